@@ -0,0 +1,515 @@
+/*
+ * core_bench.c -- microbenchmarks of the core library, no DPDK needed
+ *
+ * Every case runs until it has been timed for at least -t ms and prints one
+ * tab separated line: name, size, ops, mean and best round ns/op, Mops, and
+ * the cycles and cache misses per op when perf events are available ("-"
+ * otherwise). With -b the best ns/op are compared to a previous output and
+ * the exit code is 1 when a case is more than -T percent slower.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "kdns.h"
+#include "query.h"
+#include "radtree.h"
+#include "db_update.h"
+#include "util.h"
+
+#define BENCH_ZONE          "bench.local"
+#define BENCH_TTL           30
+#define BENCH_MAX_RESULTS   128
+#define BENCH_MAX_SIZES     8
+#define BENCH_QUERY_MAX     65536
+#define BENCH_QUERY_LEN     (DNS_HEAD_SIZE + MAXDOMAINLEN + 4)
+
+struct meter {
+    uint64_t ops;
+    uint64_t ns;
+    uint64_t cycles;
+    uint64_t misses;
+    /* fastest round, steadier than the mean on a shared machine */
+    double best;
+    struct timespec t0;
+    uint64_t c0, m0;
+};
+
+struct result {
+    char name[32];
+    uint32_t size;
+    double best;
+};
+
+enum { PERF_CYCLES, PERF_MISSES, PERF_NUM };
+
+static int perf_fd[PERF_NUM] = { -1, -1 };
+static uint64_t min_ns = 200 * 1000000ULL;
+static struct result results[BENCH_MAX_RESULTS];
+static unsigned result_num;
+
+static void perf_open(void) {
+    static const uint64_t config[PERF_NUM] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_CACHE_MISSES };
+    struct perf_event_attr pe;
+    int i;
+
+    for (i = 0; i < PERF_NUM; i++) {
+        memset(&pe, 0, sizeof(pe));
+        pe.type = PERF_TYPE_HARDWARE;
+        pe.size = sizeof(pe);
+        pe.config = config[i];
+        pe.exclude_kernel = 1;
+        pe.exclude_hv = 1;
+        perf_fd[i] = syscall(__NR_perf_event_open, &pe, 0, -1, -1, 0);
+    }
+}
+
+static uint64_t perf_read(int i) {
+    uint64_t v;
+
+    if (perf_fd[i] < 0 || read(perf_fd[i], &v, sizeof(v)) != sizeof(v))
+        return 0;
+    return v;
+}
+
+static void meter_start(struct meter *m) {
+    m->c0 = perf_read(PERF_CYCLES);
+    m->m0 = perf_read(PERF_MISSES);
+    clock_gettime(CLOCK_MONOTONIC, &m->t0);
+}
+
+static void meter_stop(struct meter *m, uint64_t ops) {
+    struct timespec t1;
+    uint64_t ns;
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ns = (t1.tv_sec - m->t0.tv_sec) * 1000000000ULL + t1.tv_nsec - m->t0.tv_nsec;
+    if (m->ops == 0 || (double)ns / ops < m->best)
+        m->best = (double)ns / ops;
+    m->ns += ns;
+    m->cycles += perf_read(PERF_CYCLES) - m->c0;
+    m->misses += perf_read(PERF_MISSES) - m->m0;
+    m->ops += ops;
+}
+
+static void perf_print(int i, uint64_t v, uint64_t ops) {
+    if (perf_fd[i] < 0)
+        printf("\t-");
+    else
+        printf("\t%.2f", (double)v / ops);
+}
+
+static void report(const char *name, uint32_t size, const struct meter *m) {
+    double ns = m->ops ? (double)m->ns / m->ops : 0;
+
+    printf("%s\t%u\t%lu\t%.1f\t%.1f\t%.3f", name, size, m->ops, ns, m->best, ns > 0 ? 1000.0 / ns : 0);
+    perf_print(PERF_CYCLES, m->cycles, m->ops);
+    perf_print(PERF_MISSES, m->misses, m->ops);
+    printf("\n");
+    fflush(stdout);
+
+    if (result_num < BENCH_MAX_RESULTS) {
+        snprintf(results[result_num].name, sizeof(results[result_num].name), "%s", name);
+        results[result_num].size = size;
+        results[result_num].best = m->best;
+        result_num++;
+    }
+}
+
+/* spreads consecutive indexes over [0, n) so lookups do not walk the tree in order */
+static inline uint32_t bench_pick(uint32_t i, uint32_t n) {
+    return (uint32_t)(((uint64_t)(i * 2654435761U) * n) >> 32);
+}
+
+static void bench_name(char *buf, size_t len, char prefix, uint32_t i) {
+    snprintf(buf, len, "%c%u.%s", prefix, i, BENCH_ZONE);
+}
+
+
+/* radix tree on the radname keys of n names */
+static void bench_radix(uint32_t n) {
+    uint8_t **keys = xalloc_array_zero(n, sizeof(uint8_t *));
+    uint16_t *lens = xalloc_array_zero(n, sizeof(uint16_t));
+    uint8_t wire[MAXDOMAINLEN], key[MAXDOMAINLEN];
+    char name[MAXDOMAINLEN];
+    struct meter ins = {0}, srch = {0};
+    struct radtree *rt;
+    uint32_t i, found = 0;
+    size_t dlen;
+
+    for (i = 0; i < n; i++) {
+        bench_name(name, sizeof(name), 'n', i);
+        domain_name_parse_wire(wire, name);
+        for (dlen = 0; wire[dlen]; dlen += wire[dlen] + 1)
+            ;
+        lens[i] = sizeof(key);
+        radomain_name_d2r(key, &lens[i], wire, dlen + 1);
+        keys[i] = xalloc(lens[i]);
+        memcpy(keys[i], key, lens[i]);
+    }
+
+    /* the tree of the last insert round is searched */
+    for (;;) {
+        rt = radix_tree_create();
+        meter_start(&ins);
+        for (i = 0; i < n; i++)
+            radix_insert(rt, keys[i], lens[i], keys[i]);
+        meter_stop(&ins, n);
+        if (ins.ns >= min_ns)
+            break;
+        radix_tree_delete(rt);
+    }
+    while (srch.ns < min_ns) {
+        meter_start(&srch);
+        for (i = 0; i < n; i++)
+            found += radix_search(rt, keys[bench_pick(i, n)], lens[bench_pick(i, n)]) != NULL;
+        meter_stop(&srch, n);
+    }
+    radix_tree_delete(rt);
+
+    if (found != srch.ops)
+        fprintf(stderr, "radix_search: %lu of %lu keys not found\n", srch.ops - found, srch.ops);
+    report("radix_insert", n, &ins);
+    report("radix_search", n, &srch);
+
+    for (i = 0; i < n; i++)
+        free(keys[i]);
+    free(keys);
+    free(lens);
+}
+
+/* domain table of n names, every insert also creates the parent chain */
+static void bench_domain_table(uint32_t n) {
+    const domain_name_st **names = xalloc_array_zero(n, sizeof(domain_name_st *));
+    domain_type *match, *encloser;
+    struct meter ins = {0}, srch = {0};
+    domain_table_type *table;
+    char name[MAXDOMAINLEN];
+    uint32_t i, found = 0;
+
+    for (i = 0; i < n; i++) {
+        bench_name(name, sizeof(name), 'n', i);
+        names[i] = domain_name_parse(name);
+    }
+
+    /* the table has no destructor, the domains of every round are leaked */
+    for (;;) {
+        table = domain_table_create();
+        meter_start(&ins);
+        for (i = 0; i < n; i++)
+            domain_table_insert(table, names[i], 0);
+        meter_stop(&ins, n);
+        if (ins.ns >= min_ns)
+            break;
+        radix_tree_delete(table->nametree);
+    }
+    while (srch.ns < min_ns) {
+        meter_start(&srch);
+        for (i = 0; i < n; i++)
+            found += domain_table_search(table, names[bench_pick(i, n)], &match, &encloser);
+        meter_stop(&srch, n);
+    }
+    radix_tree_delete(table->nametree);
+
+    if (found != srch.ops)
+        fprintf(stderr, "domain_table_search: %lu of %lu names not found\n", srch.ops - found, srch.ops);
+    report("domain_table_insert", n, &ins);
+    report("domain_table_search", n, &srch);
+}
+
+
+/*
+ * Store of n A names n<i>, n/8 CNAMEs c<i> to them and n/8 SRV names s<i>
+ * with two targets each, frozen like the lcore stores after an update burst.
+ * The stores are never released, there is no destructor for them.
+ */
+static void store_load(struct kdns *kdns, uint32_t n) {
+    char zone[] = BENCH_ZONE, name[MAXDOMAINLEN], host[MAXDOMAINLEN], ip[20];
+    uint32_t i;
+
+    memset(kdns, 0, sizeof(*kdns));
+    kdns->db = domain_store_open();
+    domain_store_zone_create(kdns->db, domain_name_parse(zone));
+    domaindata_soa_insert(kdns->db, zone);
+
+    for (i = 0; i < n; i++) {
+        bench_name(name, sizeof(name), 'n', i);
+        snprintf(ip, sizeof(ip), "10.%u.%u.%u", (i >> 16) & 0xff, (i >> 8) & 0xff, i & 0xff);
+        domaindata_a_insert(kdns->db, zone, name, ip, BENCH_TTL, 0, 0);
+    }
+    for (i = 0; i < n / 8; i++) {
+        bench_name(name, sizeof(name), 'c', i);
+        bench_name(host, sizeof(host), 'n', bench_pick(i, n));
+        domaindata_cname_insert(kdns->db, zone, name, host, BENCH_TTL, 0);
+
+        bench_name(name, sizeof(name), 's', i);
+        bench_name(host, sizeof(host), 'n', bench_pick(2 * i, n));
+        domaindata_srv_insert(kdns->db, zone, name, host, 10, 10, 8000, BENCH_TTL, 0);
+        bench_name(host, sizeof(host), 'n', bench_pick(2 * i + 1, n));
+        domaindata_srv_insert(kdns->db, zone, name, host, 10, 10, 8001, BENCH_TTL, 0);
+    }
+    domain_store_freeze(kdns->db);
+}
+
+static int query_build(uint8_t *buf, const char *name, uint16_t type) {
+    int len;
+
+    memset(buf, 0, DNS_HEAD_SIZE);
+    buf[2] = 0x01;          /* RD */
+    buf[5] = 1;             /* QDCOUNT */
+    domain_name_parse_wire(buf + DNS_HEAD_SIZE, name);
+    for (len = DNS_HEAD_SIZE; buf[len]; len += buf[len] + 1)
+        ;
+    len++;
+    buf[len++] = type >> 8;
+    buf[len++] = type & 0xff;
+    buf[len++] = 0;
+    buf[len++] = CLASS_IN;
+    return len;
+}
+
+/* query_process from the wire query to the encoded answer, as dns_packet_proess runs it */
+static void bench_query_type(struct kdns *kdns, kdns_query_st *q, const char *bname,
+        char prefix, uint32_t names, uint16_t type, uint32_t size) {
+    uint32_t num = names < BENCH_QUERY_MAX ? names : BENCH_QUERY_MAX;
+    uint8_t (*queries)[BENCH_QUERY_LEN] = xalloc_array_zero(num, BENCH_QUERY_LEN);
+    uint16_t *lens = xalloc_array_zero(num, sizeof(uint16_t));
+    uint8_t buf[EDNS_MAX_MESSAGE_LEN];
+    char name[MAXDOMAINLEN];
+    struct meter m = {0};
+    uint64_t bytes = 0;
+    uint32_t i;
+
+    for (i = 0; i < num; i++) {
+        bench_name(name, sizeof(name), prefix, bench_pick(i, names));
+        lens[i] = query_build(queries[i], name, type);
+    }
+
+    while (m.ns < min_ns) {
+        meter_start(&m);
+        for (i = 0; i < num; i++) {
+            memcpy(buf, queries[i], lens[i]);
+            query_reset(q);
+            q->packet->data = buf;
+            q->packet->position += lens[i];
+            buffer_flip(q->packet);
+            if (query_process(q, kdns) != QUERY_FAIL)
+                buffer_flip(q->packet);
+            bytes += buffer_remaining(q->packet);
+        }
+        meter_stop(&m, num);
+    }
+    if (bytes / m.ops <= lens[0])
+        fprintf(stderr, "%s: empty answers\n", bname);
+    report(bname, size, &m);
+    free(queries);
+    free(lens);
+}
+
+static void bench_query(uint32_t n) {
+    kdns_query_st *q = query_create();
+    struct kdns kdns;
+
+    store_load(&kdns, n);
+    bench_query_type(&kdns, q, "query_a", 'n', n, TYPE_A, n);
+    bench_query_type(&kdns, q, "query_nxdomain", 'x', n, TYPE_A, n);
+    if (n >= 8) {
+        bench_query_type(&kdns, q, "query_cname", 'c', n / 8, TYPE_A, n);
+        bench_query_type(&kdns, q, "query_srv", 's', n / 8, TYPE_SRV, n);
+    }
+}
+
+
+/* the question of name is in q, the answer section is encoded again on every op */
+static void bench_encode_one(struct kdns *kdns, kdns_query_st *q, const char *bname,
+        const char *name, uint16_t type, const kdns_answer_st *answer, uint32_t size) {
+    uint8_t buf[EDNS_MAX_MESSAGE_LEN];
+    struct meter m = {0};
+    size_t qend;
+    uint32_t i, j;
+
+    query_reset(q);
+    q->packet->data = buf;
+    q->packet->position += query_build(buf, name, type);
+    buffer_flip(q->packet);
+    query_process(q, kdns);
+    qend = DNS_HEAD_SIZE + domain_name_total_size(q->qname) + 4;
+    q->maxMsgLen = EDNS_MAX_MESSAGE_LEN;
+
+    while (m.ns < min_ns) {
+        meter_start(&m);
+        for (i = 0; i < 1024; i++) {
+            buffer_set_position(q->packet, qend);
+            buffer_setlimit(q->packet, sizeof(buf));
+            buf[2] &= ~TC_MASK;
+            encode_answer(q, answer);
+            for (j = 0; j < q->compressed_count; j++)
+                q->compressed_dnames[j]->compressed_offset = 0;
+            q->compressed_count = 0;
+        }
+        meter_stop(&m, 1024);
+    }
+    if (GET_FLAG_TC(q->packet) || GET_AN_COUNT(q->packet) == 0)
+        fprintf(stderr, "%s: answer of %u truncated or empty\n", bname, size);
+    report(bname, size, &m);
+}
+
+/* A, AAAA, CNAME and SRV answers of size records, the SRV targets go to the additional section */
+static void bench_encode(uint32_t size) {
+    char zone[] = BENCH_ZONE, name[MAXDOMAINLEN], host[MAXDOMAINLEN], ip[20], ip6[40];
+    kdns_query_st *q = query_create();
+    zone_type *zo;
+    domain_type *d, *t;
+    kdns_answer_st answer;
+    struct kdns kdns;
+    uint32_t i;
+
+    store_load(&kdns, 0);
+    zo = domain_store_find_zone(kdns.db, domain_name_parse(zone));
+    for (i = 0; i < size; i++) {
+        snprintf(ip, sizeof(ip), "10.0.%u.%u", i >> 8, i & 0xff);
+        domaindata_a_insert(kdns.db, zone, "a." BENCH_ZONE, ip, BENCH_TTL, 0, 0);
+        snprintf(ip6, sizeof(ip6), "fd00::%x", i + 1);
+        domaindata_aaaa_insert(kdns.db, zone, "a." BENCH_ZONE, ip6, BENCH_TTL, 0, 0);
+        bench_name(host, sizeof(host), 't', i);
+        domaindata_a_insert(kdns.db, zone, host, ip, BENCH_TTL, 0, 0);
+        domaindata_srv_insert(kdns.db, zone, "s." BENCH_ZONE, host, 10, 10, 8000 + i, BENCH_TTL, 0);
+    }
+    domaindata_cname_insert(kdns.db, zone, "c." BENCH_ZONE, "a." BENCH_ZONE, BENCH_TTL, 0);
+
+    memset(&answer, 0, sizeof(answer));
+    d = domain_table_find(kdns.db->domains, domain_name_parse("a." BENCH_ZONE));
+    answer_add_rrset(&answer, ANSWER_SECTION, d, domain_find_rrset(d, zo, TYPE_A));
+    bench_encode_one(&kdns, q, "encode_a", "a." BENCH_ZONE, TYPE_A, &answer, size);
+
+    memset(&answer, 0, sizeof(answer));
+    answer_add_rrset(&answer, ANSWER_SECTION, d, domain_find_rrset(d, zo, TYPE_AAAA));
+    bench_encode_one(&kdns, q, "encode_aaaa", "a." BENCH_ZONE, TYPE_AAAA, &answer, size);
+
+    memset(&answer, 0, sizeof(answer));
+    t = domain_table_find(kdns.db->domains, domain_name_parse("c." BENCH_ZONE));
+    answer_add_rrset(&answer, ANSWER_SECTION, t, domain_find_rrset(t, zo, TYPE_CNAME));
+    answer_add_rrset(&answer, ANSWER_SECTION, d, domain_find_rrset(d, zo, TYPE_A));
+    bench_encode_one(&kdns, q, "encode_cname", "c." BENCH_ZONE, TYPE_A, &answer, size);
+
+    memset(&answer, 0, sizeof(answer));
+    d = domain_table_find(kdns.db->domains, domain_name_parse("s." BENCH_ZONE));
+    answer_add_rrset(&answer, ANSWER_SECTION, d, domain_find_rrset(d, zo, TYPE_SRV));
+    for (i = 0; i < size; i++) {
+        bench_name(name, sizeof(name), 't', i);
+        t = domain_table_find(kdns.db->domains, domain_name_parse(name));
+        answer_add_rrset(&answer, ADDITIONAL_SECTION, t, domain_find_rrset(t, zo, TYPE_A));
+    }
+    bench_encode_one(&kdns, q, "encode_srv", "s." BENCH_ZONE, TYPE_SRV, &answer, size);
+}
+
+
+/* 1 if a case of the baseline file is more than tolerance percent slower now */
+static int baseline_check(const char *path, double tolerance) {
+    char line[256], name[32];
+    double ns;
+    uint32_t size;
+    unsigned i;
+    int regress = 0;
+    FILE *f = fopen(path, "r");
+
+    if (!f) {
+        fprintf(stderr, "cannot open baseline %s\n", path);
+        return 1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "%31s %u %*u %*f %lf", name, &size, &ns) != 3)
+            continue;
+        for (i = 0; i < result_num; i++) {
+            if (results[i].size != size || strcmp(results[i].name, name) != 0)
+                continue;
+            if (results[i].best > ns * (1 + tolerance / 100)) {
+                fprintf(stderr, "regression: %s %u %.1f ns/op, baseline %.1f\n",
+                        name, size, results[i].best, ns);
+                regress = 1;
+            }
+        }
+    }
+    fclose(f);
+    return regress;
+}
+
+static int sizes_parse(const char *arg, uint32_t *sizes) {
+    char buf[128], *tok, *save = NULL;
+    int num = 0;
+
+    snprintf(buf, sizeof(buf), "%s", arg);
+    for (tok = strtok_r(buf, ",", &save); tok && num < BENCH_MAX_SIZES; tok = strtok_r(NULL, ",", &save)) {
+        sizes[num] = strtoul(tok, NULL, 10);
+        if (sizes[num] == 0)
+            return -1;
+        num++;
+    }
+    return num;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-t ms] [-n names,...] [-e rrs,...] [-b baseline] [-T percent]\n"
+            "  -t  minimum timed duration of every case (200)\n"
+            "  -n  table and store sizes (1000,100000)\n"
+            "  -e  records per encoded answer (1,4,16,64)\n"
+            "  -b  compare to a previous output, exit 1 on regression\n"
+            "  -T  tolerated slowdown in percent (10)\n", prog);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    uint32_t names[BENCH_MAX_SIZES] = { 1000, 100000 }, rrs[BENCH_MAX_SIZES] = { 1, 4, 16, 64 };
+    int name_num = 2, rr_num = 4, i, opt;
+    const char *baseline = NULL;
+    double tolerance = 10;
+
+    while ((opt = getopt(argc, argv, "t:n:e:b:T:h")) != -1) {
+        switch (opt) {
+        case 't':
+            min_ns = strtoull(optarg, NULL, 10) * 1000000ULL;
+            break;
+        case 'n':
+            if ((name_num = sizes_parse(optarg, names)) <= 0)
+                usage(argv[0]);
+            break;
+        case 'e':
+            if ((rr_num = sizes_parse(optarg, rrs)) <= 0)
+                usage(argv[0]);
+            break;
+        case 'b':
+            baseline = optarg;
+            break;
+        case 'T':
+            tolerance = strtod(optarg, NULL);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    log_open("/dev/null");
+    perf_open();
+    printf("# kdns core bench\n");
+    printf("bench\tsize\tops\tns_per_op\tbest_ns_per_op\tmops\tcycles_per_op\tmisses_per_op\n");
+
+    for (i = 0; i < name_num; i++) {
+        bench_radix(names[i]);
+        bench_domain_table(names[i]);
+        bench_query(names[i]);
+    }
+    for (i = 0; i < rr_num; i++) {
+        bench_encode(rrs[i]);
+    }
+
+    if (baseline)
+        return baseline_check(baseline, tolerance);
+    return 0;
+}
@@ -0,0 +1,425 @@
+/*
+ * update_bench.c -- update propagation benchmark against a running kdns
+ *
+ * Posts A records u<i>.<zone> through the web API at a fixed rate, one at a
+ * time or in back-to-back batches, while a UDP query load measures the query
+ * round trip before and during the updates. The propagation figures come from
+ * the "update" object of /kdns/statistics/get: time from the API to the
+ * dispatch by the master, to the apply on each lcore and to the apply on
+ * every lcore, and the depth of the msg rings. The output is tab separated.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <jansson.h>
+
+#include "lat_hist.h"
+
+#define HTTP_BUF_SIZE       65536
+#define DNS_BUF_SIZE        512
+#define QUERY_WAIT_MS       1000
+#define DNS_MAX_SOCKS       64
+
+enum { PHASE_IDLE, PHASE_UPDATE, PHASE_DONE };
+
+struct bench_opts {
+    const char *web_addr;
+    uint16_t web_port;
+    const char *dns_addr;
+    uint16_t dns_port;
+    const char *zone;
+    const char *qname;
+    uint32_t rate;
+    uint32_t batch;
+    uint32_t updates;
+    uint32_t qps;
+    uint32_t socks;
+    uint32_t idle_secs;
+    uint32_t drain_secs;
+    int keep;
+};
+
+static struct bench_opts opts = {
+    .web_addr = "127.0.0.1",
+    .web_port = 5500,
+    .dns_port = 53,
+    .zone = "tst.local",
+    .rate = 100,
+    .batch = 1,
+    .updates = 1000,
+    .qps = 1000,
+    .socks = 8,
+    .idle_secs = 3,
+    .drain_secs = 10,
+};
+
+static volatile int phase = PHASE_IDLE;
+/* one flow per socket, so RSS spreads the queries over the lcores */
+static int dns_fds[DNS_MAX_SOCKS];
+static int dns_fd_num;
+static uint64_t query_sent_at[65536];
+static uint64_t query_sent[PHASE_DONE], query_answered[PHASE_DONE];
+static struct lat_hist query_hist[PHASE_DONE], post_hist;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void sleep_until_us(uint64_t t) {
+    struct timespec ts = { .tv_sec = t / 1000000, .tv_nsec = (t % 1000000) * 1000 };
+
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+
+static int http_connect(void) {
+    struct sockaddr_in sa;
+    int fd, one = 1;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(opts.web_port);
+    inet_pton(AF_INET, opts.web_addr, &sa.sin_addr);
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* one request on a keep-alive connection, the body of the answer is left in resp */
+static int http_once(int fd, const char *method, const char *path, const char *body, char *resp) {
+    char req[1024];
+    size_t got = 0, need = 0;
+    ssize_t n;
+    char *hdr_end = NULL, *cl;
+    int len;
+
+    len = snprintf(req, sizeof(req), "%s %s HTTP/1.1\r\nHost: %s\r\nContent-Type: application/json\r\n"
+            "Content-Length: %zu\r\nConnection: keep-alive\r\n\r\n%s",
+            method, path, opts.web_addr, body ? strlen(body) : 0, body ? body : "");
+    if (len >= (int)sizeof(req) || write(fd, req, len) != len)
+        return -1;
+
+    while (hdr_end == NULL || got < need) {
+        n = read(fd, resp + got, HTTP_BUF_SIZE - 1 - got);
+        if (n <= 0)
+            return -1;
+        got += n;
+        resp[got] = '\0';
+        if (hdr_end == NULL && (hdr_end = strstr(resp, "\r\n\r\n")) != NULL) {
+            cl = strcasestr(resp, "Content-Length:");
+            need = (hdr_end - resp) + 4 + (cl && cl < hdr_end ? strtoul(cl + 15, NULL, 10) : 0);
+            if (need >= HTTP_BUF_SIZE)
+                return -1;
+        }
+    }
+    memmove(resp, hdr_end + 4, need - (hdr_end + 4 - resp));
+    resp[need - (hdr_end + 4 - resp)] = '\0';
+    return 0;
+}
+
+static int http_request(int *fd, const char *method, const char *path, const char *body, char *resp) {
+    int retry;
+
+    /* the server may have closed an idle keep-alive connection */
+    for (retry = 0; retry < 2; retry++) {
+        if (*fd < 0 && (*fd = http_connect()) < 0)
+            return -1;
+        if (http_once(*fd, method, path, body, resp) == 0)
+            return 0;
+        close(*fd);
+        *fd = -1;
+    }
+    return -1;
+}
+
+static void record_body(char *buf, size_t len, uint32_t i) {
+    snprintf(buf, len, "{\"type\":\"A\",\"zoneName\":\"%s\",\"domainName\":\"u%u.%s\",\"host\":\"10.%u.%u.%u\"}",
+            opts.zone, i, opts.zone, (i >> 16) & 0xff, (i >> 8) & 0xff, i & 0xff);
+}
+
+
+static int dns_query_build(uint8_t *buf, uint16_t id, const char *name) {
+    const char *p = name, *dot;
+    int len = 12;
+
+    memset(buf, 0, 12);
+    buf[0] = id >> 8;
+    buf[1] = id & 0xff;
+    buf[2] = 0x01;
+    buf[5] = 1;
+    while (*p) {
+        dot = strchr(p, '.');
+        if (dot == NULL)
+            dot = p + strlen(p);
+        if (dot - p > 63 || len + (dot - p) + 6 > DNS_BUF_SIZE)
+            return -1;
+        buf[len++] = dot - p;
+        memcpy(buf + len, p, dot - p);
+        len += dot - p;
+        p = *dot ? dot + 1 : dot;
+    }
+    buf[len++] = 0;
+    buf[len++] = 0;
+    buf[len++] = 1;     /* A */
+    buf[len++] = 0;
+    buf[len++] = 1;     /* IN */
+    return len;
+}
+
+/* open loop: the queries due at the rate are sent whatever the answers do */
+static void *query_sender(__attribute__((unused)) void *arg) {
+    uint8_t buf[DNS_BUF_SIZE];
+    uint64_t start = now_us(), sent = 0, due;
+    uint16_t id = 0;
+    int len, p;
+
+    while ((p = phase) != PHASE_DONE) {
+        due = (now_us() - start) * opts.qps / 1000000;
+        for (; sent < due; sent++, id++) {
+            len = dns_query_build(buf, id, opts.qname);
+            query_sent_at[id] = now_us();
+            if (send(dns_fds[id % dns_fd_num], buf, len, 0) == len)
+                query_sent[p]++;
+        }
+        usleep(100);
+    }
+    return NULL;
+}
+
+static void *query_receiver(__attribute__((unused)) void *arg) {
+    uint8_t buf[DNS_BUF_SIZE];
+    struct pollfd pfds[DNS_MAX_SOCKS];
+    uint16_t id;
+    ssize_t n;
+    int i, p;
+
+    for (i = 0; i < dns_fd_num; i++) {
+        pfds[i].fd = dns_fds[i];
+        pfds[i].events = POLLIN;
+    }
+    while ((p = phase) != PHASE_DONE) {
+        if (poll(pfds, dns_fd_num, 100) <= 0)
+            continue;
+        for (i = 0; i < dns_fd_num; i++) {
+            if (!(pfds[i].revents & POLLIN))
+                continue;
+            n = recv(dns_fds[i], buf, sizeof(buf), MSG_DONTWAIT);
+            if (n < 12)
+                continue;
+            id = (buf[0] << 8) | buf[1];
+            if (query_sent_at[id] == 0)
+                continue;
+            lat_hist_add(&query_hist[p], now_us() - query_sent_at[id]);
+            query_sent_at[id] = 0;
+            query_answered[p]++;
+        }
+    }
+    return NULL;
+}
+
+static int dns_open(void) {
+    struct sockaddr_in sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(opts.dns_port);
+    if (inet_pton(AF_INET, opts.dns_addr, &sa.sin_addr) != 1)
+        return -1;
+    for (dns_fd_num = 0; dns_fd_num < (int)opts.socks; dns_fd_num++) {
+        dns_fds[dns_fd_num] = socket(AF_INET, SOCK_DGRAM, 0);
+        if (dns_fds[dns_fd_num] < 0 || connect(dns_fds[dns_fd_num], (struct sockaddr *)&sa, sizeof(sa)) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+
+static json_t *stats_get(int *fd, char *resp) {
+    json_t *root, *update;
+
+    if (http_request(fd, "GET", "/kdns/statistics/get", NULL, resp) < 0)
+        return NULL;
+    root = json_loads(resp, 0, NULL);
+    update = root ? json_object_get(root, "update") : NULL;
+    if (update)
+        json_incref(update);
+    json_decref(root);
+    return update;
+}
+
+static void print_hist(const char *metric, const char *lcore, uint64_t lost, const struct lat_hist *h) {
+    printf("%s\t%s\t%lu\t%lu\t%lu\t%lu\t%lu\t%lu\t%lu\n", metric, lcore, h->count, lost,
+            lat_hist_quantile(h, 0.5), lat_hist_quantile(h, 0.9), lat_hist_quantile(h, 0.99),
+            lat_hist_quantile(h, 0.999), h->max);
+}
+
+static void print_server_hist(const char *metric, const char *lcore, json_t *h) {
+    printf("%s\t%s\t%lld\t0\t%lld\t%lld\t%lld\t%lld\t%lld\n", metric, lcore,
+            json_integer_value(json_object_get(h, "count")),
+            json_integer_value(json_object_get(h, "p50_us")), json_integer_value(json_object_get(h, "p90_us")),
+            json_integer_value(json_object_get(h, "p99_us")), json_integer_value(json_object_get(h, "p999_us")),
+            json_integer_value(json_object_get(h, "max_us")));
+}
+
+static void report(json_t *update, uint64_t post_failed) {
+    json_t *lcore;
+    size_t i;
+    char id[16];
+
+    printf("metric\tlcore\tcount\tlost\tp50_us\tp90_us\tp99_us\tp999_us\tmax_us\n");
+    print_hist("post", "-", post_failed, &post_hist);
+    if (dns_fd_num > 0) {
+        print_hist("query_idle", "-", query_sent[PHASE_IDLE] - query_answered[PHASE_IDLE], &query_hist[PHASE_IDLE]);
+        print_hist("query_update", "-", query_sent[PHASE_UPDATE] - query_answered[PHASE_UPDATE], &query_hist[PHASE_UPDATE]);
+    }
+    if (update == NULL)
+        return;
+    print_server_hist("dispatch", "-", json_object_get(update, "master"));
+    json_array_foreach(json_object_get(update, "lcores"), i, lcore) {
+        snprintf(id, sizeof(id), "%lld", json_integer_value(json_object_get(lcore, "lcore")));
+        print_server_hist("apply", id, lcore);
+    }
+    print_server_hist("visible_all", "-", json_object_get(update, "all"));
+
+    printf("ring\tlcore\tdepth\thwm\n");
+    printf("ring\tmaster\t%lld\t%lld\n", json_integer_value(json_object_get(update, "master_ring_count")),
+            json_integer_value(json_object_get(update, "master_ring_hwm")));
+    json_array_foreach(json_object_get(update, "lcores"), i, lcore) {
+        printf("ring\t%lld\t%lld\t%lld\n", json_integer_value(json_object_get(lcore, "lcore")),
+                json_integer_value(json_object_get(lcore, "ring_count")),
+                json_integer_value(json_object_get(lcore, "ring_hwm")));
+    }
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [options]\n"
+            "  -a addr   web API address (127.0.0.1)\n"
+            "  -p port   web API port (5500)\n"
+            "  -z zone   zone of the records (tst.local)\n"
+            "  -n num    records to add (1000)\n"
+            "  -r rate   records per second (100)\n"
+            "  -b num    records posted back to back per batch (1)\n"
+            "  -d addr   DNS address for the query load, none by default\n"
+            "  -P port   DNS port (53)\n"
+            "  -q qps    query rate (1000)\n"
+            "  -Q name   queried name (u0.<zone>)\n"
+            "  -S num    query sockets, one flow each (8)\n"
+            "  -i sec    query load before the updates (3)\n"
+            "  -w sec    wait for the propagation after the last post (10)\n"
+            "  -k        keep the records, they are deleted by default\n", prog);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    static char resp[HTTP_BUF_SIZE];
+    char body[512], qname[256];
+    pthread_t sender, receiver;
+    uint64_t start, t, post_failed = 0, posted = 0;
+    uint32_t i, j;
+    json_t *update = NULL;
+    int opt, fd = -1;
+
+    while ((opt = getopt(argc, argv, "a:p:z:n:r:b:d:P:q:Q:S:i:w:kh")) != -1) {
+        switch (opt) {
+        case 'a': opts.web_addr = optarg; break;
+        case 'p': opts.web_port = atoi(optarg); break;
+        case 'z': opts.zone = optarg; break;
+        case 'n': opts.updates = strtoul(optarg, NULL, 10); break;
+        case 'r': opts.rate = strtoul(optarg, NULL, 10); break;
+        case 'b': opts.batch = strtoul(optarg, NULL, 10); break;
+        case 'd': opts.dns_addr = optarg; break;
+        case 'P': opts.dns_port = atoi(optarg); break;
+        case 'q': opts.qps = strtoul(optarg, NULL, 10); break;
+        case 'Q': opts.qname = optarg; break;
+        case 'S': opts.socks = strtoul(optarg, NULL, 10); break;
+        case 'i': opts.idle_secs = strtoul(optarg, NULL, 10); break;
+        case 'w': opts.drain_secs = strtoul(optarg, NULL, 10); break;
+        case 'k': opts.keep = 1; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (opts.rate == 0 || opts.batch == 0 || opts.updates == 0 || opts.socks == 0 || opts.socks > DNS_MAX_SOCKS)
+        usage(argv[0]);
+    if (opts.qname == NULL) {
+        snprintf(qname, sizeof(qname), "u0.%s", opts.zone);
+        opts.qname = qname;
+    }
+
+    if (http_request(&fd, "POST", "/kdns/statistics/reset", "", resp) < 0) {
+        fprintf(stderr, "cannot reach the web API on %s:%u\n", opts.web_addr, opts.web_port);
+        return 1;
+    }
+    if (opts.dns_addr && opts.qps) {
+        if (dns_open() < 0) {
+            fprintf(stderr, "cannot open the DNS socket to %s:%u\n", opts.dns_addr, opts.dns_port);
+            return 1;
+        }
+        pthread_create(&receiver, NULL, query_receiver, NULL);
+        pthread_create(&sender, NULL, query_sender, NULL);
+        sleep(opts.idle_secs);
+    }
+
+    printf("# kdns update bench: %u records, %u/s, batch %u, %u queries/s\n",
+            opts.updates, opts.rate, opts.batch, dns_fd_num > 0 ? opts.qps : 0);
+    phase = PHASE_UPDATE;
+    start = now_us();
+    for (i = 0; i < opts.updates; i += opts.batch) {
+        sleep_until_us(start + (uint64_t)i * 1000000 / opts.rate);
+        for (j = i; j < i + opts.batch && j < opts.updates; j++) {
+            record_body(body, sizeof(body), j);
+            t = now_us();
+            if (http_request(&fd, "POST", "/kdns/domain", body, resp) < 0 || strncmp(resp, "OK", 2) != 0) {
+                post_failed++;
+                continue;
+            }
+            lat_hist_add(&post_hist, now_us() - t);
+            posted++;
+        }
+    }
+
+    /* every posted record applied on every lcore, or the wait is over */
+    for (t = now_us(); now_us() - t < opts.drain_secs * 1000000ULL; usleep(100000)) {
+        json_decref(update);
+        update = stats_get(&fd, resp);
+        if (update == NULL || (uint64_t)json_integer_value(json_object_get(json_object_get(update, "all"), "count")) >= posted)
+            break;
+    }
+    usleep(QUERY_WAIT_MS * 1000);
+    phase = PHASE_DONE;
+    if (dns_fd_num > 0) {
+        pthread_join(sender, NULL);
+        pthread_join(receiver, NULL);
+    }
+
+    report(update, post_failed);
+    json_decref(update);
+
+    if (!opts.keep) {
+        for (i = 0; i < opts.updates; i++) {
+            record_body(body, sizeof(body), i);
+            http_request(&fd, "DELETE", "/kdns/domain", body, resp);
+        }
+    }
+    return 0;
+}
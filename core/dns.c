@@ -30,6 +30,9 @@ static rrtype_descriptor_st rrtype_descriptors[TYPE_SUPPORT_MAX] = {
 	{ TYPE_SOA, "SOA", 7, 7,
 	  { RDATA_WF_COMPRESSED_DNAME, RDATA_WF_COMPRESSED_DNAME, RDATA_WF_LONG,
 	    RDATA_WF_LONG, RDATA_WF_LONG, RDATA_WF_LONG, RDATA_WF_LONG } },
+	/* 28 */
+	{ TYPE_AAAA, "AAAA", 1, 1,
+	  { RDATA_WF_AAAA } },
 	// 33 
    { TYPE_SRV, "SRV", 4, 4,
 	  { RDATA_WF_SHORT, RDATA_WF_SHORT, RDATA_WF_SHORT,
@@ -388,7 +391,7 @@ domain_name_label_match_count(const domain_name_st *left, const domain_name_st *
 const char *
 domain_name_to_string(const domain_name_st *dname, const domain_name_st *origin)
 {
-    char buf[MAXDOMAINLEN * 5] ={0};
+	static __thread char buf[MAXDOMAINLEN * 5];
 	size_t i;
 	size_t labels_to_convert = dname->label_count - 1;
 	int absolute = 1;
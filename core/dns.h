@@ -57,7 +57,9 @@ typedef enum rr_section {
 #define TYPE_A		1	/* a host address */
 #define TYPE_CNAME	5	/* the canonical name for an alias */
 #define TYPE_SOA	6	/* marks the start of a zone of authority */
+#define TYPE_AAAA	28	/* ipv6 address */
 #define TYPE_SRV	33	/* SRV record RFC2782 */
+#define TYPE_OPT	41	/* EDNS pseudo RR, RFC 6891 */
 
 
 #define TYPE_SUPPORT_MAX  5
@@ -393,8 +395,8 @@ label_next(const uint8_t *label)
 
 /*
  * Convert DNAME to its string representation.  The result points to a
- * static buffer that is overwritten the next time this function is
- * invoked.
+ * per-thread static buffer that is overwritten the next time this
+ * function is invoked by the same thread.
  *
  * If ORIGIN is provided and DNAME is a subdomain of ORIGIN the dname
  * will be represented relative to ORIGIN.
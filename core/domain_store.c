@@ -16,7 +16,11 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "buffer.h"
 #include "domain_store.h"
+#include "slab.h"
+#include "util.h"
+#include "zone.h"
 
 static domain_type *
 allocate_domain_info(domain_table_type* table,
@@ -25,12 +29,20 @@ allocate_domain_info(domain_table_type* table,
 {
 	
 	domain_type *d;
-
-	d = (domain_type *) xalloc(sizeof(domain_type));
-        d->dname = (domain_name_st*) domain_name_partial_copy(dname, domain_dname(parent)->label_count + 1);
+	uint8_t buf[sizeof(domain_name_st) + MAXDOMAINLEN * 2];
+	const domain_name_st *name;
+
+	/* build the name on the stack and keep an exactly sized copy */
+	name = domain_name_make_no_malloc(domain_name_label(dname,
+		domain_dname(parent)->label_count), 0, (domain_name_st *) buf);
+	d = (domain_type *) slab_alloc(SLAB_DOMAIN, sizeof(domain_type));
+	d->dname = (domain_name_st *) slab_alloc(SLAB_DNAME,
+		domain_name_total_size(name));
+	memcpy(d->dname, name, domain_name_total_size(name));
 	d->parent = parent;
 	d->wildcard_child_closest_match = d;
 	d->rrsets = NULL;
+	memset(d->rrset_types, 0, sizeof(d->rrset_types));
 	d->usage = 0;
 	d->is_existing = 0;
 	d->is_apex = 0;
@@ -39,6 +51,63 @@ allocate_domain_info(domain_table_type* table,
 	return d;
 }
 
+static void
+domain_free(domain_type* domain)
+{
+    slab_free(SLAB_DNAME, domain_dname(domain),
+        domain_name_total_size(domain_dname(domain)));
+    slab_free(SLAB_DOMAIN, domain, sizeof(domain_type));
+}
+
+/* clear the changed names, the deleted ones are freed */
+static void
+domain_table_frozen_release(domain_table_type* table)
+{
+	uint32_t i;
+
+	for(i = 0; i < table->changed_num; i++) {
+		if(table->changed[i]->frozen_deleted)
+			domain_free(table->changed[i]);
+		else
+			table->changed[i]->frozen_changed = 0;
+	}
+	table->changed_num = 0;
+}
+
+static void
+domain_table_frozen_set(domain_table_type* table, struct radcompact* frozen)
+{
+	struct radcompact* old = table->frozen;
+
+	/* lookups run on this thread, none is in the old copy */
+	table->frozen = frozen;
+	domain_table_frozen_release(table);
+	radcompact_delete(old);
+}
+
+/*
+ * Names at or below domain changed, lookups in the frozen index that end on
+ * it must use the radix tree. Returns 1 if domain is tracked until the index
+ * is replaced, 0 if there is no index to track it for.
+ */
+static int
+domain_table_frozen_mark(domain_table_type* table, domain_type* domain)
+{
+	table->frozen_stale = 1;
+	if(!table->frozen)
+		return 0;
+	if(domain->frozen_changed)
+		return 1;
+	if(table->changed_num == FROZEN_CHANGED_MAX) {
+		/* too many to track, use the radix tree until the next build */
+		domain_table_frozen_set(table, NULL);
+		return 0;
+	}
+	domain->frozen_changed = 1;
+	table->changed[table->changed_num++] = domain;
+	return 1;
+}
+
 /** see if a domain is eligible to be deleted, and thus is not used */
 static int
 domain_can_be_deleted(domain_type* domain)
@@ -70,8 +139,12 @@ do_deldomain(domain_store_type* db, domain_type* domain)
 
     radix_delete(db->domains->nametree, domain->rnode);
     db->domains->number_total--;
-    free(domain_dname(domain));
-    free(domain);
+    /* the frozen index may still point to it */
+    if (domain_table_frozen_mark(db->domains, domain)) {
+        domain->frozen_deleted = 1;
+        return;
+    }
+    domain_free(domain);
 }
 
 void
@@ -91,14 +164,384 @@ domain_table_deldomain(domain_store_type* db, domain_type* domain)
 void
 add_rdata_to_recyclebin(rr_type* rr)
 {
-	/* add rdatas to recycle bin. */
+	/* only the SOA rdata is not stored in the rr */
+	if(rr->type == TYPE_SOA)
+		slab_free(SLAB_RDATA, rr->rdata.soa, sizeof(struct soa_rdata));
+}
+
+static inline uint16_t
+rr_select_weight(rr_type* rr)
+{
+	return rr->weight ? rr->weight : 1;
+}
+
+static inline uint32_t
+fnv_hash(uint32_t h, const void* data, size_t len)
+{
+	const uint8_t* d = (const uint8_t*)data;
 	size_t i;
-	for(i=0; i<rr->rdata_count; i++)
-	{
-		if(!rdata_atom_is_domain(rr->type, i))
-            free(rr->rdatas[i].data);
+	for(i=0; i<len; i++) {
+		h ^= d[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/* FNV-1a over the rdata, domain references hash by pointer */
+static uint32_t
+rr_rdata_hash(rr_type* rr)
+{
+	uint32_t h = 2166136261u;
+	switch(rr->type) {
+	case TYPE_A:
+		return fnv_hash(h, rr->rdata.a, sizeof(rr->rdata.a));
+	case TYPE_AAAA:
+		return fnv_hash(h, rr->rdata.aaaa, sizeof(rr->rdata.aaaa));
+	case TYPE_SRV:
+		h = fnv_hash(h, rr->rdata.srv.fixed, sizeof(rr->rdata.srv.fixed));
+		return fnv_hash(h, &rr->rdata.srv.target,
+			sizeof(rr->rdata.srv.target));
+	case TYPE_CNAME:
+		return fnv_hash(h, &rr->rdata.target, sizeof(rr->rdata.target));
+	case TYPE_SOA:
+		h = fnv_hash(h, &rr->rdata.soa->mname, 2 * sizeof(domain_type*));
+		return fnv_hash(h, &rr->rdata.soa->serial, 5 * sizeof(uint32_t));
+	default:
+		return h;
+	}
+}
+
+static inline size_t
+rrset_index_size(uint32_t slots)
+{
+	return sizeof(struct rrset_index) + slots * sizeof(uint16_t);
+}
+
+static void
+rrset_index_free(rrset_type* rrset)
+{
+	if(!rrset->index)
+		return;
+	slab_free(SLAB_RRSET_INDEX, rrset->index,
+		rrset_index_size(rrset->index->mask + 1));
+	rrset->index = NULL;
+}
+
+static void
+rrset_weight_add(struct rrset_index* ix, uint16_t w)
+{
+	if(w < ix->weight_min) {
+		ix->weight_min = w;
+		ix->weight_min_count = 1;
+	} else if(w == ix->weight_min) {
+		ix->weight_min_count++;
+	}
+	if(w > ix->weight_max) {
+		ix->weight_max = w;
+		ix->weight_max_count = 1;
+	} else if(w == ix->weight_max) {
+		ix->weight_max_count++;
+	}
+}
+
+static void
+rrset_weight_bounds(rrset_type* rrset)
+{
+	struct rrset_index* ix = rrset->index;
+	uint16_t i;
+
+	ix->weight_min = UINT16_MAX;
+	ix->weight_max = 0;
+	ix->weight_min_count = ix->weight_max_count = 0;
+	for(i=0; i<rrset->rr_count; i++)
+		rrset_weight_add(ix, rr_select_weight(&rrset->rrs[i]));
+}
+
+/* an rr of weight w has left the rrset */
+static void
+rrset_weight_del(rrset_type* rrset, uint16_t w)
+{
+	struct rrset_index* ix = rrset->index;
+
+	if((w == ix->weight_min && --ix->weight_min_count == 0) ||
+		(w == ix->weight_max && --ix->weight_max_count == 0))
+		rrset_weight_bounds(rrset);
+}
+
+static void
+rrset_index_put(rrset_type* rrset, uint16_t pos)
+{
+	struct rrset_index* ix = rrset->index;
+	uint32_t i = rr_rdata_hash(&rrset->rrs[pos]) & ix->mask;
+
+	while(ix->slots[i])
+		i = (i + 1) & ix->mask;
+	ix->slots[i] = pos + 1;
+	rrset_weight_add(ix, rr_select_weight(&rrset->rrs[pos]));
+}
+
+/* (re)build the index at a load of at most a quarter */
+static void
+rrset_index_build(rrset_type* rrset)
+{
+	uint32_t slots = RRSET_INDEX_MIN * 2;
+	uint16_t i;
+
+	while(slots < (uint32_t)rrset->rr_count * 4)
+		slots <<= 1;
+	rrset_index_free(rrset);
+	rrset->index = (struct rrset_index*)slab_alloc_zero(SLAB_RRSET_INDEX,
+		rrset_index_size(slots));
+	rrset->index->mask = slots - 1;
+	rrset->index->weight_min = UINT16_MAX;
+	rrset->index->weight_max = 0;
+	for(i=0; i<rrset->rr_count; i++)
+		rrset_index_put(rrset, i);
+}
+
+/* slot of the rr at pos, which is in the index */
+static uint32_t
+rrset_index_slot(rrset_type* rrset, uint16_t pos)
+{
+	struct rrset_index* ix = rrset->index;
+	uint32_t i = rr_rdata_hash(&rrset->rrs[pos]) & ix->mask;
+
+	while(ix->slots[i] != pos + 1)
+		i = (i + 1) & ix->mask;
+	return i;
+}
+
+/* empty slot i, entries of the probe run behind it shift back */
+static void
+rrset_index_clear(rrset_type* rrset, uint32_t i)
+{
+	struct rrset_index* ix = rrset->index;
+	uint32_t j = i, home;
+
+	while(1) {
+		j = (j + 1) & ix->mask;
+		if(!ix->slots[j])
+			break;
+		home = rr_rdata_hash(&rrset->rrs[ix->slots[j] - 1]) & ix->mask;
+		if(((j - home) & ix->mask) >= ((j - i) & ix->mask)) {
+			ix->slots[i] = ix->slots[j];
+			i = j;
+		}
+	}
+	ix->slots[i] = 0;
+}
+
+static inline size_t
+rrset_wire_size(uint16_t stride, uint32_t capacity)
+{
+	return sizeof(struct rrset_wire) + (size_t)stride * capacity;
+}
+
+static void
+rrset_wire_free(rrset_type* rrset)
+{
+	if(!rrset->wire)
+		return;
+	slab_free(SLAB_RRSET_WIRE, rrset->wire,
+		rrset_wire_size(rrset->wire->stride, rrset->rr_capacity));
+	rrset->wire = NULL;
+}
+
+/*
+ * Render rr without its owner into buf, which holds RR_WIRE_MAX bytes.
+ * Returns the length, 0 for types that are not pre-rendered.
+ */
+static uint16_t
+rr_wire_render(rr_type* rr, uint8_t* buf)
+{
+	const domain_name_st* target;
+	uint8_t* rdata = buf + 12;
+	uint16_t rdlength;
+
+	switch(rr->type) {
+	case TYPE_A:
+		memcpy(rdata, rr->rdata.a, sizeof(rr->rdata.a));
+		rdlength = sizeof(rr->rdata.a);
+		break;
+	case TYPE_AAAA:
+		memcpy(rdata, rr->rdata.aaaa, sizeof(rr->rdata.aaaa));
+		rdlength = sizeof(rr->rdata.aaaa);
+		break;
+	case TYPE_SRV:
+		target = domain_dname(rr->rdata.srv.target);
+		memcpy(rdata, rr->rdata.srv.fixed, sizeof(rr->rdata.srv.fixed));
+		memcpy(rdata + sizeof(rr->rdata.srv.fixed), domain_name_get(target),
+			target->name_size);
+		rdlength = sizeof(rr->rdata.srv.fixed) + target->name_size;
+		break;
+	default:
+		return 0;
+	}
+	/* the owner pointer is patched in when the rr is copied */
+	buf[0] = 0xc0;
+	buf[1] = 0;
+	do_write_uint16(buf + 2, rr->type);
+	do_write_uint16(buf + 4, rr->klass);
+	do_write_uint32(buf + 6, rr->ttl);
+	do_write_uint16(buf + 10, rdlength);
+	return 12 + rdlength;
+}
+
+/* render all rrs with a stride that fits the longest one */
+static void
+rrset_wire_build(rrset_type* rrset)
+{
+	uint8_t buf[RR_WIRE_MAX];
+	uint16_t i, len, stride = 0;
+
+	rrset_wire_free(rrset);
+	for(i=0; i<rrset->rr_count; i++) {
+		len = rr_wire_render(&rrset->rrs[i], buf);
+		if(len == 0)
+			return;
+		if(len > stride)
+			stride = len;
+	}
+	rrset->wire = (struct rrset_wire*)slab_alloc(SLAB_RRSET_WIRE,
+		rrset_wire_size(stride, rrset->rr_capacity));
+	rrset->wire->stride = stride;
+	for(i=0; i<rrset->rr_count; i++)
+		rr_wire_render(&rrset->rrs[i],
+			rrset->wire->data + (size_t)i * stride);
+}
+
+/* render the rr at pos, the whole image is rebuilt if it does not fit */
+static void
+rrset_wire_put(rrset_type* rrset, uint16_t pos)
+{
+	uint8_t buf[RR_WIRE_MAX];
+	uint16_t len;
+
+	if(!rrset->wire) {
+		rrset_wire_build(rrset);
+		return;
+	}
+	len = rr_wire_render(&rrset->rrs[pos], buf);
+	if(len > rrset->wire->stride) {
+		rrset_wire_build(rrset);
+		return;
+	}
+	memcpy(rrset->wire->data + (size_t)pos * rrset->wire->stride, buf, len);
+}
+
+static void
+rrset_resize(rrset_type* rrset, uint32_t capacity)
+{
+	rr_type* o = rrset->rrs;
+	struct rrset_wire* w = rrset->wire;
+
+	rrset->rrs = (rr_type*)slab_alloc(SLAB_RR, capacity * sizeof(rr_type));
+	if(rrset->rr_count)
+		memcpy(rrset->rrs, o, rrset->rr_count * sizeof(rr_type));
+	slab_free(SLAB_RR, o, rrset->rr_capacity * sizeof(rr_type));
+	if(w) {
+		rrset->wire = (struct rrset_wire*)slab_alloc(SLAB_RRSET_WIRE,
+			rrset_wire_size(w->stride, capacity));
+		rrset->wire->stride = w->stride;
+		memcpy(rrset->wire->data, w->data,
+			(size_t)rrset->rr_count * w->stride);
+		slab_free(SLAB_RRSET_WIRE, w,
+			rrset_wire_size(w->stride, rrset->rr_capacity));
+	}
+	rrset->rr_capacity = capacity;
+}
+
+int
+rrset_find_rr(rrset_type* rrset, rr_type* rr)
+{
+	struct rrset_index* ix = rrset->index;
+	uint32_t i;
+	int pos;
+
+	if(!ix) {
+		for(pos=0; pos<rrset->rr_count; pos++) {
+			if(!zrdatacmp(rr->type, rr, &rrset->rrs[pos]))
+				return pos;
+		}
+		return -1;
+	}
+	for(i = rr_rdata_hash(rr) & ix->mask; ix->slots[i];
+		i = (i + 1) & ix->mask) {
+		pos = ix->slots[i] - 1;
+		if(!zrdatacmp(rr->type, rr, &rrset->rrs[pos]))
+			return pos;
+	}
+	return -1;
+}
+
+int
+rrset_add_rr(rrset_type* rrset, rr_type* rr)
+{
+	uint32_t capacity;
+
+	if(rrset->rr_count == 65535)
+		return -1;
+	if(rrset->rr_count == rrset->rr_capacity) {
+		capacity = rrset->rr_capacity ? rrset->rr_capacity * 2 : 1;
+		if(capacity > 65535)
+			capacity = 65535;
+		rrset_resize(rrset, capacity);
+	}
+	if(rrset->rr_count == 0)
+		rrset->type = rr->type;
+	rrset->rrs[rrset->rr_count++] = *rr;
+	rrset_wire_put(rrset, rrset->rr_count - 1);
+
+	if(rrset->index) {
+		if((uint32_t)rrset->rr_count * 2 > rrset->index->mask + 1)
+			rrset_index_build(rrset);
+		else
+			rrset_index_put(rrset, rrset->rr_count - 1);
+	} else if(rrset->rr_count >= RRSET_INDEX_MIN) {
+		rrset_index_build(rrset);
+	}
+	return 0;
+}
+
+void
+rrset_remove_rr(rrset_type* rrset, uint16_t pos)
+{
+	uint16_t last = rrset->rr_count - 1;
+	uint16_t w = rr_select_weight(&rrset->rrs[pos]);
+
+	if(rrset->index) {
+		rrset_index_clear(rrset, rrset_index_slot(rrset, pos));
+		if(pos != last)
+			rrset->index->slots[rrset_index_slot(rrset, last)] = pos + 1;
+	}
+	add_rdata_to_recyclebin(&rrset->rrs[pos]);
+	if(pos != last) {
+		rrset->rrs[pos] = rrset->rrs[last];
+		if(rrset->wire)
+			memcpy(rrset->wire->data + (size_t)pos * rrset->wire->stride,
+				rrset->wire->data + (size_t)last * rrset->wire->stride,
+				rrset->wire->stride);
+	}
+	rrset->rr_count = last;
+
+	if(rrset->index && rrset->rr_count < RRSET_INDEX_MIN / 2)
+		rrset_index_free(rrset);
+	else if(rrset->index)
+		rrset_weight_del(rrset, w);
+	if(rrset->rr_capacity > 4 && rrset->rr_count <= rrset->rr_capacity / 4)
+		rrset_resize(rrset, rrset->rr_capacity / 2);
+}
+
+void
+rrset_set_weight(rrset_type* rrset, uint16_t pos, uint16_t weight)
+{
+	uint16_t w = rr_select_weight(&rrset->rrs[pos]);
+
+	rrset->rrs[pos].weight = weight;
+	if(rrset->index) {
+		rrset_weight_add(rrset->index, rr_select_weight(&rrset->rrs[pos]));
+		rrset_weight_del(rrset, w);
 	}
-	free(rr->rdatas);
 }
 
 /* this routine determines if below a domain there exist names with
@@ -133,14 +576,17 @@ apex_rrset_checks( rrset_type* rrset, domain_type* domain)
 			zone->soa_nx_rrset = xalloc(
 				sizeof(rrset_type));
 			zone->soa_nx_rrset->rr_count = 1;
+			zone->soa_nx_rrset->type = TYPE_SOA;
+			zone->soa_nx_rrset->rr_capacity = 1;
+			zone->soa_nx_rrset->index = NULL;
+			zone->soa_nx_rrset->wire = NULL;
 			zone->soa_nx_rrset->next = 0;
 			zone->soa_nx_rrset->zone = zone;
 			zone->soa_nx_rrset->rrs = xalloc(sizeof(rr_type));
 		}
 		memcpy(zone->soa_nx_rrset->rrs, rrset->rrs, sizeof(rr_type));
 
-		memcpy(&soa_minimum, rdata_atomdata(rrset->rrs->rdatas[6]),
-				rdata_atom_size(rrset->rrs->rdatas[6]));
+		soa_minimum = rrset->rrs->rdata.soa->minimum;
 		if (rrset->rrs->ttl > ntohl(soa_minimum)) {
 			zone->soa_nx_rrset->rrs[0].ttl = ntohl(soa_minimum);
 		}
@@ -175,6 +621,20 @@ rrset_zero_nonexist_check(domain_type* domain, domain_type* ce)
 	return NULL;
 }
 
+/** refill the type map from the rrset list */
+static void
+domain_type_map_update(domain_type* domain)
+{
+	rrset_type* rrset = domain->rrsets;
+	int i;
+
+	for(i = 0; i < DOMAIN_TYPE_MAP; i++) {
+		domain->rrset_types[i] = rrset ? rrset->type : 0;
+		if(rrset)
+			rrset = rrset->next;
+	}
+}
+
 /** remove rrset.  Adjusts zone params.  Does not remove domain */
 void
 rrset_delete(domain_store_type* db, domain_type* domain, rrset_type* rrset)
@@ -190,6 +650,7 @@ rrset_delete(domain_store_type* db, domain_type* domain, rrset_type* rrset)
 		return;
 	}
 	*pp = rrset->next;
+	domain_type_map_update(domain);
 
 	/* is this a SOA rrset ? */
 	if(rrset->zone->soa_rrset == rrset) {
@@ -201,8 +662,10 @@ rrset_delete(domain_store_type* db, domain_type* domain, rrset_type* rrset)
 	/* recycle the memory space of the rrset */
 	for (i = 0; i < rrset->rr_count; ++i)
 		add_rdata_to_recyclebin( &rrset->rrs[i]);
-    free(rrset->rrs);
-    free(rrset);
+    rrset_index_free(rrset);
+    rrset_wire_free(rrset);
+    slab_free(SLAB_RR, rrset->rrs, rrset->rr_capacity * sizeof(rr_type));
+    slab_free(SLAB_RRSET, rrset, sizeof(rrset_type));
 }
 
 
@@ -210,15 +673,13 @@ rrset_delete(domain_store_type* db, domain_type* domain, rrset_type* rrset)
 void
 rr_lower_usage(domain_store_type* db, rr_type* rr)
 {
-	unsigned i;
-	for(i=0; i<rr->rdata_count; i++) {
-		if(rdata_atom_is_domain(rr->type, i)) {
-			assert(rdata_atom_domain(rr->rdatas[i])->usage > 0);
-			rdata_atom_domain(rr->rdatas[i])->usage --;
-			if(rdata_atom_domain(rr->rdatas[i])->usage == 0)
-				domain_table_deldomain(db,
-					rdata_atom_domain(rr->rdatas[i]));
-		}
+	domain_type* refs[2];
+	int i, n = rr_rdata_domains(rr, refs);
+	for(i=0; i<n; i++) {
+		assert(refs[i]->usage > 0);
+		refs[i]->usage --;
+		if(refs[i]->usage == 0)
+			domain_table_deldomain(db, refs[i]);
 	}
 }
 
@@ -259,6 +720,9 @@ domain_table_create(void)
 
 
     result->number_total = 1;
+    result->frozen = NULL;
+    result->frozen_stale = 1;
+    result->changed_num = 0;
 
 	result->root = root;
 
@@ -335,6 +799,7 @@ domain_table_insert(domain_table_type* table,
 		assert(domain_dname(closest_encloser)->label_count < dname->label_count);
 
 		/* Insert new node(s).  */
+		domain_table_frozen_mark(table, closest_encloser);
 		do {
 			result = allocate_domain_info(table,
 						      dname,
@@ -380,6 +845,25 @@ domain_type *domain_previous_existing_child(domain_type* domain)
 	return domain;
 }
 
+domain_type *
+domain_wildcard_child(domain_type* domain)
+{
+	domain_type* wildcard_child;
+
+	assert(domain);
+	assert(domain->wildcard_child_closest_match);
+
+	wildcard_child = domain->wildcard_child_closest_match;
+	if (wildcard_child != domain
+	    && wildcard_child->is_existing
+	    && label_is_wildcard(domain_name_get(domain_dname(wildcard_child))))
+	{
+		return wildcard_child;
+	} else {
+		return NULL;
+	}
+}
+
 void
 domain_add_rrset(domain_type* domain, rrset_type* rrset)
 {
@@ -394,6 +878,7 @@ domain_add_rrset(domain_type* domain, rrset_type* rrset)
 	*p = rrset;
 	rrset->next = 0;
 #endif
+	domain_type_map_update(domain);
 
 	while (domain && !domain->is_existing) {
 		domain->is_existing = 1;
@@ -414,10 +899,22 @@ domain_add_rrset(domain_type* domain, rrset_type* rrset)
 rrset_type *
 domain_find_rrset(domain_type* domain, zone_type* zone, uint16_t type)
 {
-	rrset_type* result = domain->rrsets;
+	rrset_type* result;
+	int i, n;
+
+	/* skip the rrsets the type map rules out without touching them */
+	for (i = 0; i < DOMAIN_TYPE_MAP; i++) {
+		if (domain->rrset_types[i] == type)
+			break;
+		if (domain->rrset_types[i] == 0)
+			return NULL;
+	}
+	result = domain->rrsets;
+	for (n = 0; n < i; n++)
+		result = result->next;
 
 	while (result) {
-		if (result->zone == zone && rrset_rrtype(result) == type) {
+		if (result->zone == zone && result->type == type) {
 			return result;
 		}
 		result = result->next;
@@ -485,6 +982,55 @@ domain_store_lookup(struct  domain_store* db,
 	      domain_type     **closest_match,
 	      domain_type     **closest_encloser)
 {
+	struct radcompact* frozen = db->domains->frozen;
+
+	if (frozen) {
+		/* no predecessor here, the closest match is the encloser */
+		int exact = radcompact_name_lookup(frozen, domain_name_get(dname),
+			dname->name_size, (void**)closest_encloser);
+		assert(*closest_encloser);
+		if (!(*closest_encloser)->frozen_changed) {
+			*closest_match = *closest_encloser;
+			return exact;
+		}
+	}
 	return domain_table_search(
 		db->domains, dname, closest_match, closest_encloser);
 }
+
+int
+domain_store_freeze_needed(struct  domain_store* db)
+{
+	return db->domains->frozen_stale;
+}
+
+struct radcompact*
+domain_store_freeze_build(struct  domain_store* db)
+{
+	struct radcompact* frozen = radcompact_build(db->domains->nametree);
+
+	if (!frozen)
+		log_msg(LOG_ERR, "unable to build the frozen name index\n");
+	return frozen;
+}
+
+void
+domain_store_freeze_install(struct  domain_store* db, struct radcompact* frozen)
+{
+	domain_table_frozen_set(db->domains, frozen);
+	db->domains->frozen_stale = (frozen == NULL);
+}
+
+int
+domain_store_freeze(struct  domain_store* db)
+{
+	struct radcompact* frozen;
+
+	if (!domain_store_freeze_needed(db))
+		return 0;
+	frozen = domain_store_freeze_build(db);
+	if (!frozen)
+		return 0;
+	domain_store_freeze_install(db, frozen);
+	return 1;
+}
@@ -12,22 +12,36 @@
 #include <stdio.h>
 #include "dns.h"
 #include "radtree.h"
+#include "radcompact.h"
 
 struct kdns;
 
+/* rrset types cached in the domain, for the first rrsets of the list */
+#define DOMAIN_TYPE_MAP		4
+
+/*
+ * A domain node fits one cache line. The fields the answer path reads come
+ * first, the radix node and usage count of the updates last.
+ */
 typedef struct domain
 {
-
-	struct radnode* rnode;
-	 domain_name_st* dname;
+	domain_name_st* dname;
 	struct domain* parent;
 	struct domain* wildcard_child_closest_match;
 	struct rrset * rrsets;
-	size_t     usage;     
-    uint16_t    compressed_offset;
-    uint32_t maxAnswer;
+	/* types of the first rrsets in list order, 0 past the end */
+	uint16_t    rrset_types[DOMAIN_TYPE_MAP];
+	uint32_t    maxAnswer;
+	uint16_t    compressed_offset;
 	unsigned     is_existing : 1;
 	unsigned     is_apex : 1;
+	/* the frozen index may be wrong at or below this name */
+	unsigned     frozen_changed : 1;
+	/* deleted, kept until the frozen index that holds it is replaced */
+	unsigned     frozen_deleted : 1;
+
+	struct radnode* rnode;
+	size_t     usage;
 }domain_type;
 
 typedef struct zone
@@ -43,14 +57,37 @@ typedef struct zone
 	unsigned     is_changed : 1; /* zone was changed by AXFR */
 }zone_type;
 
-/* a RR in DNS */
+/* SOA rdata, the numbers are in network order */
+struct soa_rdata {
+	struct domain*   mname;
+	struct domain*   rname;
+	uint32_t         serial;
+	uint32_t         refresh;
+	uint32_t         retry;
+	uint32_t         expire;
+	uint32_t         minimum;
+};
+
+/*
+ * a RR in DNS. The rdata is kept in the rr, fixed size fields already in
+ * wire order, only the SOA rdata lives in its own block.
+ */
 typedef struct rr {
 	struct domain *     owner;
-	union rdata_atom* rdatas;
+	union {
+		uint8_t          a[4];		/* A address */
+		uint8_t          aaaa[16];	/* AAAA address, no larger than srv */
+		struct {
+			uint16_t       fixed[3];	/* priority, weight, port */
+			struct domain* target;
+		} srv;
+		struct domain*   target;	/* CNAME */
+		struct soa_rdata* soa;
+	} rdata;
 	uint32_t         ttl;
 	uint16_t         type;
 	uint16_t         klass;
-	uint16_t         rdata_count;
+	uint16_t         weight;	/* answer selection weight, 0 is unweighted */
 }rr_type;
 
 /*
@@ -59,25 +96,63 @@ typedef struct rr {
  */
 typedef struct rrset
 {
-	struct rrset* next;
 	struct zone*  zone;
 	struct rr*    rrs;
+	struct rrset_wire* wire;	/* pre-rendered rrs, or NULL */
 	uint16_t    rr_count;
+	uint16_t    type;		/* type of the rrs */
+	uint16_t    rr_capacity;	/* allocated entries of rrs */
+	struct rrset* next;
+	struct rrset_index* index;	/* rdata index of large rrsets, or NULL */
 }rrset_type;
 
-typedef union rdata_atom
-{
-	domain_type* domain;
+/*
+ * Pre-rendered wire image of each rr of an A, AAAA or SRV rrset, stride bytes
+ * per rr in the order of rrs: a slot for the owner name pointer, then
+ * type, class, ttl, rdlength and rdata.
+ */
+struct rrset_wire {
+	uint16_t stride;
+	uint8_t  data[0];
+};
 
-	/* Default. */
-	uint16_t*    data;
-}rdata_atom_type;
+/* longest rendered rr: pointer, fixed fields, SRV rdata */
+#define RR_WIRE_MAX	(2 + 10 + 6 + MAXDOMAINLEN)
+
+/* rrsets from this size on get a hashed rdata index */
+#define RRSET_INDEX_MIN		16
+
+/*
+ * Open addressing hash of the rdata of the rrs in an rrset, the slots hold
+ * the rr position plus one and 0 for empty. The weight bounds of the rrs
+ * let the answer path sample a large rrset.
+ */
+struct rrset_index {
+	uint32_t mask;
+	uint16_t weight_min;
+	uint16_t weight_max;
+	/* rrs at each bound, the bounds are rescanned when one drops to 0 */
+	uint16_t weight_min_count;
+	uint16_t weight_max_count;
+	uint16_t slots[0];
+};
+
+/* names changed since the frozen index was built, tracked until it is dropped */
+#define FROZEN_CHANGED_MAX	1024
 
 typedef struct domain_table
 {
     struct radtree *nametree;
 	struct domain* root;
     size_t     number_total; 
+	/*
+	 * frozen copy of nametree for lookups, stale once names were added
+	 * or deleted. Lookups that end on a changed name use nametree.
+	 */
+	struct radcompact* frozen;
+	unsigned   frozen_stale : 1;
+	uint32_t   changed_num;
+	struct domain* changed[FROZEN_CHANGED_MAX];
 }domain_table_type;
 
 
@@ -115,6 +190,14 @@ void rrset_lower_usage(domain_store_type* db, rrset_type* rrset);
 void rrset_delete(domain_store_type* db, domain_type* domain, rrset_type* rrset);
 void rr_lower_usage(domain_store_type* db, rr_type* rr);
 void add_rdata_to_recyclebin( rr_type* rr);
+/* position of an rr with the same rdata in the rrset, -1 if there is none */
+int rrset_find_rr(rrset_type* rrset, rr_type* rr);
+/* append an rr, the rrs array grows geometrically. -1 if the rrset is full */
+int rrset_add_rr(rrset_type* rrset, rr_type* rr);
+/* recycle the rr at pos and move the last rr into its place */
+void rrset_remove_rr(rrset_type* rrset, uint16_t pos);
+/* change the weight of the A or AAAA rr at pos */
+void rrset_set_weight(rrset_type* rrset, uint16_t pos, uint16_t weight);
 domain_type* rrset_zero_nonexist_check(domain_type* domain, domain_type* ce);
 
 
@@ -152,6 +235,9 @@ domain_type * find_domain_name_above(domain_type* domain, zone_type* zone);
 
 domain_type *domain_previous_existing_child(domain_type* domain);
 
+/* the existing "*" child of DOMAIN, or NULL if there is none */
+domain_type *domain_wildcard_child(domain_type* domain);
+
 
 static inline domain_name_st *
 domain_dname(domain_type* domain)
@@ -182,25 +268,31 @@ static inline const char* domain_to_string(domain_type* domain)
 { return domain_name_to_string(domain_dname(domain), NULL); }
 
 
-static inline int rdata_atom_is_domain(uint16_t type, size_t index);
-static inline int rdata_atom_is_literal_domain(uint16_t type, size_t index);
-
+/* the name a CNAME or SRV rr points to, NULL for other types */
 static inline domain_type *
-rdata_atom_domain(rdata_atom_type atom)
+rr_target(rr_type* rr)
 {
-	return atom.domain;
+	switch(rr->type) {
+	case TYPE_CNAME:
+		return rr->rdata.target;
+	case TYPE_SRV:
+		return rr->rdata.srv.target;
+	default:
+		return NULL;
+	}
 }
 
-static inline uint16_t
-rdata_atom_size(rdata_atom_type atom)
-{
-	return *atom.data;
-}
-
-static inline uint8_t *
-rdata_atomdata(rdata_atom_type atom)
+/* the names referenced by the rdata into refs, returns their number */
+static inline int
+rr_rdata_domains(rr_type* rr, domain_type* refs[2])
 {
-	return (uint8_t *) (atom.data + 1);
+	if(rr->type == TYPE_SOA) {
+		refs[0] = rr->rdata.soa->mname;
+		refs[1] = rr->rdata.soa->rname;
+		return 2;
+	}
+	refs[0] = rr_target(rr);
+	return refs[0] != NULL;
 }
 
 
@@ -215,8 +307,6 @@ zone_type *domain_store_find_zone(domain_store_type *db, const domain_name_st *d
 void domain_table_deldomain(domain_store_type* db, domain_type* domain);
 
 
-/** marshal rdata into buffer, must be MAX_RDLENGTH in size */
-size_t rr_marshal_rdata(rr_type* rr, uint8_t* rdata, size_t sz);
 /* dbaccess.c */
 int domain_store_lookup (struct  domain_store* db,
 		   const domain_name_st* dname,
@@ -224,6 +314,27 @@ int domain_store_lookup (struct  domain_store* db,
 		   domain_type     **closest_encloser);
 /* pass number of children (to alloc in dirty array */
 struct  domain_store *domain_store_open(void);
+
+/*
+ * Rebuild the frozen lookup index of the store if names were added or
+ * deleted since it was built. Returns 1 if the index was rebuilt.
+ */
+int domain_store_freeze(struct  domain_store* db);
+
+/* names were added or deleted since the frozen index was built */
+int domain_store_freeze_needed(struct  domain_store* db);
+
+/*
+ * Build a frozen index of the store, NULL on alloc failure. It may run on
+ * another thread while the owner of the store reads it but changes nothing.
+ */
+struct radcompact* domain_store_freeze_build(struct  domain_store* db);
+
+/*
+ * Replace the frozen index of the store with one built since its last
+ * change, or drop it with NULL. On the thread that owns the store.
+ */
+void domain_store_freeze_install(struct  domain_store* db, struct radcompact* frozen);
 void domain_store_close(struct  domain_store* db);
 
 /** zone one zonefile into memory and revert on parse error, write to udb */
@@ -232,40 +343,12 @@ void apex_rrset_checks(rrset_type* rrset,domain_type* domain);
 zone_type* domain_store_zone_create(domain_store_type* db, const domain_name_st* dname);
 void domain_store_zone_delete(domain_store_type* db, zone_type* zone);
 
-static inline int
-rdata_atom_is_domain(uint16_t type, size_t index)
-{
-	const rrtype_descriptor_st *descriptor
-		= rrtype_descriptor_by_type(type);
-	return (index < descriptor->maximum
-		&& (descriptor->wireformat[index] == RDATA_WF_COMPRESSED_DNAME
-		    || descriptor->wireformat[index] == RDATA_WF_UNCOMPRESSED_DNAME));
-}
-
-static inline int
-rdata_atom_is_literal_domain(uint16_t type, size_t index)
-{
-	const rrtype_descriptor_st *descriptor
-		= rrtype_descriptor_by_type(type);
-	return (index < descriptor->maximum
-		&& (descriptor->wireformat[index] == RDATA_WF_LITERAL_DNAME));
-}
-
-static inline rdata_wireformat_type
-rdata_atom_wireformat_type(uint16_t type, size_t index)
-{
-	const rrtype_descriptor_st *descriptor
-		= rrtype_descriptor_by_type(type);
-	assert(index < descriptor->maximum);
-	return (rdata_wireformat_type) descriptor->wireformat[index];
-}
-
 static inline uint16_t
 rrset_rrtype(rrset_type* rrset)
 {
 	assert(rrset);
 	assert(rrset->rr_count > 0);
-	return rrset->rrs[0].type;
+	return rrset->type;
 }
 
 static inline uint16_t
@@ -11,6 +11,7 @@
 #define	_NSD_H_
 
 #include "dns.h"
+#include "view_def.h"
 
 #define MAX_CORES 64
 
@@ -19,6 +20,8 @@ typedef struct kdns kdns_type;
 struct	kdns
 {
 	struct  domain_store	*db;
+	/* per view overlay stores, index 0 is the default view (db only) */
+	struct  domain_store	*views[MAX_VIEWS];
     /*
     uint16_t *compressed_domain_name_offsets ;
     uint32_t compression_tablecapacity ;
@@ -16,6 +16,9 @@
 
 int round_robin = 1;
 
+/* rrsets up to this size are ordered by weight, larger ones are rotated */
+#define RR_ORDER_MAX	64
+
 
 
 static void
@@ -39,61 +42,333 @@ do_dname_data_encode(kdns_query_st *q, domain_type *domain)
 
 
 
-int
-packet_encode_rr(kdns_query_st *q, domain_type *owner, rr_type *rr, uint32_t ttl)
+/* bytes do_dname_data_encode writes for domain as the packet is now */
+static inline size_t
+dname_encode_len(domain_type *domain)
 {
-	size_t truncation_mark;
-	uint16_t rdlength = 0;
-	size_t rdlength_pos;
-	uint16_t j;
-	/*
-	 * If the record does not in fit in the packet the packet size
-	 * will be restored to the mark.
-	 */
-	truncation_mark = buffer_get_position(q->packet);
+	size_t len = 0;
+
+	while (domain->parent && domain->compressed_offset == 0) {
+		len += label_length(domain_name_get(domain_dname(domain))) + 1U;
+		domain = domain->parent;
+	}
+	return len + (domain->parent ? 2 : 1);
+}
+
+/*
+ * Whether a record of the owner and rdlength fits below maxMsgLen, checked
+ * before anything is written since the buffer may end right there. Names
+ * in the rdata are counted as if the owner did not compress them.
+ */
+static inline int
+rr_encode_fits(kdns_query_st *q, domain_type *owner, size_t rdlength)
+{
+	return buffer_get_position(q->packet) + dname_encode_len(owner) +
+		3 * sizeof(uint16_t) + sizeof(uint32_t) + rdlength <= q->maxMsgLen;
+}
 
-    do_dname_data_encode(q,owner);
+typedef int (*rr_encode_fn)(kdns_query_st *q, domain_type *owner,
+	rr_type *rr, uint32_t ttl);
+
+/* owner, type, class and ttl, returns the position of the rdlength */
+static inline size_t
+rr_encode_head(kdns_query_st *q, domain_type *owner, rr_type *rr, uint32_t ttl)
+{
+	size_t rdlength_pos;
 
-    
+	do_dname_data_encode(q, owner);
 	buffer_write_u16(q->packet, rr->type);
 	buffer_write_u16(q->packet, rr->klass);
 	buffer_write_u32(q->packet, ttl);
-
-	/* Reserve space for rdlength. */
 	rdlength_pos = buffer_get_position(q->packet);
-	buffer_skip(q->packet, sizeof(rdlength));
+	buffer_skip(q->packet, sizeof(uint16_t));
+	return rdlength_pos;
+}
 
-	for (j = 0; j < rr->rdata_count; ++j) {
-		switch (rdata_atom_wireformat_type(rr->type, j)) {
-		case RDATA_WF_COMPRESSED_DNAME:
-			do_dname_data_encode(q, rdata_atom_domain(rr->rdatas[j]));
-			break;
-		case RDATA_WF_UNCOMPRESSED_DNAME:
-		{
-			const domain_name_st *dname = domain_dname(
-				rdata_atom_domain(rr->rdatas[j]));
-			buffer_write(q->packet,
-				     domain_name_get(dname), dname->name_size);
-			break;
+/*
+ * Set the rdlength if the record fits in the packet, otherwise restore the
+ * packet size to the mark.
+ */
+static inline int
+rr_encode_finish(kdns_query_st *q, size_t truncation_mark, size_t rdlength_pos)
+{
+	if (buffer_get_position(q->packet) <= q->maxMsgLen) {
+		buffer_write_u16_at(q->packet, rdlength_pos,
+			buffer_get_position(q->packet) - rdlength_pos - sizeof(uint16_t));
+		return 1;
+	}
+	buffer_set_position(q->packet, truncation_mark);
+	return 0;
+}
+
+static int
+rr_encode_a(kdns_query_st *q, domain_type *owner, rr_type *rr, uint32_t ttl)
+{
+	size_t mark = buffer_get_position(q->packet);
+	size_t rdlength_pos;
+
+	if (!rr_encode_fits(q, owner, sizeof(rr->rdata.a)))
+		return 0;
+	rdlength_pos = rr_encode_head(q, owner, rr, ttl);
+
+	buffer_write(q->packet, rr->rdata.a, sizeof(rr->rdata.a));
+	return rr_encode_finish(q, mark, rdlength_pos);
+}
+
+static int
+rr_encode_aaaa(kdns_query_st *q, domain_type *owner, rr_type *rr, uint32_t ttl)
+{
+	size_t mark = buffer_get_position(q->packet);
+	size_t rdlength_pos;
+
+	if (!rr_encode_fits(q, owner, sizeof(rr->rdata.aaaa)))
+		return 0;
+	rdlength_pos = rr_encode_head(q, owner, rr, ttl);
+
+	buffer_write(q->packet, rr->rdata.aaaa, sizeof(rr->rdata.aaaa));
+	return rr_encode_finish(q, mark, rdlength_pos);
+}
+
+static int
+rr_encode_cname(kdns_query_st *q, domain_type *owner, rr_type *rr, uint32_t ttl)
+{
+	size_t mark = buffer_get_position(q->packet);
+	size_t rdlength_pos;
+
+	if (!rr_encode_fits(q, owner, dname_encode_len(rr->rdata.target)))
+		return 0;
+	rdlength_pos = rr_encode_head(q, owner, rr, ttl);
+
+	do_dname_data_encode(q, rr->rdata.target);
+	return rr_encode_finish(q, mark, rdlength_pos);
+}
+
+/*
+ * The SRV target is written uncompressed, record where its labels start so
+ * that later names, like the owners of the additional A and AAAA records, can point
+ * into it.
+ */
+static void
+srv_target_note(kdns_query_st *q, domain_type *target, size_t offset)
+{
+	while (target->parent && target->compressed_offset == 0 &&
+		offset <= MAX_COMPRESSION_OFFSET &&
+		q->compressed_count < MAX_COMPRESSED_DNAMES) {
+		target->compressed_offset = offset;
+		q->compressed_dnames[q->compressed_count++] = target;
+		offset += label_length(domain_name_get(domain_dname(target))) + 1U;
+		target = target->parent;
+	}
+}
+
+static int
+rr_encode_srv(kdns_query_st *q, domain_type *owner, rr_type *rr, uint32_t ttl)
+{
+	size_t mark = buffer_get_position(q->packet);
+	size_t rdlength_pos;
+	const domain_name_st *target = domain_dname(rr->rdata.srv.target);
+
+	if (!rr_encode_fits(q, owner, sizeof(rr->rdata.srv.fixed) + target->name_size))
+		return 0;
+	rdlength_pos = rr_encode_head(q, owner, rr, ttl);
+	buffer_write(q->packet, rr->rdata.srv.fixed, sizeof(rr->rdata.srv.fixed));
+	/* the SRV target is never compressed */
+	buffer_write(q->packet, domain_name_get(target), target->name_size);
+	if (!rr_encode_finish(q, mark, rdlength_pos))
+		return 0;
+	srv_target_note(q, rr->rdata.srv.target,
+		rdlength_pos + sizeof(uint16_t) + sizeof(rr->rdata.srv.fixed));
+	return 1;
+}
+
+static int
+rr_encode_soa(kdns_query_st *q, domain_type *owner, rr_type *rr, uint32_t ttl)
+{
+	size_t mark = buffer_get_position(q->packet);
+	size_t rdlength_pos;
+	struct soa_rdata *soa = rr->rdata.soa;
+
+	if (!rr_encode_fits(q, owner, dname_encode_len(soa->mname) +
+		dname_encode_len(soa->rname) + 5 * sizeof(uint32_t)))
+		return 0;
+	rdlength_pos = rr_encode_head(q, owner, rr, ttl);
+	do_dname_data_encode(q, soa->mname);
+	do_dname_data_encode(q, soa->rname);
+	buffer_write(q->packet, &soa->serial, 5 * sizeof(uint32_t));
+	return rr_encode_finish(q, mark, rdlength_pos);
+}
+
+static rr_encode_fn
+rr_encoder(uint16_t type)
+{
+	switch (type) {
+	case TYPE_A:
+		return rr_encode_a;
+	case TYPE_AAAA:
+		return rr_encode_aaaa;
+	case TYPE_CNAME:
+		return rr_encode_cname;
+	case TYPE_SRV:
+		return rr_encode_srv;
+	case TYPE_SOA:
+		return rr_encode_soa;
+	default:
+		return NULL;
+	}
+}
+
+int
+packet_encode_rr(kdns_query_st *q, domain_type *owner, rr_type *rr, uint32_t ttl)
+{
+	rr_encode_fn encode = rr_encoder(rr->type);
+
+	return encode ? encode(q, owner, rr, ttl) : 0;
+}
+
+static inline uint32_t
+query_rand(kdns_query_st *q)
+{
+	/* xorshift32 */
+	uint32_t x = q->rand_state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	q->rand_state = x;
+	return x;
+}
+
+static inline uint16_t
+rr_srv_prio(rr_type *rr)
+{
+	return ntohs(rr->rdata.srv.fixed[0]);
+}
+
+static inline uint32_t
+rr_weight(rr_type *rr)
+{
+	if (rr->type == TYPE_SRV)
+		return ntohs(rr->rdata.srv.fixed[1]);
+	return rr->weight ? rr->weight : 1;
+}
+
+/*
+ * Pick count rrs of the rrset into order: SRV records by ascending priority
+ * with a weighted shuffle inside each priority (RFC 2782), other types by
+ * weighted selection without replacement. Returns 0 if all weights, and
+ * for SRV all priorities, are equal, the caller just rotates then.
+ */
+static uint16_t
+rrset_weighted_order(kdns_query_st *q, rrset_type *rrset, uint16_t *order,
+	uint16_t count)
+{
+	uint32_t weights[RR_ORDER_MAX];
+	uint32_t total, r;
+	uint16_t i, j, end, tmp;
+	uint16_t n = rrset->rr_count;
+	int is_srv = (rrset->type == TYPE_SRV);
+	int weighted = 0;
+
+	for (i = 0; i < n; ++i) {
+		order[i] = i;
+		weights[i] = rr_weight(&rrset->rrs[i]);
+		if (weights[i] != weights[0] || (is_srv &&
+			rr_srv_prio(&rrset->rrs[i]) != rr_srv_prio(&rrset->rrs[0])))
+			weighted = 1;
+	}
+	if (!weighted)
+		return 0;
+
+	if (is_srv) {
+		/* insertion sort by priority, n is small */
+		for (i = 1; i < n; ++i) {
+			tmp = order[i];
+			for (j = i; j > 0 && rr_srv_prio(&rrset->rrs[order[j-1]]) >
+				rr_srv_prio(&rrset->rrs[tmp]); --j)
+				order[j] = order[j-1];
+			order[j] = tmp;
 		}
-		default:
-			buffer_write(q->packet,
-				     rdata_atomdata(rr->rdatas[j]),
-				     rdata_atom_size(rr->rdatas[j]));
-			break;
+	}
+
+	for (i = 0; i < count; ++i) {
+		end = n;
+		if (is_srv) {
+			for (end = i + 1; end < n && rr_srv_prio(&rrset->rrs[order[end]]) ==
+				rr_srv_prio(&rrset->rrs[order[i]]); ++end)
+				;
 		}
+		total = 0;
+		for (j = i; j < end; ++j)
+			total += weights[order[j]];
+		if (total == 0) {
+			j = i + query_rand(q) % (end - i);
+		} else {
+			r = query_rand(q) % total;
+			for (j = i; j < end - 1 && r >= weights[order[j]]; ++j)
+				r -= weights[order[j]];
+		}
+		tmp = order[i];
+		order[i] = order[j];
+		order[j] = tmp;
 	}
+	return count;
+}
 
-	if (buffer_get_position(q->packet) <= q->maxMsgLen){
-		rdlength = (buffer_get_position(q->packet) - rdlength_pos
-			    - sizeof(rdlength));
-		buffer_write_u16_at(q->packet, rdlength_pos, rdlength);
-		return 1;
-	} else {
-		buffer_set_position(q->packet, truncation_mark);
-       // query_clear_dname_offsets(q, truncation_mark);
-		return 0;
+/*
+ * Pick count distinct rrs of a large weighted rrset by rejection sampling
+ * against the weight bound of its index, so only about count rrs are looked
+ * at. When skewed weights make the tries run out, the rest of the slots are
+ * filled in rotation order. count is below the size of the rrset.
+ */
+static uint16_t
+rrset_sample_order(kdns_query_st *q, rrset_type *rrset, uint16_t *order,
+	uint16_t count)
+{
+	struct rrset_index *ix = rrset->index;
+	uint32_t tries = (uint32_t)count * 16;
+	uint32_t i, idx;
+	uint16_t got = 0, k;
+
+	while (got < count && tries--) {
+		idx = query_rand(q) % rrset->rr_count;
+		if (query_rand(q) % ix->weight_max >= rr_weight(&rrset->rrs[idx]))
+			continue;
+		for (k = 0; k < got && order[k] != idx; ++k)
+			;
+		if (k == got)
+			order[got++] = idx;
 	}
+	idx = q->round_robin_off++ % rrset->rr_count;
+	for (i = 0; got < count && i < rrset->rr_count; ++i, ++idx) {
+		if (idx == rrset->rr_count)
+			idx = 0;
+		for (k = 0; k < got && order[k] != idx; ++k)
+			;
+		if (k == got)
+			order[got++] = idx;
+	}
+	return got;
+}
+
+/*
+ * Copy the pre-rendered image of rr idx and point its owner to the owner
+ * name already in the packet.
+ */
+static inline int
+rr_copy_wire(kdns_query_st *q, rrset_type *rrset, uint16_t idx,
+	uint16_t owner_offset)
+{
+	uint8_t *frag = rrset->wire->data + (size_t)idx * rrset->wire->stride;
+	uint16_t len = 12 + do_read_uint16(frag + 10);
+	size_t pos = buffer_get_position(q->packet);
+
+	if (pos + len > q->maxMsgLen)
+		return 0;
+	buffer_write(q->packet, frag, len);
+	buffer_write_u16_at(q->packet, pos, 0xc000 | owner_offset);
+	if (rrset->rrs[idx].type == TYPE_SRV)
+		srv_target_note(q, rrset->rrs[idx].rdata.srv.target,
+			pos + 12 + sizeof(rrset->rrs[idx].rdata.srv.fixed));
+	return 1;
 }
 
 int
@@ -103,9 +378,14 @@ packet_encode_rrset(kdns_query_st *query, domain_type *owner,
 {
 	uint16_t i;
 	uint16_t added = 0;  
-	static uint16_t round_robin_off = 0;
+	uint16_t order[RR_ORDER_MAX];
+	uint16_t ordered = 0;
+	uint16_t limit;
 	int do_robin = (round_robin && section == ANSWER_SECTION);
 	uint16_t start;
+	uint16_t owner_offset;
+	int ok;
+	rr_encode_fn encode = rr_encoder(rrset->type);
     uint32_t maxAnswer = 65535;
     int truncate_rrset = (section == ANSWER_SECTION ||
 				section == AUTHORITY_SECTION ||
@@ -116,25 +396,43 @@ packet_encode_rrset(kdns_query_st *query, domain_type *owner,
     }
 
 	assert(rrset->rr_count > 0);
+	if (!encode)
+		return 0;
     size_t truncation_mark = buffer_get_position(query->packet);
 
 
-	if(do_robin && rrset->rr_count)
-		start = (uint16_t)(round_robin_off++ % rrset->rr_count);
-	else	start = 0;
-	for (i = start; i < rrset->rr_count && added < maxAnswer; ++i) {
-		if (packet_encode_rr(query, owner, &rrset->rrs[i],
-			rrset->rrs[i].ttl)) {
-			++added;
+	if (do_robin && rrset->rr_count > 1 && rrset->rr_count <= RR_ORDER_MAX)
+		ordered = rrset_weighted_order(query, rrset, order,
+			rrset->rr_count < maxAnswer ? rrset->rr_count : maxAnswer);
+	else if (do_robin && rrset->index && maxAnswer < rrset->rr_count &&
+		rrset->index->weight_min != rrset->index->weight_max &&
+		rrset->type != TYPE_SRV)
+		ordered = rrset_sample_order(query, rrset, order,
+			maxAnswer < RR_ORDER_MAX ? maxAnswer : RR_ORDER_MAX);
+
+	if (ordered) {
+		start = 0;
+		limit = ordered;
+	} else {
+		if(do_robin && rrset->rr_count)
+			start = (uint16_t)(query->round_robin_off++ % rrset->rr_count);
+		else	start = 0;
+		limit = rrset->rr_count;
+	}
+	/* once the owner name is in the packet, rrs are copied pre-rendered */
+	owner_offset = owner->parent ? owner->compressed_offset : 0;
+	for (i = 0; i < limit && added < maxAnswer; ++i) {
+		uint32_t idx = ordered ? order[i] : (uint32_t)start + i;
+		if (idx >= rrset->rr_count)
+			idx -= rrset->rr_count;
+		if (rrset->wire && owner_offset) {
+			ok = rr_copy_wire(query, rrset, idx, owner_offset);
 		} else {
-		    all_added = 0;
-			start = 0;
-			break;
+			ok = encode(query, owner, &rrset->rrs[idx], rrset->rrs[idx].ttl);
+			if (owner->parent)
+				owner_offset = owner->compressed_offset;
 		}
-	}
-	for (i = 0; i < start && added < maxAnswer; ++i) {
-		if (packet_encode_rr(query, owner, &rrset->rrs[i],
-			rrset->rrs[i].ttl)) {
+		if (ok) {
 			++added;
 		} else {
 		    all_added = 0;
@@ -132,6 +132,7 @@ struct query;
 #define MAX_COMPRESSED_DNAMES	MAXRRSPP /* Maximum number of compressed domains. */
 #define MAX_COMPRESSION_OFFSET  0x3fff	 ///the 2 higher bits set to 0
 #define IPV4_MINIMAL_RESPONSE_SIZE 1480	 /* Recommended minimal edns size for IPv4 */
+#define OPT_RR_SIZE		11	 /* OPT RR without options */
  
  
 /*
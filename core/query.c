@@ -1,7 +1,9 @@
 /*
  * query.c  
  */
- 
+
+#include <time.h>
+#include <stdint.h>
 #include "dns.h"
 #include "kdns.h"
 #include "domain_store.h"
@@ -16,9 +18,12 @@ struct additional_rr_types
 
 struct additional_rr_types default_additional_rr_types[] = {
 	{ TYPE_A, ADDITIONAL_SECTION },
+	{ TYPE_AAAA, ADDITIONAL_SECTION },
 	{ 0, (rr_section_type) 0 }
 };
 
+uint16_t edns_udp_size = 0;
+
 static int add_rrset(struct query  *query,
 		     kdns_answer_st    *answer,
 		     rr_section_type section,
@@ -72,6 +77,26 @@ query_create(void)
 	kdns_query_st *query = (kdns_query_st *) xalloc_zero( sizeof(kdns_query_st));
 	query->packet = buffer_create( QIOBUFSZ);
     query->qname =(domain_name_st *) xalloc_zero(sizeof(domain_name_st)+ MAXDOMAINLEN);
+	query->rand_state = ((uint32_t)(uintptr_t)query ^ (uint32_t)time(NULL)) | 1;
+	return query;
+}
+
+kdns_query_st *
+query_create_in(void *(*alloc)(size_t size), uint8_t *data, size_t capacity)
+{
+	kdns_query_st *query;
+	uint8_t *block = (uint8_t *) alloc(sizeof(kdns_query_st)
+		+ sizeof(buffer_st) + sizeof(domain_name_st) + MAXDOMAINLEN);
+
+	if (!block)
+		return NULL;
+	query = (kdns_query_st *) block;
+	query->packet = (buffer_st *) (block + sizeof(kdns_query_st));
+	query->packet->data = data;
+	query->packet->limit = query->packet->capacity = capacity;
+	query->qname = (domain_name_st *) (block + sizeof(kdns_query_st)
+		+ sizeof(buffer_st));
+	query->rand_state = ((uint32_t)(uintptr_t)query ^ (uint32_t)time(NULL)) | 1;
 	return query;
 }
 
@@ -85,11 +110,16 @@ query_reset(kdns_query_st *q )
 	q->qtype = 0;
 	q->qclass = 0;
 	q->zone = NULL;
+	q->db = NULL;
+	q->view_id = 0;
 	q->opcode = 0;
         q->maxAnswer = 0;
         q->offset = 0;
 	q->cname_count = 0;
+	q->cname_target = NULL;
+	q->wildcard_count = 0;
         q->maxMsgLen= UDP_MAX_MESSAGE_LEN;
+	q->edns = 0;
 }
 
 /*
@@ -111,10 +141,55 @@ process_query_section(kdns_query_st *query)
 	return 1;
 }
 
+/*
+ * Parse the OPT RR (RFC 6891) after the question, anything else in the
+ * additional section is ignored. The client's payload size raises the
+ * answer size up to edns_udp_size. Returns -1 for an EDNS version other
+ * than 0.
+ */
+static int
+process_edns(kdns_query_st *q)
+{
+	size_t pos = buffer_get_position(q->packet);
+	uint16_t size;
+
+	if (!buffer_available(q->packet, OPT_RR_SIZE) ||
+	    buffer_read_u8_at(q->packet, pos) != 0 ||
+	    buffer_read_u16_at(q->packet, pos + 1) != TYPE_OPT)
+		return 0;
+	q->edns = 1;
+	if (buffer_read_u8_at(q->packet, pos + 6) != 0)
+		return -1;
+
+	size = buffer_read_u16_at(q->packet, pos + 3);
+	if (size > edns_udp_size)
+		size = edns_udp_size;
+	if (size > q->maxMsgLen)
+		q->maxMsgLen = size;
+	if (q->maxMsgLen > buffer_getcapacity(q->packet))
+		q->maxMsgLen = buffer_getcapacity(q->packet);
+	/* room for the OPT RR of the answer */
+	q->maxMsgLen -= OPT_RR_SIZE;
+	return 0;
+}
+
+/* append the OPT RR of the answer, ext_rcode is the upper 8 bits of the RCODE */
+static void
+query_add_opt(kdns_query_st *q, uint8_t ext_rcode)
+{
+	buffer_write_u8(q->packet, 0);
+	buffer_write_u16(q->packet, TYPE_OPT);
+	buffer_write_u16(q->packet, edns_udp_size);
+	buffer_write_u8(q->packet, ext_rcode);
+	buffer_write_u8(q->packet, 0);
+	buffer_write_u16(q->packet, 0);
+	buffer_write_u16(q->packet, 0);
+	SET_AR_COUNT(q->packet, GET_AR_COUNT(q->packet) + 1);
+}
 
 static void
 add_additional_rrsets(struct query *query, kdns_answer_st *answer,
-		      rrset_type *master_rrset, size_t rdata_index,
+		      rrset_type *master_rrset,
 		      struct additional_rr_types types[])
 {
 	int i;
@@ -122,11 +197,10 @@ add_additional_rrsets(struct query *query, kdns_answer_st *answer,
 	assert(query);
 	assert(answer);
 	assert(master_rrset);
-	assert(rdata_atom_is_domain(rrset_rrtype(master_rrset), rdata_index));
 
 	for (i = 0; i < master_rrset->rr_count; ++i) {
 		int j;
-		domain_type *additional = rdata_atom_domain(master_rrset->rrs[i].rdatas[rdata_index]);
+		domain_type *additional = rr_target(&master_rrset->rrs[i]);
 
 		assert(additional);
 
@@ -151,7 +225,7 @@ add_rrset(struct query   *query,
 {
 	int result = answer_add_rrset(answer, section, owner, rrset);
     if (rrset_rrtype(rrset) == TYPE_SRV){
-        add_additional_rrsets(query, answer, rrset, 3, default_additional_rr_types);
+        add_additional_rrsets(query, answer, rrset, default_additional_rr_types);
     }
 
 	return result;
@@ -207,17 +281,38 @@ answer_domain(struct kdns*  kdns, struct query *q, kdns_answer_st *answer,
 		int added;
 		added = add_rrset(q, answer, ANSWER_SECTION, domain, rrset);
 		assert(rrset->rr_count > 0);
-		if (added) {
+		if (added && q->cname_count < QUERY_MAX_CNAME) {
 			/* only process first CNAME record */
-			domain_type *closest_match = rdata_atom_domain(rrset->rrs[0].rdatas[0]);
+			domain_type *closest_match = rrset->rrs[0].rdata.target;
 			domain_type *closest_encloser = closest_match;
 			zone_type* origzone = q->zone;
+			domain_store_type *origdb = q->db;
+			domain_type *origtarget = q->cname_target;
+			int exact = 1;
 			++q->cname_count;
-
-			answer_lookup_zone( kdns, q, answer,
-					     closest_match == closest_encloser,
+			q->cname_target = closest_match;
+
+			/* a view overlay may alias names that only the base store has */
+			if (q->db != kdns->db && !closest_match->is_existing) {
+				q->db = kdns->db;
+				exact = domain_store_lookup(q->db, domain_dname(closest_match),
+					&closest_match, &closest_encloser);
+			} else if (q->db == kdns->db && q->view_id && kdns->views[q->view_id]) {
+				/* and shadow the targets of base store aliases */
+				domain_type *view_match, *view_encloser;
+				if (domain_store_lookup(kdns->views[q->view_id],
+					domain_dname(closest_match), &view_match, &view_encloser)
+					&& view_match->is_existing) {
+					q->db = kdns->views[q->view_id];
+					closest_match = view_match;
+					closest_encloser = view_encloser;
+				}
+			}
+			answer_lookup_zone( kdns, q, answer, exact,
 					     closest_match, closest_encloser);
 			q->zone = origzone;
+			q->db = origdb;
+			q->cname_target = origtarget;
 		}
 		return;
 	} else {
@@ -241,9 +336,36 @@ answer_authoritative(struct kdns   * kdns,
 {
 	domain_type *match;
 	domain_type *original = closest_match;
+	domain_type *wildcard_child;
+
 	if (exact) {
 		match = closest_match;
-	}  else {
+	} else if (closest_encloser
+		   && (wildcard_child = domain_wildcard_child(closest_encloser)) != NULL
+		   && q->wildcard_count < QUERY_MAX_WILDCARD) {
+		/*
+		 * Synthesize the owner from the wildcard. It takes the rrsets of
+		 * the wildcard and the name being answered: the question name by
+		 * a compression pointer, or the CNAME target node.
+		 */
+		match = &q->wildcard_domains[q->wildcard_count++];
+		memset(match, 0, sizeof(domain_type));
+		match->rrsets = wildcard_child->rrsets;
+		memcpy(match->rrset_types, wildcard_child->rrset_types,
+			sizeof(match->rrset_types));
+		match->maxAnswer = wildcard_child->maxAnswer;
+		match->wildcard_child_closest_match = match;
+		match->is_existing = 1;
+		if (q->cname_target) {
+			match->dname = q->cname_target->dname;
+			match->parent = q->cname_target->parent;
+		} else {
+			match->dname = wildcard_child->dname;
+			match->parent = closest_encloser;
+			match->compressed_offset = DNS_HEAD_SIZE;
+		}
+		original = wildcard_child;
+	} else {
 		match = NULL;
 	}
 
@@ -261,7 +383,7 @@ static void
 answer_lookup_zone(struct kdns * kdns, struct query *q, kdns_answer_st *answer,
 	 int exact, domain_type *closest_match,domain_type *closest_encloser)
 {
-	q->zone = domain_find_zone( kdns->db, closest_encloser);
+	q->zone = domain_find_zone( q->db, closest_encloser);
 	if (!q->zone) {
 		/* no zone for this */
 		if(q->cname_count == 0)
@@ -310,14 +432,28 @@ query_response(struct kdns * kdns, struct query *q)
 	domain_type *closest_match;
 	domain_type *closest_encloser;
 	kdns_answer_st answer ={0};
-
-	int exact = domain_store_lookup( kdns->db, q->qname, &closest_match, &closest_encloser);
+	int exact = 0;
+
+	/* names present in the client's view overlay shadow the base store */
+	if (q->view_id && kdns->views[q->view_id]) {
+		exact = domain_store_lookup( kdns->views[q->view_id], q->qname,
+			&closest_match, &closest_encloser);
+		if (exact && closest_match->is_existing) {
+			q->db = kdns->views[q->view_id];
+		}
+	}
+	if (q->db == NULL) {
+		q->db = kdns->db;
+		exact = domain_store_lookup( kdns->db, q->qname, &closest_match, &closest_encloser);
+	}
 
 	answer_lookup_zone( kdns, q, &answer, exact, closest_match,closest_encloser);
 
     if (GET_RCODE(q->packet) != RCODE_REFUSE) {
         encode_answer(q, &answer);
         query_compressed_table_clear(q);
+        if (q->edns)
+            query_add_opt(q, 0);
     }
 }
 
@@ -363,6 +499,12 @@ query_state_type query_process(kdns_query_st *q, kdns_type * kdns)
  	if (GET_AN_COUNT(q->packet) != 0 || GET_NS_COUNT(q->packet) != 0 ||  GET_AR_COUNT(q->packet) >= 2) {
 		return query_format_error(q);
 	}
+	if (GET_AR_COUNT(q->packet) == 1 && edns_udp_size && process_edns(q) < 0) {
+		/* BADVERS */
+		query_error(q, RCODE_OK);
+		query_add_opt(q, 1);
+		return QUERY_SUCCESS;
+	}
 
  	buffer_setlimit(q->packet, buffer_get_position(q->packet));
 
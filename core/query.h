@@ -19,6 +19,13 @@
 
 
 
+/* wildcard matches synthesized per query, bounds the CNAME chain too */
+#define QUERY_MAX_WILDCARD	4
+#define QUERY_MAX_CNAME		8
+
+/* largest UDP payload offered to EDNS clients, 0 answers them like the others */
+extern uint16_t edns_udp_size;
+
 typedef enum query_state {
 	QUERY_SUCCESS,
 	QUERY_FAIL,
@@ -35,14 +42,29 @@ typedef struct query {
     uint8_t opcode;
     
 	zone_type *zone;
+	/* store the answer is taken from, base or view overlay */
+	domain_store_type *db;
+	/* client view, 0 is the default view */
+	uint8_t view_id;
     
 	int cname_count;
+	/* CNAME target being answered, NULL while answering qname */
+	domain_type *cname_target;
+	/* owners synthesized from wildcards (RFC 4592) */
+	domain_type wildcard_domains[QUERY_MAX_WILDCARD];
+	uint16_t    wildcard_count;
     uint16_t offset;
     uint32_t maxAnswer;
     uint32_t maxMsgLen;
+    /* the query carried an OPT RR, so does the answer */
+    uint8_t edns;
 
     domain_type *compressed_dnames[MAXRRSPP];
     uint16_t    compressed_count;
+
+    /* answer ordering state, kept across queries and private to the owner lcore */
+    uint16_t    round_robin_off;
+    uint32_t    rand_state;
     
     /*
 	uint16_t     compressed_domain_name_count;
@@ -76,6 +98,14 @@ int answer_add_rrset(kdns_answer_st *answer, rr_section_type section,
  */
 kdns_query_st *query_create(void);
 
+/*
+ * Create a query in one block from alloc, which must return zeroed
+ * memory: the query, its packet buffer and its name. The packet starts
+ * on the caller's data, it may be pointed at each message answered.
+ */
+kdns_query_st *query_create_in(void *(*alloc)(size_t size), uint8_t *data,
+	size_t capacity);
+
 /*
  * Reset a query structure so it is ready for receiving and processing
  * a new query.
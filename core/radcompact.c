@@ -0,0 +1,254 @@
+/*
+ * radcompact.c -- frozen, read only copy of a radix tree
+ *
+ * Copyright (c) 2018 tiglabs All rights reserved.
+ *
+ * See LICENSE for the license.
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "radcompact.h"
+#include "radtree.h"
+
+/* node size classes by number of children */
+#define RADC_NODE4	0
+#define RADC_NODE16	1
+#define RADC_NODE48	2
+#define RADC_NODE256	3
+
+#define RADC_ALIGN(x, a)	(((x) + (a) - 1) & ~((size_t)(a) - 1))
+
+/**
+ * Node header. It is followed by the edge string that leads to the node
+ * and then by the lookup table of the size class:
+ *	NODE4, NODE16:	keys[4|16], uint32_t child[4|16]
+ *	NODE48:		index[256] (slot + 1, 0 is none), uint32_t child[48]
+ *	NODE256:	uint32_t child[256] (0 is none)
+ * Child references are offsets into the node block, the root is at 0 and
+ * is never a child.
+ */
+struct radc_node {
+	void* elem;
+	uint8_t type;
+	uint8_t unused;
+	uint16_t plen;
+	uint16_t count;
+	uint16_t unused2;
+};
+
+static void* (*radc_alloc)(size_t) = malloc;
+static void (*radc_release)(void*) = free;
+
+void radcompact_set_allocator(void* (*alloc)(size_t size),
+	void (*release)(void* ptr))
+{
+	radc_alloc = alloc;
+	radc_release = release;
+}
+
+static inline uint8_t*
+radc_body(struct radc_node* n)
+{
+	return (uint8_t*)(n + 1) + RADC_ALIGN(n->plen, 4);
+}
+
+static inline uint8_t
+radc_type(unsigned count)
+{
+	if(count <= 4) return RADC_NODE4;
+	if(count <= 16) return RADC_NODE16;
+	if(count <= 48) return RADC_NODE48;
+	return RADC_NODE256;
+}
+
+static size_t
+radc_node_size(uint8_t type, uint16_t plen)
+{
+	size_t size = sizeof(struct radc_node) + RADC_ALIGN(plen, 4);
+	switch(type) {
+	case RADC_NODE4:
+		size += 4 + 4 * sizeof(uint32_t);
+		break;
+	case RADC_NODE16:
+		size += 16 + 16 * sizeof(uint32_t);
+		break;
+	case RADC_NODE48:
+		size += 256 + 48 * sizeof(uint32_t);
+		break;
+	default:
+		size += 256 * sizeof(uint32_t);
+		break;
+	}
+	return RADC_ALIGN(size, sizeof(void*));
+}
+
+static unsigned
+radc_count(struct radnode* n)
+{
+	unsigned i, count = 0;
+	for(i=0; i<n->len; i++) {
+		if(n->array[i].node)
+			count++;
+	}
+	return count;
+}
+
+static size_t
+radc_tree_size(struct radnode* n, uint16_t plen)
+{
+	size_t size = radc_node_size(radc_type(radc_count(n)), plen);
+	unsigned i;
+	for(i=0; i<n->len; i++) {
+		if(n->array[i].node)
+			size += radc_tree_size(n->array[i].node,
+				n->array[i].len);
+	}
+	return size;
+}
+
+/* write the node and its subtree depth first, so a lookup walks forward */
+static uint32_t
+radc_write(struct radcompact* rc, size_t* pos, struct radnode* n,
+	uint8_t* str, uint16_t plen)
+{
+	uint32_t off = (uint32_t)*pos;
+	struct radc_node* c = (struct radc_node*)(rc->base + off);
+	uint8_t* body;
+	uint32_t child;
+	unsigned i, j = 0;
+
+	c->elem = n->elem;
+	c->count = radc_count(n);
+	c->type = radc_type(c->count);
+	c->plen = plen;
+	if(plen)
+		memcpy(c + 1, str, plen);
+	*pos += radc_node_size(c->type, plen);
+	rc->nodes[c->type]++;
+
+	body = radc_body(c);
+	for(i=0; i<n->len; i++) {
+		struct radsel* s = &n->array[i];
+		uint8_t byte = (uint8_t)(n->offset + i);
+		if(!s->node)
+			continue;
+		child = radc_write(rc, pos, s->node, s->str, s->len);
+		switch(c->type) {
+		case RADC_NODE4:
+			body[j] = byte;
+			((uint32_t*)(body + 4))[j] = child;
+			break;
+		case RADC_NODE16:
+			body[j] = byte;
+			((uint32_t*)(body + 16))[j] = child;
+			break;
+		case RADC_NODE48:
+			body[byte] = j + 1;
+			((uint32_t*)(body + 256))[j] = child;
+			break;
+		default:
+			((uint32_t*)body)[byte] = child;
+			break;
+		}
+		j++;
+	}
+	return off;
+}
+
+struct radcompact*
+radcompact_build(struct radtree* rt)
+{
+	struct radcompact* rc;
+	size_t pos = 0;
+
+	if(!rt->root)
+		return NULL;
+	rc = (struct radcompact*)calloc(1, sizeof(*rc));
+	if(!rc)
+		return NULL;
+	rc->size = radc_tree_size(rt->root, 0);
+	if(rc->size > UINT32_MAX) {
+		free(rc);
+		return NULL;
+	}
+	rc->base = (uint8_t*)radc_alloc(rc->size);
+	if(!rc->base) {
+		free(rc);
+		return NULL;
+	}
+	memset(rc->base, 0, rc->size);
+	radc_write(rc, &pos, rt->root, NULL, 0);
+	assert(pos == rc->size);
+	rc->count = rt->count;
+	return rc;
+}
+
+void
+radcompact_delete(struct radcompact* rc)
+{
+	if(!rc)
+		return;
+	radc_release(rc->base);
+	free(rc);
+}
+
+static inline uint32_t
+radc_child(struct radc_node* n, uint8_t byte)
+{
+	uint8_t* body = radc_body(n);
+	unsigned i;
+
+	switch(n->type) {
+	case RADC_NODE4:
+		for(i=0; i<n->count; i++) {
+			if(body[i] == byte)
+				return ((uint32_t*)(body + 4))[i];
+		}
+		return 0;
+	case RADC_NODE16:
+		for(i=0; i<n->count; i++) {
+			if(body[i] == byte)
+				return ((uint32_t*)(body + 16))[i];
+		}
+		return 0;
+	case RADC_NODE48:
+		i = body[byte];
+		return i ? ((uint32_t*)(body + 256))[i - 1] : 0;
+	default:
+		return ((uint32_t*)body)[byte];
+	}
+}
+
+int
+radcompact_name_lookup(struct radcompact* rc, const uint8_t* dname,
+	size_t dlen, void** encloser)
+{
+	uint8_t k[256];
+	uint16_t len = sizeof(k);
+	uint16_t pos = 0;
+	uint32_t child;
+	struct radc_node* n = (struct radc_node*)rc->base;
+
+	*encloser = NULL;
+	radomain_name_d2r(k, &len, dname, dlen);
+	while(1) {
+		if(n->plen) {
+			if(pos + n->plen > len ||
+				memcmp(n + 1, k + pos, n->plen) != 0)
+				return 0;
+			pos += n->plen;
+		}
+		/* a label ends here, the element is a parent of dname */
+		if(n->elem && (pos == 0 || pos == len || k[pos] == 0))
+			*encloser = n->elem;
+		if(pos == len)
+			return n->elem != NULL;
+		child = radc_child(n, k[pos]);
+		if(!child)
+			return 0;
+		pos++;
+		n = (struct radc_node*)(rc->base + child);
+	}
+}
@@ -0,0 +1,70 @@
+/*
+ * radcompact.h -- frozen, read only copy of a radix tree
+ *
+ * Copyright (c) 2018 tiglabs All rights reserved.
+ *
+ * See LICENSE for the license.
+ *
+ */
+#ifndef RADCOMPACT_H
+#define RADCOMPACT_H
+
+#include <sys/types.h>
+#include <stdint.h>
+
+struct radtree;
+
+/**
+ * A compact radix tree built from a radtree for the lookup path.
+ *
+ * All nodes live in one contiguous block, children are referenced by
+ * 32 bit offsets into that block, edge strings are stored inline in the
+ * node (path compression) and nodes come in the size classes 4, 16, 48
+ * and 256 of an adaptive radix tree. It can not be modified, changes are
+ * made to the radtree and a new copy is built.
+ */
+struct radcompact {
+	/** start of the node block, the root node is at offset 0 */
+	uint8_t* base;
+	/** size of the node block in bytes */
+	size_t size;
+	/** number of elements */
+	size_t count;
+	/** number of nodes per size class */
+	size_t nodes[4];
+};
+
+/**
+ * Set the allocator for the node block, malloc and free by default.
+ * @param alloc: allocate size bytes.
+ * @param release: free a block returned by alloc.
+ */
+void radcompact_set_allocator(void* (*alloc)(size_t size),
+	void (*release)(void* ptr));
+
+/**
+ * Build a compact copy of the radix tree.
+ * @param rt: the radix tree, its elements are shared with the copy.
+ * @return new compact tree or NULL on alloc failure or empty tree.
+ */
+struct radcompact* radcompact_build(struct radtree* rt);
+
+/**
+ * Delete a compact tree, not its elements.
+ * @param rc: compact tree, may be NULL.
+ */
+void radcompact_delete(struct radcompact* rc);
+
+/**
+ * Look up a domain name in a compact tree of domain names.
+ * @param rc: the compact tree.
+ * @param dname: the domain name in wireformat.
+ * @param dlen: length of the domain name.
+ * @param encloser: returns the element of the longest name in the tree that
+ * 	is equal to or a parent of dname, NULL if there is none.
+ * @return true if dname itself is in the tree.
+ */
+int radcompact_name_lookup(struct radcompact* rc, const uint8_t* dname,
+	size_t dlen, void** encloser);
+
+#endif /* RADCOMPACT_H */
@@ -0,0 +1,202 @@
+/*
+ * slab.c -- typed slab allocators for the domain store
+ *
+ * Copyright (c) 2018 tiglabs All rights reserved.
+ *
+ * See LICENSE for the license.
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "slab.h"
+#include "util.h"
+
+#define SLAB_CLASS_NUM		12
+#define SLAB_CHUNK_MIN		(16 * 1024)
+#define SLAB_CHUNK_MAX		(2 * 1024 * 1024)
+#define SLAB_MAX_CACHES		256
+
+static const uint16_t slab_class_size[SLAB_CLASS_NUM] = {
+	16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024
+};
+
+static const char *slab_type_names[SLAB_TYPE_MAX] = {
+	"domain", "dname", "rrset", "rrset_index",
+	"rrset_wire", "rr", "rdata"
+};
+
+struct slab_free_obj {
+	struct slab_free_obj *next;
+};
+
+struct slab_class {
+	struct slab_free_obj *free_list;
+	/* unused tail of the newest chunk */
+	uint8_t *cur;
+	uint8_t *end;
+	/* size of the next chunk, doubles up to SLAB_CHUNK_MAX */
+	size_t chunk_size;
+};
+
+struct slab_cache {
+	struct slab_class classes[SLAB_TYPE_MAX][SLAB_CLASS_NUM];
+	struct slab_stats stats[SLAB_TYPE_MAX];
+};
+
+static void *(*slab_backend_alloc)(size_t) = malloc;
+static void (*slab_backend_release)(void *) = free;
+
+static __thread struct slab_cache *slab_local;
+static struct slab_cache *slab_caches[SLAB_MAX_CACHES];
+static unsigned slab_cache_num;
+
+void
+slab_set_backend(void *(*alloc)(size_t size), void (*release)(void *ptr))
+{
+	slab_backend_alloc = alloc;
+	slab_backend_release = release;
+}
+
+const char *
+slab_type_name(enum slab_type type)
+{
+	return slab_type_names[type];
+}
+
+static struct slab_cache *
+slab_cache_get(void)
+{
+	unsigned idx;
+
+	if (slab_local)
+		return slab_local;
+	slab_local = (struct slab_cache *) xalloc_zero(sizeof(struct slab_cache));
+	idx = __sync_fetch_and_add(&slab_cache_num, 1);
+	if (idx < SLAB_MAX_CACHES)
+		slab_caches[idx] = slab_local;
+	return slab_local;
+}
+
+static inline int
+slab_class_index(size_t size)
+{
+	int i;
+	for (i = 0; i < SLAB_CLASS_NUM; i++) {
+		if (size <= slab_class_size[i])
+			return i;
+	}
+	return -1;
+}
+
+static void *
+slab_backend_get(size_t size)
+{
+	void *p = slab_backend_alloc(size);
+	if (!p) {
+		log_msg(LOG_ERR, "slab backend alloc of %zu bytes failed: %s",
+			size, strerror(errno));
+		exit(1);
+	}
+	return p;
+}
+
+void *
+slab_alloc(enum slab_type type, size_t size)
+{
+	struct slab_cache *cache = slab_cache_get();
+	struct slab_stats *st = &cache->stats[type];
+	struct slab_class *sc;
+	struct slab_free_obj *obj;
+	int idx = slab_class_index(size);
+	size_t csize;
+
+	st->allocs++;
+	st->objects++;
+	if (idx < 0) {
+		st->bytes += size;
+		st->reserved += size;
+		return slab_backend_get(size);
+	}
+
+	csize = slab_class_size[idx];
+	st->bytes += csize;
+	sc = &cache->classes[type][idx];
+	if (sc->free_list) {
+		obj = sc->free_list;
+		sc->free_list = obj->next;
+		return obj;
+	}
+	if (sc->cur + csize > sc->end) {
+		if (sc->chunk_size == 0)
+			sc->chunk_size = SLAB_CHUNK_MIN;
+		sc->cur = (uint8_t *) slab_backend_get(sc->chunk_size);
+		sc->end = sc->cur + sc->chunk_size;
+		st->reserved += sc->chunk_size;
+		if (sc->chunk_size < SLAB_CHUNK_MAX)
+			sc->chunk_size *= 2;
+	}
+	obj = (struct slab_free_obj *) sc->cur;
+	sc->cur += csize;
+	return obj;
+}
+
+void *
+slab_alloc_zero(enum slab_type type, size_t size)
+{
+	void *p = slab_alloc(type, size);
+	memset(p, 0, size);
+	return p;
+}
+
+void
+slab_free(enum slab_type type, void *ptr, size_t size)
+{
+	struct slab_cache *cache;
+	struct slab_stats *st;
+	struct slab_class *sc;
+	struct slab_free_obj *obj = (struct slab_free_obj *) ptr;
+	int idx;
+
+	if (!ptr)
+		return;
+	cache = slab_cache_get();
+	st = &cache->stats[type];
+	idx = slab_class_index(size);
+	st->frees++;
+	st->objects--;
+	if (idx < 0) {
+		st->bytes -= size;
+		st->reserved -= size;
+		slab_backend_release(ptr);
+		return;
+	}
+	/* objects freed by another thread move to this thread's lists */
+	st->bytes -= slab_class_size[idx];
+	sc = &cache->classes[type][idx];
+	obj->next = sc->free_list;
+	sc->free_list = obj;
+}
+
+void
+slab_stats_get(struct slab_stats stats[SLAB_TYPE_MAX])
+{
+	unsigned i, num = slab_cache_num;
+	int t;
+
+	memset(stats, 0, sizeof(struct slab_stats) * SLAB_TYPE_MAX);
+	if (num > SLAB_MAX_CACHES)
+		num = SLAB_MAX_CACHES;
+	for (i = 0; i < num; i++) {
+		struct slab_cache *cache = slab_caches[i];
+		if (!cache)
+			continue;
+		for (t = 0; t < SLAB_TYPE_MAX; t++) {
+			stats[t].objects += cache->stats[t].objects;
+			stats[t].bytes += cache->stats[t].bytes;
+			stats[t].reserved += cache->stats[t].reserved;
+			stats[t].allocs += cache->stats[t].allocs;
+			stats[t].frees += cache->stats[t].frees;
+		}
+	}
+}
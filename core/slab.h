@@ -0,0 +1,53 @@
+/*
+ * slab.h -- typed slab allocators for the domain store
+ *
+ * Copyright (c) 2018 tiglabs All rights reserved.
+ *
+ * See LICENSE for the license.
+ *
+ */
+#ifndef _SLAB_H_
+#define _SLAB_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* object types of the domain store, each one is accounted separately */
+enum slab_type {
+	SLAB_DOMAIN,
+	SLAB_DNAME,
+	SLAB_RRSET,
+	SLAB_RRSET_INDEX,
+	SLAB_RRSET_WIRE,
+	SLAB_RR,
+	SLAB_RDATA,
+	SLAB_TYPE_MAX
+};
+
+struct slab_stats {
+	uint64_t objects;	/* live objects */
+	uint64_t bytes;		/* live bytes, rounded up to the size class */
+	uint64_t reserved;	/* bytes taken from the backend */
+	uint64_t allocs;
+	uint64_t frees;
+};
+
+/*
+ * Objects come from per thread caches with one free list per type and size
+ * class. Chunks are carved from memory of the backend, malloc by default,
+ * and are never handed back. Objects larger than the biggest class go to
+ * the backend directly. The size passed to slab_free must be the size the
+ * object was allocated with.
+ */
+void slab_set_backend(void *(*alloc)(size_t size), void (*release)(void *ptr));
+
+void *slab_alloc(enum slab_type type, size_t size);
+void *slab_alloc_zero(enum slab_type type, size_t size);
+void slab_free(enum slab_type type, void *ptr, size_t size);
+
+const char *slab_type_name(enum slab_type type);
+
+/* sum over the caches of all threads */
+void slab_stats_get(struct slab_stats stats[SLAB_TYPE_MAX]);
+
+#endif /* _SLAB_H_ */
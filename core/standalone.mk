@@ -0,0 +1,37 @@
+# Plain build of libkdns.a without DPDK, for benchmarks and profiling:
+#   make -C core -f standalone.mk [O=build] [CFLAGS_EXTRA=...]
+
+O ?= build
+CC ?= gcc
+AR ?= ar
+
+CFLAGS ?= -O3 -g -march=native
+CFLAGS += -Wall $(CFLAGS_EXTRA)
+
+SRCS := dns.c \
+domain_store.c \
+packet.c \
+query.c \
+radtree.c \
+radcompact.c \
+slab.c \
+util.c \
+zone.c
+
+OBJS := $(addprefix $(O)/,$(SRCS:.c=.o))
+
+.PHONY: all
+all: $(O)/libkdns.a
+
+$(O)/libkdns.a: $(OBJS)
+	$(AR) rcs $@ $^
+
+$(O)/%.o: %.c $(wildcard *.h) | $(O)
+	$(CC) $(CFLAGS) -c $< -o $@
+
+$(O):
+	mkdir -p $@
+
+.PHONY: clean
+clean:
+	rm -rf $(O)
@@ -0,0 +1,16 @@
+/*
+ * view_def.h -- view limits, shared by the core and the configuration
+ *
+ * Copyright (c) 2018 tiglabs All rights reserved.
+ *
+ * See LICENSE for the license.
+ *
+ */
+
+#ifndef	_VIEW_DEF_H_
+#define	_VIEW_DEF_H_
+
+/* views including the default view 0 */
+#define MAX_VIEWS 16
+
+#endif	/* _VIEW_DEF_H_ */
@@ -18,109 +18,66 @@
 #include "domain_store.h"
 
 
-uint16_t *
-alloc_rdata_init( const void *data, size_t size)
-{
-	uint16_t *result = xalloc( sizeof(uint16_t) + size);
-	*result = size;
-	memcpy(result + 1, data, size);
-	return result;
-}
-
-
-uint16_t *
+uint32_t
 zparser_conv_serial( const char *serialstr)
 {
-	uint16_t *r = NULL;
 	uint32_t serial;
 	const char *t;
 
 	serial = strtoserial(serialstr, &t);
 	if (*t != '\0') {
 		log_msg(LOG_ERR,"serial is expected or serial too big");
-	} else {
-		serial = htonl(serial);
-		r = alloc_rdata_init( &serial, sizeof(serial));
+		return 0;
 	}
-	return r;
+	return htonl(serial);
 }
 
-uint16_t *
-zparser_conv_short( const char *text)
+int
+zparser_conv_a( const char *text, uint8_t *a)
 {
-	uint16_t *r = NULL;
-	uint16_t value;
-	char *end;
-
-	value = htons((uint16_t) strtol(text, &end, 10));
-	if (*end != '\0') {
-		log_msg(LOG_ERR,"integer value is expected");
-	} else {
-		r = alloc_rdata_init( &value, sizeof(value));
+	if (inet_pton(AF_INET, text, a) != 1) {
+		log_msg(LOG_ERR,"invalid IPv4 address '%s'", text);
+		return 0;
 	}
-	return r;
+	return 1;
 }
 
-uint16_t *
-zparser_conv_a( const char *text)
+int
+zparser_conv_aaaa( const char *text, uint8_t *aaaa)
 {
-	in_addr_t address;
-	uint16_t *r = NULL;
-
-	if (inet_pton(AF_INET, text, &address) != 1) {
-		log_msg(LOG_ERR,"invalid IPv4 address '%s'", text);
-	} else {
-		r = alloc_rdata_init( &address, sizeof(address));
+	if (inet_pton(AF_INET6, text, aaaa) != 1) {
+		log_msg(LOG_ERR,"invalid IPv6 address '%s'", text);
+		return 0;
 	}
-	return r;
+	return 1;
 }
 
 
  int
 zrdatacmp(uint16_t type, rr_type *a, rr_type *b)
 {
-	int i = 0;
-
 	assert(a);
 	assert(b);
 
-	/* One is shorter than another */
-	if (a->rdata_count != b->rdata_count)
+	switch (type) {
+	case TYPE_A:
+		return memcmp(a->rdata.a, b->rdata.a, sizeof(a->rdata.a)) != 0;
+	case TYPE_AAAA:
+		return memcmp(a->rdata.aaaa, b->rdata.aaaa, sizeof(a->rdata.aaaa)) != 0;
+	case TYPE_SRV:
+		return a->rdata.srv.target != b->rdata.srv.target ||
+			memcmp(a->rdata.srv.fixed, b->rdata.srv.fixed,
+				sizeof(a->rdata.srv.fixed)) != 0;
+	case TYPE_CNAME:
+		return a->rdata.target != b->rdata.target;
+	case TYPE_SOA:
+		return a->rdata.soa->mname != b->rdata.soa->mname ||
+			a->rdata.soa->rname != b->rdata.soa->rname ||
+			memcmp(&a->rdata.soa->serial, &b->rdata.soa->serial,
+				5 * sizeof(uint32_t)) != 0;
+	default:
 		return 1;
-
-	/* Compare element by element */
-	for (i = 0; i < a->rdata_count; ++i) {
-		if (rdata_atom_is_domain(type, i)) {
-			if (rdata_atom_domain(a->rdatas[i])
-			    != rdata_atom_domain(b->rdatas[i]))
-			{
-				return 1;
-			}
-		} else if(rdata_atom_is_literal_domain(type, i)) {
-			if (rdata_atom_size(a->rdatas[i])
-			    != rdata_atom_size(b->rdatas[i]))
-				return 1;
-			if (!domain_name_equal_nocase(rdata_atomdata(a->rdatas[i]),
-				   rdata_atomdata(b->rdatas[i]),
-				   rdata_atom_size(a->rdatas[i])))
-				return 1;
-		} else {
-			if (rdata_atom_size(a->rdatas[i])
-			    != rdata_atom_size(b->rdatas[i]))
-			{
-				return 1;
-			}
-			if (memcmp(rdata_atomdata(a->rdatas[i]),
-				   rdata_atomdata(b->rdatas[i]),
-				   rdata_atom_size(a->rdatas[i])) != 0)
-			{
-				return 1;
-			}
-		}
 	}
-
-	/* Otherwise they are equal */
-	return 0;
 }
 
 
@@ -189,44 +146,3 @@ void domain_store_zones_check_create(struct kdns*  kdns, char* zones)
     }
     return;
 }
-
-
-/** add an rdata (uncompressed) to the destination */
-static size_t
-add_rdata(rr_type* rr, unsigned i, uint8_t* buf, size_t buflen)
-{
-	switch(rdata_atom_wireformat_type(rr->type, i)) {
-		case RDATA_WF_COMPRESSED_DNAME:
-		case RDATA_WF_UNCOMPRESSED_DNAME:
-		{
-			const domain_name_st* dname = domain_dname(
-				rdata_atom_domain(rr->rdatas[i]));
-			if(dname->name_size > buflen)
-				return 0;
-			memmove(buf, domain_name_get(dname), dname->name_size);
-			return dname->name_size;
-		}
-		default:
-			break;
-	}
-	if(rdata_atom_size(rr->rdatas[i]) > buflen)
-		return 0;
-	memmove(buf, rdata_atomdata(rr->rdatas[i]),
-		rdata_atom_size(rr->rdatas[i]));
-	return rdata_atom_size(rr->rdatas[i]);
-}
-
-/* marshal rdata into buffer, must be MAX_RDLENGTH in size */
-size_t
-rr_marshal_rdata(rr_type* rr, uint8_t* rdata, size_t sz)
-{
-	size_t len = 0;
-	unsigned i;
-	assert(rr);
-	for(i=0; i<rr->rdata_count; i++) {
-		len += add_rdata(rr, i, rdata+len, sz-len);
-	}
-	return len;
-}
-
-
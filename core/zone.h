@@ -39,13 +39,13 @@ zrdatacmp(uint16_t type, rr_type *a, rr_type *b);
 
 
 
-uint16_t *zparser_conv_serial( const char *periodstr);
+/* serial in network order, 0 if it does not parse */
+uint32_t zparser_conv_serial( const char *periodstr);
 
-uint16_t *zparser_conv_short( const char *text);
-
-uint16_t *zparser_conv_a( const char *text);
-
-uint16_t *alloc_rdata_init( const void *data, size_t size);
+/* IPv4 address into the 4 bytes of A rdata, 0 if it does not parse */
+int zparser_conv_a( const char *text, uint8_t *a);
+/* IPv6 address into the 16 bytes of AAAA rdata, 0 if it does not parse */
+int zparser_conv_aaaa( const char *text, uint8_t *aaaa);
 
 
 #endif /* _ZONEC_H_ */
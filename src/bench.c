@@ -0,0 +1,400 @@
+/*
+ * bench.c -- offline throughput benchmark on a ring port
+ */
+#include <stdio.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_dev.h>
+#include <rte_ethdev.h>
+#include <rte_eth_ring.h>
+#include <rte_lcore.h>
+#include <rte_malloc.h>
+#include <rte_mbuf.h>
+#include <rte_memcpy.h>
+#include <rte_ring.h>
+
+#include "bench.h"
+#include "netdev.h"
+#include "dns-conf.h"
+#include "db_update.h"
+#include "packet.h"
+#include "util.h"
+
+#define BENCH_RING_SIZE     1024
+#define BENCH_MAX_QUERIES   65536U
+#define BENCH_QUERY_MAX     256
+#define BENCH_FEED_ROUNDS   8
+#define BENCH_TTL           300
+/* zone plus the synthetic label */
+#define BENCH_NAME_LEN      (DB_MAX_NAME_LEN + 16)
+
+/* answer sizes: < 64, < 128, < 256, < 512, < 1024 and the rest */
+#define BENCH_SIZE_CLASSES  6
+
+extern struct rte_mempool *pkt_mbuf_pool;
+extern struct kdns dpdk_dns[];
+
+struct bench_query {
+    uint16_t len;
+    uint8_t data[BENCH_QUERY_MAX];
+};
+
+static struct rte_ring *bench_rx[RTE_PMD_RING_MAX_RX_RINGS];
+static struct rte_ring *bench_tx[RTE_PMD_RING_MAX_TX_RINGS];
+static uint16_t bench_rxq_num;
+static uint16_t bench_txq_num;
+static uint8_t bench_port;
+
+static struct bench_query *bench_queries;
+static uint32_t bench_query_num;
+
+static const uint16_t bench_size_limits[BENCH_SIZE_CLASSES - 1] = {64, 128, 256, 512, 1024};
+
+
+static void bench_zone(char *zone, size_t len) {
+    char *p;
+
+    snprintf(zone, len, "%s", g_dns_cfg->bench.zone ? g_dns_cfg->bench.zone : g_dns_cfg->comm.zones);
+    if ((p = strchr(zone, ',')) != NULL)
+        *p = '\0';
+}
+
+static uint32_t bench_srv_names(void) {
+    return (uint64_t)g_dns_cfg->bench.names * g_dns_cfg->bench.srv_percent / 100;
+}
+
+void bench_port_create(void) {
+    char name[RTE_RING_NAMESIZE];
+    int port;
+    uint16_t q;
+
+    bench_rxq_num = g_dns_cfg->netdev.rxq_num;
+    bench_txq_num = g_dns_cfg->netdev.txq_num;
+    if (bench_rxq_num > RTE_PMD_RING_MAX_RX_RINGS || bench_txq_num > RTE_PMD_RING_MAX_TX_RINGS) {
+        log_msg(LOG_ERR, "bench: at most %d rx and %d tx queues\n",
+            RTE_PMD_RING_MAX_RX_RINGS, RTE_PMD_RING_MAX_TX_RINGS);
+        exit(-1);
+    }
+    /* the master is the only producer of the rx rings and consumer of the tx rings */
+    for (q = 0; q < bench_rxq_num; q++) {
+        snprintf(name, sizeof(name), "bench_rx_%u", q);
+        bench_rx[q] = rte_ring_create(name, BENCH_RING_SIZE, rte_socket_id(), RING_F_SP_ENQ | RING_F_SC_DEQ);
+        if (bench_rx[q] == NULL) {
+            log_msg(LOG_ERR, "bench: cannot create ring %s\n", name);
+            exit(-1);
+        }
+    }
+    for (q = 0; q < bench_txq_num; q++) {
+        snprintf(name, sizeof(name), "bench_tx_%u", q);
+        bench_tx[q] = rte_ring_create(name, BENCH_RING_SIZE, rte_socket_id(), RING_F_SP_ENQ | RING_F_SC_DEQ);
+        if (bench_tx[q] == NULL) {
+            log_msg(LOG_ERR, "bench: cannot create ring %s\n", name);
+            exit(-1);
+        }
+    }
+
+    port = rte_eth_from_rings("net_ring_bench", bench_rx, bench_rxq_num, bench_tx, bench_txq_num, rte_socket_id());
+    if (port < 0) {
+        log_msg(LOG_ERR, "bench: cannot create the ring port\n");
+        exit(-1);
+    }
+    bench_port = port;
+    g_dns_cfg->netdev.ports[0] = bench_port;
+    g_dns_cfg->netdev.port_num = 1;
+    g_dns_cfg->netdev.flow_steering = 0;
+}
+
+void bench_store_load(unsigned lcore_id) {
+    struct bench_config *cfg = &g_dns_cfg->bench;
+    struct domain_store *db = dpdk_dns[lcore_id].db;
+    char zone[DB_MAX_NAME_LEN], name[BENCH_NAME_LEN], host[BENCH_NAME_LEN], ip[INET_ADDRSTRLEN];
+    uint32_t srv_names = bench_srv_names();
+    uint32_t a_names = cfg->names - srv_names;
+    uint32_t i, j, t, addr;
+
+    bench_zone(zone, sizeof(zone));
+    for (i = 0; i < cfg->names; i++) {
+        if (i < srv_names) {
+            /* SRV names point at A names when there are any */
+            snprintf(name, sizeof(name), "s%u.%s", i, zone);
+            for (j = 0; j < cfg->srv_targets; j++) {
+                t = a_names ? srv_names + (i * cfg->srv_targets + j) % a_names : j;
+                snprintf(host, sizeof(host), "n%u.%s", t, zone);
+                domaindata_srv_insert(db, zone, name, host, 10, 10, 8000 + j, BENCH_TTL, 0);
+            }
+        } else {
+            snprintf(name, sizeof(name), "n%u.%s", i, zone);
+            for (j = 0; j < cfg->ips_per_name; j++) {
+                addr = i * cfg->ips_per_name + j + 1;
+                snprintf(ip, sizeof(ip), "10.%u.%u.%u", (addr >> 16) & 0xff, (addr >> 8) & 0xff, addr & 0xff);
+                domaindata_a_insert(db, zone, name, ip, BENCH_TTL, 0, 0);
+            }
+        }
+    }
+    log_msg(LOG_INFO, "bench: lcore %u loaded %u names (%u SRV) in %s\n", lcore_id, cfg->names, srv_names, zone);
+}
+
+/* an Ethernet/IPv4/UDP query for name from a client address derived from seq */
+static int bench_query_build(struct bench_query *bq, const char *name, uint16_t qtype, uint32_t seq,
+        struct ether_addr *dst_mac, uint32_t dst_addr) {
+    struct ether_hdr *eth = (struct ether_hdr *)bq->data;
+    struct ipv4_hdr *ip = (struct ipv4_hdr *)(eth + 1);
+    struct udp_hdr *udp = (struct udp_hdr *)(ip + 1);
+    uint8_t *dns = (uint8_t *)(udp + 1);
+    uint8_t *p = dns + DNS_HEAD_SIZE;
+    const char *label = name;
+    size_t len;
+    uint16_t dns_len;
+
+    memset(bq, 0, sizeof(*bq));
+    while (*label) {
+        len = strcspn(label, ".");
+        if (len == 0 || len > 63 || p + len + 1 + 5 > bq->data + BENCH_QUERY_MAX)
+            return -1;
+        *p++ = len;
+        memcpy(p, label, len);
+        p += len;
+        label += len;
+        if (*label == '.')
+            label++;
+    }
+    *p++ = 0;
+    *(unaligned_uint16_t *)p = htons(qtype);
+    *(unaligned_uint16_t *)(p + 2) = htons(CLASS_IN);
+    p += 4;
+    dns_len = p - dns;
+
+    *(unaligned_uint16_t *)dns = htons(seq);
+    *(unaligned_uint16_t *)(dns + 2) = htons(0x0100);   /* RD */
+    *(unaligned_uint16_t *)(dns + 4) = htons(1);
+
+    ether_addr_copy(dst_mac, &eth->d_addr);
+    eth->s_addr.addr_bytes[0] = 0x02;
+    eth->s_addr.addr_bytes[5] = 0x01;
+    eth->ether_type = htons(ETHER_TYPE_IPv4);
+
+    ip->version_ihl = IP_VHL_DEF;
+    ip->total_length = htons(sizeof(struct ipv4_hdr) + sizeof(struct udp_hdr) + dns_len);
+    ip->time_to_live = IP_DEFTTL;
+    ip->next_proto_id = IPPROTO_UDP;
+    ip->src_addr = htonl(0x0a000000 | (seq & 0xffffff));
+    ip->dst_addr = dst_addr;
+    ip->hdr_checksum = rte_ipv4_cksum(ip);
+
+    udp->src_port = htons(1024 + seq % 60000);
+    udp->dst_port = UDP_PORT_53;
+    udp->dgram_len = htons(sizeof(struct udp_hdr) + dns_len);
+
+    bq->len = UDP4_DATA_OFFSET + dns_len;
+    return 0;
+}
+
+/* names are sampled with a multiplicative hash so A and SRV queries mix */
+static void bench_queries_generate(void) {
+    struct bench_config *cfg = &g_dns_cfg->bench;
+    char zone[DB_MAX_NAME_LEN], name[BENCH_NAME_LEN];
+    struct ether_addr mac;
+    struct in_addr vip;
+    uint32_t srv_names = bench_srv_names();
+    uint32_t k, i, num = RTE_MIN(cfg->names, BENCH_MAX_QUERIES);
+
+    bench_zone(zone, sizeof(zone));
+    rte_eth_macaddr_get(bench_port, &mac);
+    if (g_dns_cfg->netdev.kni_vip == NULL || inet_pton(AF_INET, g_dns_cfg->netdev.kni_vip, &vip) != 1)
+        vip.s_addr = htonl(0x0a000001);
+
+    for (k = 0; k < num; k++) {
+        i = (uint32_t)(((uint64_t)k * 2654435761u) % cfg->names);
+        snprintf(name, sizeof(name), "%c%u.%s", i < srv_names ? 's' : 'n', i, zone);
+        if (bench_query_build(&bench_queries[bench_query_num], name,
+                i < srv_names ? TYPE_SRV : TYPE_A, k, &mac, vip.s_addr) == 0)
+            bench_query_num++;
+    }
+}
+
+static int bench_trace_query(struct rte_mbuf *pkt) {
+    struct ether_hdr *eth = rte_pktmbuf_mtod(pkt, struct ether_hdr *);
+    struct ipv4_hdr *ip = (struct ipv4_hdr *)(eth + 1);
+    struct udp_hdr *udp = (struct udp_hdr *)(ip + 1);
+
+    return pkt->nb_segs == 1 && pkt->data_len > UDP4_DATA_OFFSET + DNS_HEAD_SIZE &&
+        pkt->data_len <= BENCH_QUERY_MAX && eth->ether_type == htons(ETHER_TYPE_IPv4) &&
+        ip->version_ihl == IP_VHL_DEF && ip->next_proto_id == IPPROTO_UDP &&
+        udp->dst_port == UDP_PORT_53;
+}
+
+/* read the trace through the pcap PMD, only UDP/IPv4 queries to port 53 are kept */
+static void bench_trace_load(const char *path) {
+    struct rte_mbuf *pkts[NETIF_MAX_PKT_BURST];
+    struct rte_eth_conf conf;
+    char args[PATH_LENGTH + 32];
+    uint32_t skipped = 0;
+    uint16_t i, n;
+    uint8_t port;
+
+    snprintf(args, sizeof(args), "rx_pcap=%s,tx_pcap=/dev/null", path);
+    if (rte_eal_vdev_init("net_pcap_bench", args) < 0 || rte_eth_dev_get_port_by_name("net_pcap_bench", &port) != 0) {
+        log_msg(LOG_ERR, "bench: cannot open trace %s\n", path);
+        exit(-1);
+    }
+    memset(&conf, 0, sizeof(conf));
+    if (rte_eth_dev_configure(port, 1, 1, &conf) < 0 ||
+            rte_eth_rx_queue_setup(port, 0, BENCH_RING_SIZE, rte_socket_id(), NULL, pkt_mbuf_pool) < 0 ||
+            rte_eth_tx_queue_setup(port, 0, BENCH_RING_SIZE, rte_socket_id(), NULL) < 0 ||
+            rte_eth_dev_start(port) < 0) {
+        log_msg(LOG_ERR, "bench: cannot start the pcap port of %s\n", path);
+        exit(-1);
+    }
+
+    /* the pcap PMD returns nothing once the file is read */
+    while (bench_query_num < BENCH_MAX_QUERIES &&
+            (n = rte_eth_rx_burst(port, 0, pkts, NETIF_MAX_PKT_BURST)) > 0) {
+        for (i = 0; i < n; i++) {
+            if (bench_query_num < BENCH_MAX_QUERIES && bench_trace_query(pkts[i])) {
+                bench_queries[bench_query_num].len = pkts[i]->data_len;
+                rte_memcpy(bench_queries[bench_query_num].data, rte_pktmbuf_mtod(pkts[i], void *),
+                    pkts[i]->data_len);
+                bench_query_num++;
+            } else {
+                skipped++;
+            }
+            rte_pktmbuf_free(pkts[i]);
+        }
+    }
+    rte_eth_dev_stop(port);
+    rte_eth_dev_close(port);
+    log_msg(LOG_INFO, "bench: %u queries from %s, %u packets skipped\n", bench_query_num, path, skipped);
+}
+
+static uint16_t bench_feed(uint16_t q, uint32_t *cursor) {
+    struct rte_mbuf *pkts[NETIF_MAX_PKT_BURST];
+    struct bench_query *bq;
+    uint16_t i, sent;
+
+    if (rte_ring_free_count(bench_rx[q]) < NETIF_MAX_PKT_BURST ||
+            rte_pktmbuf_alloc_bulk(pkt_mbuf_pool, pkts, NETIF_MAX_PKT_BURST) != 0)
+        return 0;
+    for (i = 0; i < NETIF_MAX_PKT_BURST; i++) {
+        bq = &bench_queries[*cursor];
+        if (++*cursor == bench_query_num)
+            *cursor = 0;
+        rte_memcpy(rte_pktmbuf_mtod(pkts[i], void *), bq->data, bq->len);
+        pkts[i]->data_len = bq->len;
+        pkts[i]->pkt_len = bq->len;
+        pkts[i]->port = bench_port;
+    }
+    sent = rte_ring_sp_enqueue_burst(bench_rx[q], (void **)pkts, NETIF_MAX_PKT_BURST);
+    for (i = sent; i < NETIF_MAX_PKT_BURST; i++)
+        rte_pktmbuf_free(pkts[i]);
+    return sent;
+}
+
+static void bench_drain(uint64_t sizes[BENCH_SIZE_CLASSES]) {
+    struct rte_mbuf *pkts[NETIF_MAX_PKT_BURST];
+    uint16_t q, i, n;
+    uint32_t len;
+    int c;
+
+    for (q = 0; q < bench_txq_num; q++) {
+        n = rte_ring_sc_dequeue_burst(bench_tx[q], (void **)pkts, NETIF_MAX_PKT_BURST);
+        for (i = 0; i < n; i++) {
+            len = pkts[i]->pkt_len - UDP4_DATA_OFFSET;
+            for (c = 0; c < BENCH_SIZE_CLASSES - 1 && len >= bench_size_limits[c]; c++)
+                ;
+            sizes[c]++;
+            rte_pktmbuf_free(pkts[i]);
+        }
+    }
+}
+
+static void bench_report(uint64_t cycles, const uint64_t *rcv0, const uint64_t *snd0,
+        const uint64_t sizes[BENCH_SIZE_CLASSES], uint64_t underruns) {
+    struct bench_config *cfg = &g_dns_cfg->bench;
+    double secs = (double)cycles / rte_get_tsc_hz();
+    uint64_t rcv, snd, rcv_sum = 0, snd_sum = 0, size_sum = 0;
+    unsigned lcore_id;
+    int c;
+
+    printf("bench: %u queries from %s, %u names, %u s\n", bench_query_num,
+        cfg->trace ? cfg->trace : "the synthetic names", cfg->names, cfg->duration);
+    printf("%-8s %12s %12s %12s\n", "lcore", "rx_qps", "tx_qps", "cycles/pkt");
+    RTE_LCORE_FOREACH_SLAVE(lcore_id) {
+        struct netif_queue_stats *st = &kdns_net_device[0].l_netif_queue_conf[lcore_id].stats;
+        rcv = st->dns_pkts_rcv - rcv0[lcore_id];
+        snd = st->dns_pkts_snd - snd0[lcore_id];
+        rcv_sum += rcv;
+        snd_sum += snd;
+        /* the lcores busy poll, so this holds while the feeder keeps up */
+        printf("%-8u %12.0f %12.0f %12.0f\n", lcore_id, rcv / secs, snd / secs,
+            rcv ? (double)cycles / rcv : 0);
+    }
+    printf("%-8s %12.0f %12.0f\n", "total", rcv_sum / secs, snd_sum / secs);
+
+    for (c = 0; c < BENCH_SIZE_CLASSES; c++)
+        size_sum += sizes[c];
+    printf("answer size (dns bytes):\n");
+    for (c = 0; c < BENCH_SIZE_CLASSES; c++) {
+        if (c < BENCH_SIZE_CLASSES - 1)
+            printf("  < %-6u %6.2f%%\n", bench_size_limits[c], size_sum ? 100.0 * sizes[c] / size_sum : 0);
+        else
+            printf("  >= %-5u %6.2f%%\n", bench_size_limits[c - 1], size_sum ? 100.0 * sizes[c] / size_sum : 0);
+    }
+    printf("feeder underruns: %lu\n", underruns);
+    fflush(stdout);
+}
+
+void bench_run(void) {
+    struct bench_config *cfg = &g_dns_cfg->bench;
+    uint64_t hz = rte_get_tsc_hz();
+    uint64_t sizes[BENCH_SIZE_CLASSES];
+    uint64_t rcv0[RTE_MAX_LCORE], snd0[RTE_MAX_LCORE];
+    uint32_t cursor[RTE_PMD_RING_MAX_RX_RINGS];
+    uint64_t now, measure, end, underruns = 0;
+    unsigned lcore_id;
+    uint16_t q;
+    int measuring = 0, r;
+
+    bench_queries = rte_malloc("bench_queries", sizeof(struct bench_query) * BENCH_MAX_QUERIES, 0);
+    if (bench_queries == NULL) {
+        log_msg(LOG_ERR, "bench: cannot alloc the queries\n");
+        exit(-1);
+    }
+    if (cfg->trace)
+        bench_trace_load(cfg->trace);
+    else
+        bench_queries_generate();
+    if (bench_query_num == 0) {
+        log_msg(LOG_ERR, "bench: no queries to replay\n");
+        exit(-1);
+    }
+
+    for (q = 0; q < bench_rxq_num; q++)
+        cursor[q] = (uint64_t)q * bench_query_num / bench_rxq_num;
+    memset(sizes, 0, sizeof(sizes));
+    measure = rte_rdtsc() + hz * cfg->warmup;
+    end = measure + hz * cfg->duration;
+
+    while ((now = rte_rdtsc()) < end) {
+        if (unlikely(!measuring && now >= measure)) {
+            RTE_LCORE_FOREACH_SLAVE(lcore_id) {
+                rcv0[lcore_id] = kdns_net_device[0].l_netif_queue_conf[lcore_id].stats.dns_pkts_rcv;
+                snd0[lcore_id] = kdns_net_device[0].l_netif_queue_conf[lcore_id].stats.dns_pkts_snd;
+            }
+            memset(sizes, 0, sizeof(sizes));
+            measure = now;
+            measuring = 1;
+        }
+        for (q = 0; q < bench_rxq_num; q++) {
+            if (measuring && rte_ring_empty(bench_rx[q]))
+                underruns++;
+            for (r = 0; r < BENCH_FEED_ROUNDS && bench_feed(q, &cursor[q]) > 0; r++)
+                ;
+        }
+        bench_drain(sizes);
+    }
+
+    bench_report(now - measure, rcv0, snd0, sizes, underruns);
+    exit(0);
+}
@@ -0,0 +1,20 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+/*
+ * Offline benchmark (--bench): the served port is a ring port, the master
+ * replays queries from a pcap trace or from the synthetic names into its rx
+ * rings and takes the answers off its tx rings, the lcores run the normal
+ * process_slave loop.
+ */
+
+/* replace NETDEV/ports by the ring port */
+void bench_port_create(void);
+
+/* load the synthetic names of BENCH into the store of the lcore */
+void bench_store_load(unsigned lcore_id);
+
+/* on the master: replay, print the report and exit */
+void bench_run(void);
+
+#endif
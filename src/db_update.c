@@ -2,7 +2,10 @@
  * data_update.c 
  */
 #include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
 #include "db_update.h"
+#include "slab.h"
 #include "util.h"
 
 
@@ -19,45 +22,33 @@ static rrset_type *  do_domaindata_insert(struct  domain_store *db,zone_type * z
     /* Do we have this type of rrset already? */
     rrset = domain_find_rrset(rr->owner, zo, rr->type);
     if (!rrset) {
-        rrset = (rrset_type *) xalloc(sizeof(rrset_type));
+        rrset = (rrset_type *) slab_alloc_zero(SLAB_RRSET, sizeof(rrset_type));
         rrset->zone = zo;
-        rrset->rr_count = 1;
-        rrset->rrs = (rr_type *) xalloc(sizeof(rr_type));
-        rrset->rrs[0] = *rr;
+        rrset_add_rr(rrset, rr);
 
         /* Add it */
         domain_add_rrset(rr->owner, rrset);
     } else {
-        int i;
-        rr_type* o;
         if (rrset->rrs[0].ttl != rr->ttl) {
             log_msg(LOG_ERR,"TTL  does not match\n");
             return NULL;        
         }
 
-        /* Search for possible duplicates... */
-        for (i = 0; i < rrset->rr_count; i++) {
-            if (!zrdatacmp(rr->type, rr, &rrset->rrs[i])) {
-                break;
+        /* Discard the duplicates, an address posted again takes its new weight */
+        int pos = rrset_find_rr(rrset, rr);
+        if (pos >= 0) {
+            if ((rr->type == TYPE_A || rr->type == TYPE_AAAA) && rrset->rrs[pos].weight != rr->weight) {
+                rrset_set_weight(rrset, pos, rr->weight);
+                return rrset;
             }
-        }
-
-        /* Discard the duplicates... */
-        if (i < rrset->rr_count) {
             return NULL;
         }
-        if(rrset->rr_count == 65535) {
+
+        /* Add it... */
+        if (rrset_add_rr(rrset, rr) != 0) {
             log_msg(LOG_ERR,"too many RRs for domain RRset");
             return NULL;
         }
-
-        /* Add it... */
-        o = rrset->rrs;
-        rrset->rrs = (rr_type *) xalloc_array_zero(rrset->rr_count + 1, sizeof(rr_type));
-        memcpy(rrset->rrs, o, (rrset->rr_count) * sizeof(rr_type));
-        free(o);
-        rrset->rrs[rrset->rr_count] = *rr;
-        ++rrset->rr_count;
     } 
     return rrset ;
 }
@@ -77,37 +68,16 @@ static int  do_domaindata_delete(struct  domain_store *db,zone_type * zo,const d
         log_msg(LOG_ERR,"rrset not find :%s \n",domain_name_get(dname));
        return -1;
     } else {
-        int rrnum;
         /* Search for the val ... */
-        for (rrnum = 0; rrnum < rrset->rr_count; rrnum ++) {
-            if (!zrdatacmp(rr->type, rr, &rrset->rrs[rrnum])) {
-                break;
-            }
-        }
-        // find
-   
-        if (rrnum < rrset->rr_count) {   
+        int rrnum = rrset_find_rr(rrset, rr);
+        if (rrnum >= 0) {   
              rr_lower_usage(db, &rrset->rrs[rrnum]);
              if(rrset->rr_count == 1) {
                 rrset_delete(db, domain, rrset);
                 rrset_zero_nonexist_check(domain, NULL);
                 domain_table_deldomain(db, domain);
              }else{
-                 rr_type* rrs_orig = rrset->rrs;
-    			add_rdata_to_recyclebin( &rrset->rrs[rrnum]);
-    			if(rrnum < rrset->rr_count-1)
-    				rrset->rrs[rrnum] = rrset->rrs[rrset->rr_count-1];
-    			memset(&rrset->rrs[rrset->rr_count-1], 0, sizeof(rr_type));
-    			/* realloc the rrs array one smaller */
-                rrset->rrs = xalloc_array_zero(rrset->rr_count-1,  sizeof(rr_type));
-                memcpy(rrset->rrs,rrs_orig,(rrset->rr_count-1) * sizeof(rr_type));
-    			if(!rrset->rrs) {
-    				log_msg(LOG_ERR,"out of memory, %s:%d", __FILE__, __LINE__);
-    				exit(1);
-    			}
-                free(rrs_orig);
-                
-                rrset->rr_count --;  
+                rrset_remove_rr(rrset, rrnum);
              }          
         }
     } 
@@ -137,31 +107,14 @@ int do_domaindata_delete_all(struct  domain_store *db,zone_type * zo,const domai
 }
 
 
-static void
-db_zadd_rdata_domain( struct  domain_store *db,char *domian_name,rr_type * rr_insert)
+static domain_type *
+db_zadd_rdata_domain( struct  domain_store *db,char *domian_name)
 {
-
     const domain_name_st* dname = domain_name_parse((const char*)domian_name);
     domain_type* owner = domain_table_insert(db->domains,dname,0);
 
-   	if (rr_insert->rdata_count >= MAXRDATALEN) {
-		log_msg(LOG_ERR,"too many rdata elements");
-	} else {
-        rr_insert->rdatas[rr_insert->rdata_count].domain = owner;
-        owner->usage ++; /* new reference to domain */
-        ++rr_insert->rdata_count;
-	}
-}
-
-static void
-db_zadd_rdata_wireformat(rr_type * rr_insert, uint16_t *data)
-{
-	if (rr_insert->rdata_count >= MAXRDATALEN) {
-		log_msg(LOG_ERR,"too many rdata elements");
-	} else {
-		rr_insert->rdatas[rr_insert->rdata_count].data = data;
-		++ rr_insert->rdata_count;
-	}
+    owner->usage ++; /* new reference to domain */
+    return owner;
 }
 
 
@@ -176,33 +129,35 @@ int domaindata_soa_insert(struct  domain_store *db,char *zone_name){
         return -1;		
 	}
 
-    rr_type * rr_insert =  (rr_type *) xalloc(sizeof(rr_type));
-    rr_insert->klass      = CLASS_IN;
-    rr_insert->type       = TYPE_SOA;
-    rr_insert->rdata_count = 0;
+    rr_type rr_insert;
+    memset(&rr_insert, 0, sizeof(rr_insert));
+    rr_insert.klass      = CLASS_IN;
+    rr_insert.type       = TYPE_SOA;
+
+    struct soa_rdata *soa = slab_alloc_zero(SLAB_RDATA, sizeof(struct soa_rdata));
+    rr_insert.rdata.soa = soa;
 
     char z_name[64]={0};
     snprintf(z_name, sizeof(z_name), "ns1.%s", zone_name);
-    rr_insert->rdatas =  xalloc_array_zero( MAXRDATALEN, sizeof(rdata_atom_type));
-
-    db_zadd_rdata_domain(db,z_name,rr_insert);//ns
+    soa->mname = db_zadd_rdata_domain(db,z_name);//ns
     snprintf(z_name, sizeof(z_name), "mail.%s", zone_name);
-    db_zadd_rdata_domain(db,z_name,rr_insert);//email
-    db_zadd_rdata_wireformat(rr_insert, zparser_conv_serial("2017070809"));//serial number
-    db_zadd_rdata_wireformat(rr_insert, zparser_conv_serial("3600"));//refresh
-    db_zadd_rdata_wireformat(rr_insert, zparser_conv_serial("900"));//retry
-    db_zadd_rdata_wireformat(rr_insert, zparser_conv_serial("1209600"));//expire
-    db_zadd_rdata_wireformat(rr_insert, zparser_conv_serial("1800"));//  ttl
+    soa->rname = db_zadd_rdata_domain(db,z_name);//email
+    soa->serial = zparser_conv_serial("2017070809");//serial number
+    soa->refresh = zparser_conv_serial("3600");//refresh
+    soa->retry = zparser_conv_serial("900");//retry
+    soa->expire = zparser_conv_serial("1209600");//expire
+    soa->minimum = zparser_conv_serial("1800");//  ttl
 
     domain_type* owner = domain_table_insert(db->domains,zname,0);
 
-    rrset_type *  rrset = do_domaindata_insert(db,zo,zname, rr_insert,0);
+    rrset_type *  rrset = do_domaindata_insert(db,zo,zname, &rr_insert,0);
         
     if (rrset != NULL){
         apex_rrset_checks(rrset,owner);
         return 0;
     }
 
+    add_rdata_to_recyclebin(&rr_insert);
     return -1;
 }
 
@@ -219,43 +174,32 @@ int domaindata_srv_insert(struct  domain_store *db,char *zone_name,char *domian_
         return -1;		
 	}
 
-   rr_type * rr_insert =  (rr_type *) xalloc(sizeof(rr_type));
-   rr_insert->klass      = CLASS_IN;
-   rr_insert->type       = TYPE_SRV;
-   rr_insert->ttl        = ttl;
-   rr_insert->rdata_count = 0;
-   
-   rr_insert->rdatas =  xalloc_array_zero( MAXRDATALEN, sizeof(rdata_atom_type));
-
-    char string[32];
-    sprintf(string,"%d",prio); 
-    db_zadd_rdata_wireformat(rr_insert, zparser_conv_short(string));//prio
-    sprintf(string,"%d",weight); 
-    db_zadd_rdata_wireformat(rr_insert, zparser_conv_short(string));//weight
-    sprintf(string,"%d",port); 
-    db_zadd_rdata_wireformat(rr_insert, zparser_conv_short(string));//port
+   rr_type rr_insert;
+   memset(&rr_insert, 0, sizeof(rr_insert));
+   rr_insert.klass      = CLASS_IN;
+   rr_insert.type       = TYPE_SRV;
+   rr_insert.ttl        = ttl;
+   rr_insert.rdata.srv.fixed[0] = htons(prio);
+   rr_insert.rdata.srv.fixed[1] = htons(weight);
+   rr_insert.rdata.srv.fixed[2] = htons(port);
 
     domain_type* owner = domain_table_insert(db->domains,hostDomain,maxAnswer);//domain_table_find 
     if (owner == NULL){
        log_msg(LOG_ERR,"err can not find domian : %s\n",host);
-       goto error;
+       return -1;
     }
 
-    rr_insert->rdatas[rr_insert->rdata_count].domain = owner;
+    rr_insert.rdata.srv.target = owner;
 	owner->usage ++; /* new reference to domain */
-	++rr_insert->rdata_count;
      
     const domain_name_st* dname = domain_name_parse((const char*)domian_name);
-    rrset_type *  rrset = do_domaindata_insert(db,zo,dname, rr_insert,maxAnswer);
+    rrset_type *  rrset = do_domaindata_insert(db,zo,dname, &rr_insert,maxAnswer);
         
     if (rrset != NULL){
        
         return 0;
     }
 
-error:
-    free(rr_insert->rdatas);
-    free(rr_insert);
     return -1;
 }
 
@@ -271,37 +215,25 @@ uint16_t port, uint32_t ttl,uint32_t maxAnswer ){
         return -1;		
 	}
 
-   rr_type * rr_del=  (rr_type *) xalloc(sizeof(rr_type));
-   rr_del->klass      = CLASS_IN;
-   rr_del->type       = TYPE_SRV;
-   rr_del->ttl        = ttl;
-   rr_del->rdata_count = 0;
-   
-   rr_del->rdatas =  xalloc_array_zero(MAXRDATALEN, sizeof(rdata_atom_type));
-
-    char string[32];
-    sprintf(string,"%d",prio); 
-    db_zadd_rdata_wireformat(rr_del, zparser_conv_short(string));//prio
-    sprintf(string,"%d",weight); 
-    db_zadd_rdata_wireformat(rr_del, zparser_conv_short(string));//weight
-    sprintf(string,"%d",port); 
-    db_zadd_rdata_wireformat(rr_del, zparser_conv_short(string));//port
+   rr_type rr_del;
+   memset(&rr_del, 0, sizeof(rr_del));
+   rr_del.klass      = CLASS_IN;
+   rr_del.type       = TYPE_SRV;
+   rr_del.ttl        = ttl;
+   rr_del.rdata.srv.fixed[0] = htons(prio);
+   rr_del.rdata.srv.fixed[1] = htons(weight);
+   rr_del.rdata.srv.fixed[2] = htons(port);
 
     domain_type* owner = domain_table_insert(db->domains,hostDomain,maxAnswer);//domain_table_find 
     if (owner == NULL){
        log_msg(LOG_ERR,"err can not find domian : %s\n",host);
     }
 
-    rr_del->rdatas[rr_del->rdata_count].domain = owner;
-	++rr_del->rdata_count;
+    rr_del.rdata.srv.target = owner;
      
   const domain_name_st* dname = domain_name_parse((const char*)domian_name);
     
-   int ret = do_domaindata_delete(db,zo,dname,rr_del);
-   add_rdata_to_recyclebin(rr_del);
-   free(rr_del);
-   return ret;
-
+   return do_domaindata_delete(db,zo,dname,&rr_del);
 }
 
 
@@ -318,25 +250,23 @@ int domaindata_cname_insert(struct  domain_store *db,char *zone_name,char *domia
         return -1;		
 	}
 
-   rr_type * rr_insert =  (rr_type *) xalloc(sizeof(rr_type));
-   rr_insert->klass      = CLASS_IN;
-   rr_insert->type       = TYPE_CNAME;
-   rr_insert->ttl        = ttl;
-   rr_insert->rdata_count = 0;
-   
-   rr_insert->rdatas =  xalloc_array_zero( MAXRDATALEN, sizeof(rdata_atom_type));
+   rr_type rr_insert;
+   memset(&rr_insert, 0, sizeof(rr_insert));
+   rr_insert.klass      = CLASS_IN;
+   rr_insert.type       = TYPE_CNAME;
+   rr_insert.ttl        = ttl;
 
     domain_type* owner = domain_table_insert(db->domains,hostDomain,maxAnswer);//domain_table_find 
     if (owner == NULL){
         log_msg(LOG_ERR,"err can not find domian : %s\n",host);
+        return -1;
     }
 
-    rr_insert->rdatas[rr_insert->rdata_count].domain = owner;
+    rr_insert.rdata.target = owner;
 	owner->usage ++; /* reference to domain */
-	++rr_insert->rdata_count;
      
     const domain_name_st* dname = domain_name_parse((const char*)domian_name);
-    rrset_type *  rrset = do_domaindata_insert(db,zo,dname, rr_insert,maxAnswer);
+    rrset_type *  rrset = do_domaindata_insert(db,zo,dname, &rr_insert,maxAnswer);
         
     if (rrset != NULL){
        
@@ -362,18 +292,26 @@ int domaindata_cname_delete(struct  domain_store *db,char *zone_name,char *domia
 }
 
 
-int domaindata_a_insert(struct  domain_store *db,char *zone_name,char *domian_name, char * ip_addr, uint32_t ttl,uint32_t maxAnswer ){
+/* an A or AAAA rr for ip_addr, 0 if the address does not parse */
+static int rr_address_init(rr_type *rr, uint16_t type, char *ip_addr, uint32_t ttl, uint16_t weight){
 
-    rr_type * rr_insert =  (rr_type *) xalloc(sizeof(rr_type));
-    rr_insert->klass      = CLASS_IN;
-    rr_insert->type       = TYPE_A;
-    rr_insert->ttl        = ttl;
-    
-    rr_insert->rdatas =  xalloc_array_zero( MAXRDATALEN, sizeof(rdata_atom_type));
-    uint16_t * dataA = zparser_conv_a(ip_addr);
+    memset(rr, 0, sizeof(*rr));
+    rr->klass      = CLASS_IN;
+    rr->type       = type;
+    rr->ttl        = ttl;
+    rr->weight     = weight;
+    if (type == TYPE_AAAA)
+        return zparser_conv_aaaa(ip_addr, rr->rdata.aaaa);
+    return zparser_conv_a(ip_addr, rr->rdata.a);
+}
 
-    rr_insert->rdatas[0].data = dataA;
-    rr_insert->rdata_count =1; 
+static int domaindata_address_insert(struct  domain_store *db,char *zone_name,char *domian_name, uint16_t type,
+    char * ip_addr, uint32_t ttl,uint32_t maxAnswer, uint16_t weight ){
+
+    rr_type rr_insert;
+    if (!rr_address_init(&rr_insert, type, ip_addr, ttl, weight)) {
+        return -1;
+    }
 
     const domain_name_st* zname = domain_name_parse((const char*)zone_name);
    const  domain_name_st* dname = domain_name_parse((const char*)domian_name);
@@ -384,7 +322,7 @@ int domaindata_a_insert(struct  domain_store *db,char *zone_name,char *domian_na
         log_msg(LOG_ERR," not find the zone\n");
         return -1;		
 	}
-    rrset_type * rrset =  do_domaindata_insert(db,zo,dname, rr_insert,maxAnswer);
+    rrset_type * rrset =  do_domaindata_insert(db,zo,dname, &rr_insert,maxAnswer);
     if (rrset == NULL){
         return -1;
     }
@@ -392,20 +330,13 @@ int domaindata_a_insert(struct  domain_store *db,char *zone_name,char *domian_na
 
 }
 
+static int domaindata_address_delete(struct  domain_store *db,char *zone_name,char *domian_name, uint16_t type,
+    char * ip_addr, uint32_t ttl){
 
-
-int domaindata_a_delete(struct  domain_store *db,char *zone_name,char *domian_name,char * ip_addr, uint32_t ttl){
-
-    rr_type * rr_del =  (rr_type *) xalloc(sizeof(rr_type));
-    rr_del->klass      = CLASS_IN;
-    rr_del->type       = TYPE_A;
-    rr_del->ttl        = ttl;
-    
-    rr_del->rdatas =  xalloc_array_zero(MAXRDATALEN, sizeof(rdata_atom_type));
-    uint16_t * dataA = zparser_conv_a(ip_addr);
-
-    rr_del->rdatas[0].data = dataA;
-    rr_del->rdata_count =1; 
+    rr_type rr_del;
+    if (!rr_address_init(&rr_del, type, ip_addr, ttl, 0)) {
+        return -1;
+    }
 
    const domain_name_st* zname = domain_name_parse((const char*) zone_name);
    const domain_name_st* dname = domain_name_parse((const char*) domian_name);
@@ -417,10 +348,25 @@ int domaindata_a_delete(struct  domain_store *db,char *zone_name,char *domian_na
         return -1;		
 	}
 
-   int ret = do_domaindata_delete(db,zo,dname,rr_del);
-   add_rdata_to_recyclebin( rr_del);
-   free(rr_del);
-   return ret;
+   return do_domaindata_delete(db,zo,dname,&rr_del);
+}
+
+int domaindata_a_insert(struct  domain_store *db,char *zone_name,char *domian_name, char * ip_addr, uint32_t ttl,uint32_t maxAnswer,
+    uint16_t weight ){
+    return domaindata_address_insert(db, zone_name, domian_name, TYPE_A, ip_addr, ttl, maxAnswer, weight);
+}
+
+int domaindata_a_delete(struct  domain_store *db,char *zone_name,char *domian_name,char * ip_addr, uint32_t ttl){
+    return domaindata_address_delete(db, zone_name, domian_name, TYPE_A, ip_addr, ttl);
+}
+
+int domaindata_aaaa_insert(struct  domain_store *db,char *zone_name,char *domian_name, char * ip_addr, uint32_t ttl,uint32_t maxAnswer,
+    uint16_t weight ){
+    return domaindata_address_insert(db, zone_name, domian_name, TYPE_AAAA, ip_addr, ttl, maxAnswer, weight);
+}
+
+int domaindata_aaaa_delete(struct  domain_store *db,char *zone_name,char *domian_name,char * ip_addr, uint32_t ttl){
+    return domaindata_address_delete(db, zone_name, domian_name, TYPE_AAAA, ip_addr, ttl);
 }
 
 
@@ -430,7 +376,18 @@ int domaindata_update(struct  domain_store *db, struct domin_info_update* update
          if (update->action == DOMAN_ACTION_DEL){
             return domaindata_a_delete(db,update->zone_name,update->domain_name,update->host,update->ttl);
          }else if (update->action == DOMAN_ACTION_ADD){
-            return domaindata_a_insert(db,update->zone_name,update->domain_name,update->host,update->ttl,update->maxAnswer);
+            return domaindata_a_insert(db,update->zone_name,update->domain_name,update->host,update->ttl,update->maxAnswer,
+                update->weight);
+         }else{
+            log_msg(LOG_ERR,"err action\n");
+            return -2;
+         }
+     }else if (update->type == TYPE_AAAA){
+         if (update->action == DOMAN_ACTION_DEL){
+            return domaindata_aaaa_delete(db,update->zone_name,update->domain_name,update->host,update->ttl);
+         }else if (update->action == DOMAN_ACTION_ADD){
+            return domaindata_aaaa_insert(db,update->zone_name,update->domain_name,update->host,update->ttl,update->maxAnswer,
+                update->weight);
          }else{
             log_msg(LOG_ERR,"err action\n");
             return -2;
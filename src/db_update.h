@@ -13,6 +13,8 @@ enum db_action {
  DOMAN_ACTION_DEL 
 };
 
+struct update_track;
+
 typedef struct domin_info_update{
     enum db_action   action;
  	uint32_t         ttl;
@@ -21,12 +23,17 @@ typedef struct domin_info_update{
     uint16_t         weight;
     uint16_t         port;
     uint32_t         maxAnswer;
+    uint8_t          view_id;
     unsigned int     hashValue ; // hash check
+    /* tsc when the API received it, and the propagation state shared by the lcore copies */
+    uint64_t         tsc;
+    struct update_track *track;
     
     char  type_str[DB_MAX_NAME_LEN];
     char  zone_name[DB_MAX_NAME_LEN];
     char  domain_name[DB_MAX_NAME_LEN];
     char  host[DB_MAX_NAME_LEN];
+    char  view_name[DB_MAX_NAME_LEN];
     struct domin_info_update *next;  
 }domin_info_update_st;
 
@@ -38,7 +45,11 @@ int domaindata_srv_delete(struct  domain_store *db,char *zone_name,char *domian_
 uint16_t port, uint32_t ttl ,uint32_t maxAnswer);
 int domaindata_cname_insert(struct  domain_store *db,char *zone_name,char *domian_name, char * host, uint32_t ttl,uint32_t maxAnswer );
 int domaindata_cname_delete(struct  domain_store *db,char *zone_name,char *domian_name);
-int domaindata_a_insert(struct  domain_store *db,char *zone_name,char *domian_name, char * ip_addr, uint32_t ttl,uint32_t maxAnswer );
+int domaindata_a_insert(struct  domain_store *db,char *zone_name,char *domian_name, char * ip_addr, uint32_t ttl,uint32_t maxAnswer,
+uint16_t weight );
 int domaindata_a_delete(struct  domain_store *db,char *zone_name,char *domian_name,char * ip_addr, uint32_t ttl);
+int domaindata_aaaa_insert(struct  domain_store *db,char *zone_name,char *domian_name, char * ip_addr, uint32_t ttl,uint32_t maxAnswer,
+uint16_t weight );
+int domaindata_aaaa_delete(struct  domain_store *db,char *zone_name,char *domian_name,char * ip_addr, uint32_t ttl);
 
 #endif
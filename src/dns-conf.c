@@ -2,7 +2,10 @@
 #include <stdio.h>
 #include <string.h>
 #include <rte_cfgfile.h>
+#include <rte_common.h>
+#include <rte_ether.h>
 #include "dns-conf.h"
+#include "kdns.h"
 #include "util.h"
 
 #include "parser.h"
@@ -14,11 +17,32 @@
 struct dns_config *g_dns_cfg;
 
 
+/* MB over all sockets of a --socket-mem list */
+static int
+dpdk_mem_total(const char *socket_mem) {
+    char buf[128];
+    char *tokens[RTE_MAX_NUMA_NODES];
+    int i, num, total = 0;
+
+    snprintf(buf, sizeof(buf), "%s", socket_mem);
+    num = str_split(buf, ",", tokens, RTE_MAX_NUMA_NODES);
+    for (i = 0; i < num; i++) {
+        total += atoi(tokens[i]);
+    }
+    return total;
+}
+
 static void
 dpdk_config_init(struct rte_cfgfile *cfgfile, struct dpdk_config *cfg,
                  const char *proc_name) {
     const char *entry;
     char buffer[128];
+    int no_huge = 0;
+
+    entry = rte_cfgfile_get_entry(cfgfile, "EAL", "no-huge");
+    if (entry) {
+        no_huge = parser_read_arg_bool(entry) > 0;
+    }
 
     /* proc name */
     cfg->argv[cfg->argc++] = strdup(proc_name);
@@ -34,7 +58,12 @@ dpdk_config_init(struct rte_cfgfile *cfgfile, struct dpdk_config *cfg,
     }
 
     entry = rte_cfgfile_get_entry(cfgfile, "EAL", "memory");
-    if (entry) {
+    if (entry && no_huge) {
+        /* plain memory, e.g. for --bench on a box without hugepages */
+        snprintf(buffer, sizeof(buffer), "-m%d", dpdk_mem_total(entry));
+        cfg->argv[cfg->argc++] = strdup("--no-huge");
+        cfg->argv[cfg->argc++] = strdup(buffer);
+    } else if (entry) {
         snprintf(buffer, sizeof(buffer), "--socket-mem=%s", entry);
         cfg->argv[cfg->argc++] = strdup(buffer);
     } else {
@@ -57,6 +86,13 @@ dpdk_config_init(struct rte_cfgfile *cfgfile, struct dpdk_config *cfg,
         cfg->argv[cfg->argc++] = strdup(buffer);
     }
 
+    /* e.g. a bonded port: net_bonding0,mode=4,slave=0000:82:00.0,slave=0000:82:00.1 */
+    entry = rte_cfgfile_get_entry(cfgfile, "EAL", "vdev");
+    if (entry) {
+        snprintf(buffer, sizeof(buffer), "--vdev=%s", entry);
+        cfg->argv[cfg->argc++] = strdup(buffer);
+    }
+
     entry = rte_cfgfile_get_entry(cfgfile, "EAL", "log-level");
     if (entry) {
         snprintf(buffer, sizeof(buffer), "--log-level=%s", entry);
@@ -130,6 +166,25 @@ common_config_init(struct rte_cfgfile *cfgfile, struct comm_config *cfg){
         exit(-1); 
     }
 
+    entry = rte_cfgfile_get_entry(cfgfile, "COMMON", "index-freeze-delay");
+    if (entry) {
+        if (parser_read_uint32(&cfg->index_freeze_delay, entry) < 0) {
+            printf("Cannot read COMMON/index-freeze-delay = %s.\n", entry);
+            exit(-1);
+        }
+    }else{
+        cfg->index_freeze_delay = 1000;
+    }
+
+    cfg->edns_udp_size = 1232;
+    entry = rte_cfgfile_get_entry(cfgfile, "COMMON", "edns-udp-size");
+    if (entry && (parser_read_uint16(&cfg->edns_udp_size, entry) < 0 || (cfg->edns_udp_size != 0 &&
+            (cfg->edns_udp_size < UDP_MAX_MESSAGE_LEN || cfg->edns_udp_size > EDNS_MAX_MESSAGE_LEN)))) {
+        printf("Cannot read COMMON/edns-udp-size = %s, 0 or %d to %d.\n", entry,
+            UDP_MAX_MESSAGE_LEN, EDNS_MAX_MESSAGE_LEN);
+        exit(-1);
+    }
+
     entry = rte_cfgfile_get_entry(cfgfile, "COMMON", "zones");
     if (entry){
         cfg->zones = strdup(entry);
@@ -154,6 +209,29 @@ netdev_config_init(struct rte_cfgfile *cfgfile, struct netdev_config *cfg) {
         cfg->mode = strdup(entry);
     }
 
+    cfg->ports[0] = 0;
+    cfg->port_num = 1;
+    entry = rte_cfgfile_get_entry(cfgfile, "NETDEV", "ports");
+    if (entry) {
+        char buf[128];
+        char *tokens[NETDEV_MAX_PORTS + 1];
+        int i, num;
+
+        snprintf(buf, sizeof(buf), "%s", entry);
+        num = str_split(buf, ",", tokens, NETDEV_MAX_PORTS + 1);
+        if (num <= 0 || num > NETDEV_MAX_PORTS) {
+            printf("Cannot read NETDEV/ports = %s, 1 to %d ports.\n", entry, NETDEV_MAX_PORTS);
+            exit(-1);
+        }
+        for (i = 0; i < num; i++) {
+            if (parser_read_uint16(&cfg->ports[i], tokens[i]) < 0) {
+                printf("Cannot read NETDEV/ports = %s.\n", entry);
+                exit(-1);
+            }
+        }
+        cfg->port_num = num;
+    }
+
 
     entry = rte_cfgfile_get_entry(cfgfile, "NETDEV", "mbuf-num");
     if (entry && parser_read_uint16(&cfg->mbuf_num, entry) < 0) {
@@ -162,6 +240,11 @@ netdev_config_init(struct rte_cfgfile *cfgfile, struct netdev_config *cfg) {
     }
 
     
+    entry = rte_cfgfile_get_entry(cfgfile, "NETDEV", "exception-path");
+    if (entry) {
+        cfg->exception_path = strdup(entry);
+    }
+
     entry = rte_cfgfile_get_entry(cfgfile, "NETDEV", "kni-mbuf-num");
     if (entry && parser_read_uint16(&cfg->kni_mbuf_num, entry) < 0) {
         printf("Cannot read NETDEV/kni-mbuf-num = %s.\n", entry);
@@ -192,6 +275,39 @@ netdev_config_init(struct rte_cfgfile *cfgfile, struct netdev_config *cfg) {
         exit(-1);
     }
 
+    cfg->tx_drain_us = 100;
+    entry = rte_cfgfile_get_entry(cfgfile, "NETDEV", "tx-drain-us");
+    if (entry && parser_read_uint32(&cfg->tx_drain_us, entry) < 0) {
+        printf("Cannot read NETDEV/tx-drain-us = %s.\n", entry);
+        exit(-1);
+    }
+
+    entry = rte_cfgfile_get_entry(cfgfile, "NETDEV", "flow-steering");
+    if (entry) {
+        cfg->flow_steering = parser_read_arg_bool(entry) > 0;
+    }
+
+    cfg->mtu = 1500;
+    entry = rte_cfgfile_get_entry(cfgfile, "NETDEV", "mtu");
+    if (entry && (parser_read_uint16(&cfg->mtu, entry) < 0 || cfg->mtu < 576 || cfg->mtu > ETHER_MTU)) {
+        printf("Cannot read NETDEV/mtu = %s, 576 to %d.\n", entry, ETHER_MTU);
+        exit(-1);
+    }
+
+    cfg->frag_table_size = 4096;
+    entry = rte_cfgfile_get_entry(cfgfile, "NETDEV", "frag-table-size");
+    if (entry && parser_read_uint32(&cfg->frag_table_size, entry) < 0) {
+        printf("Cannot read NETDEV/frag-table-size = %s.\n", entry);
+        exit(-1);
+    }
+
+    cfg->frag_timeout_ms = 2000;
+    entry = rte_cfgfile_get_entry(cfgfile, "NETDEV", "frag-timeout-ms");
+    if (entry && (parser_read_uint32(&cfg->frag_timeout_ms, entry) < 0 || cfg->frag_timeout_ms == 0)) {
+        printf("Cannot read NETDEV/frag-timeout-ms = %s.\n", entry);
+        exit(-1);
+    }
+
     entry = rte_cfgfile_get_entry(cfgfile, "NETDEV", "kni-ipv4");
     if (entry) {
         if (parse_ipv4_addr(entry, (struct in_addr *)&cfg->kni_ip) < 0) {
@@ -213,6 +329,249 @@ netdev_config_init(struct rte_cfgfile *cfgfile, struct netdev_config *cfg) {
 }
 
 
+static void
+rrl_config_init(struct rte_cfgfile *cfgfile, struct rrl_config *cfg) {
+    const char *entry;
+
+    cfg->answer_rate = 0;
+    cfg->nxdomain_rate = 0;
+    cfg->fwd_rate = 0;
+    cfg->burst = 1;
+    cfg->slip = 2;
+    cfg->table_size = 16384;
+    cfg->ipv4_prefix_len = 24;
+    cfg->ipv6_prefix_len = 56;
+
+    entry = rte_cfgfile_get_entry(cfgfile, "RRL", "enable");
+    if (entry) {
+        cfg->enable = parser_read_arg_bool(entry) > 0;
+    }
+    if (!cfg->enable) {
+        return;
+    }
+
+    entry = rte_cfgfile_get_entry(cfgfile, "RRL", "answer-rate");
+    if (entry && parser_read_uint32(&cfg->answer_rate, entry) < 0) {
+        printf("Cannot read RRL/answer-rate = %s.\n", entry);
+        exit(-1);
+    }
+
+    entry = rte_cfgfile_get_entry(cfgfile, "RRL", "nxdomain-rate");
+    if (entry && parser_read_uint32(&cfg->nxdomain_rate, entry) < 0) {
+        printf("Cannot read RRL/nxdomain-rate = %s.\n", entry);
+        exit(-1);
+    }
+
+    entry = rte_cfgfile_get_entry(cfgfile, "RRL", "fwd-rate");
+    if (entry && parser_read_uint32(&cfg->fwd_rate, entry) < 0) {
+        printf("Cannot read RRL/fwd-rate = %s.\n", entry);
+        exit(-1);
+    }
+
+    entry = rte_cfgfile_get_entry(cfgfile, "RRL", "burst");
+    if (entry && (parser_read_uint32(&cfg->burst, entry) < 0 || cfg->burst == 0)) {
+        printf("Cannot read RRL/burst = %s.\n", entry);
+        exit(-1);
+    }
+
+    entry = rte_cfgfile_get_entry(cfgfile, "RRL", "slip");
+    if (entry && parser_read_uint32(&cfg->slip, entry) < 0) {
+        printf("Cannot read RRL/slip = %s.\n", entry);
+        exit(-1);
+    }
+
+    entry = rte_cfgfile_get_entry(cfgfile, "RRL", "table-size");
+    if (entry && (parser_read_uint32(&cfg->table_size, entry) < 0 ||
+            !rte_is_power_of_2(cfg->table_size) || cfg->table_size < 4)) {
+        printf("Cannot read RRL/table-size = %s, must be a power of 2 of at least 4.\n", entry);
+        exit(-1);
+    }
+
+    entry = rte_cfgfile_get_entry(cfgfile, "RRL", "ipv4-prefix-len");
+    if (entry && (parser_read_uint8(&cfg->ipv4_prefix_len, entry) < 0 || cfg->ipv4_prefix_len > 32)) {
+        printf("Cannot read RRL/ipv4-prefix-len = %s.\n", entry);
+        exit(-1);
+    }
+
+    entry = rte_cfgfile_get_entry(cfgfile, "RRL", "ipv6-prefix-len");
+    if (entry && (parser_read_uint8(&cfg->ipv6_prefix_len, entry) < 0 || cfg->ipv6_prefix_len > 128)) {
+        printf("Cannot read RRL/ipv6-prefix-len = %s.\n", entry);
+        exit(-1);
+    }
+}
+
+
+static void
+idle_config_init(struct rte_cfgfile *cfgfile, struct idle_config *cfg) {
+    const char *entry;
+
+    cfg->pause_polls = 64;
+    cfg->scale_us = 1000;
+    cfg->sleep_us = 10000;
+    cfg->sleep_max_ms = 1;
+    cfg->rx_intr = 1;
+
+    entry = rte_cfgfile_get_entry(cfgfile, "IDLE", "enable");
+    if (entry) {
+        cfg->enable = parser_read_arg_bool(entry) > 0;
+    }
+    if (!cfg->enable) {
+        return;
+    }
+
+    entry = rte_cfgfile_get_entry(cfgfile, "IDLE", "pause-polls");
+    if (entry && parser_read_uint32(&cfg->pause_polls, entry) < 0) {
+        printf("Cannot read IDLE/pause-polls = %s.\n", entry);
+        exit(-1);
+    }
+
+    entry = rte_cfgfile_get_entry(cfgfile, "IDLE", "scale-us");
+    if (entry && parser_read_uint32(&cfg->scale_us, entry) < 0) {
+        printf("Cannot read IDLE/scale-us = %s.\n", entry);
+        exit(-1);
+    }
+
+    entry = rte_cfgfile_get_entry(cfgfile, "IDLE", "sleep-us");
+    if (entry && parser_read_uint32(&cfg->sleep_us, entry) < 0) {
+        printf("Cannot read IDLE/sleep-us = %s.\n", entry);
+        exit(-1);
+    }
+
+    entry = rte_cfgfile_get_entry(cfgfile, "IDLE", "sleep-max-ms");
+    if (entry && (parser_read_uint32(&cfg->sleep_max_ms, entry) < 0 ||
+            cfg->sleep_max_ms == 0 || cfg->sleep_max_ms > 1000)) {
+        printf("Cannot read IDLE/sleep-max-ms = %s, 1 to 1000.\n", entry);
+        exit(-1);
+    }
+
+    entry = rte_cfgfile_get_entry(cfgfile, "IDLE", "rx-intr");
+    if (entry) {
+        cfg->rx_intr = parser_read_arg_bool(entry) > 0;
+    }
+}
+
+
+static void
+service_cpu_read(struct rte_cfgfile *cfgfile, const char *name, int *cpu) {
+    const char *entry = rte_cfgfile_get_entry(cfgfile, "SERVICE", name);
+    uint16_t v;
+
+    *cpu = -1;
+    if (entry == NULL || strcmp(entry, "master") == 0) {
+        return;
+    }
+    if (parser_read_uint16(&v, entry) < 0 || v >= RTE_MAX_LCORE) {
+        printf("Cannot read SERVICE/%s = %s, a cpu id or master.\n", name, entry);
+        exit(-1);
+    }
+    *cpu = v;
+}
+
+static void
+service_config_init(struct rte_cfgfile *cfgfile, struct service_config *cfg) {
+    const char *entry;
+
+    cfg->kni_budget = 256;
+    cfg->update_budget = 64;
+
+    service_cpu_read(cfgfile, "kni-cpu", &cfg->kni_cpu);
+    service_cpu_read(cfgfile, "update-cpu", &cfg->update_cpu);
+
+    entry = rte_cfgfile_get_entry(cfgfile, "SERVICE", "kni-budget");
+    if (entry && (parser_read_uint32(&cfg->kni_budget, entry) < 0 || cfg->kni_budget == 0)) {
+        printf("Cannot read SERVICE/kni-budget = %s.\n", entry);
+        exit(-1);
+    }
+
+    entry = rte_cfgfile_get_entry(cfgfile, "SERVICE", "update-budget");
+    if (entry && (parser_read_uint32(&cfg->update_budget, entry) < 0 || cfg->update_budget == 0)) {
+        printf("Cannot read SERVICE/update-budget = %s.\n", entry);
+        exit(-1);
+    }
+}
+
+
+static void
+bench_config_init(struct rte_cfgfile *cfgfile, struct bench_config *cfg) {
+    const char *entry;
+
+    cfg->names = 100000;
+    cfg->ips_per_name = 1;
+    cfg->srv_percent = 0;
+    cfg->srv_targets = 2;
+    cfg->warmup = 2;
+    cfg->duration = 10;
+
+    entry = rte_cfgfile_get_entry(cfgfile, "BENCH", "trace");
+    if (entry) {
+        cfg->trace = strdup(entry);
+    }
+    entry = rte_cfgfile_get_entry(cfgfile, "BENCH", "zone");
+    if (entry) {
+        cfg->zone = strdup(entry);
+    }
+    entry = rte_cfgfile_get_entry(cfgfile, "BENCH", "names");
+    if (entry && (parser_read_uint32(&cfg->names, entry) < 0 || cfg->names == 0)) {
+        printf("Cannot read BENCH/names = %s.\n", entry);
+        exit(-1);
+    }
+    entry = rte_cfgfile_get_entry(cfgfile, "BENCH", "ips-per-name");
+    if (entry && (parser_read_uint32(&cfg->ips_per_name, entry) < 0 || cfg->ips_per_name == 0)) {
+        printf("Cannot read BENCH/ips-per-name = %s.\n", entry);
+        exit(-1);
+    }
+    entry = rte_cfgfile_get_entry(cfgfile, "BENCH", "srv-percent");
+    if (entry && (parser_read_uint32(&cfg->srv_percent, entry) < 0 || cfg->srv_percent > 100)) {
+        printf("Cannot read BENCH/srv-percent = %s.\n", entry);
+        exit(-1);
+    }
+    entry = rte_cfgfile_get_entry(cfgfile, "BENCH", "srv-targets");
+    if (entry && (parser_read_uint32(&cfg->srv_targets, entry) < 0 || cfg->srv_targets == 0)) {
+        printf("Cannot read BENCH/srv-targets = %s.\n", entry);
+        exit(-1);
+    }
+    entry = rte_cfgfile_get_entry(cfgfile, "BENCH", "warmup");
+    if (entry && parser_read_uint32(&cfg->warmup, entry) < 0) {
+        printf("Cannot read BENCH/warmup = %s.\n", entry);
+        exit(-1);
+    }
+    entry = rte_cfgfile_get_entry(cfgfile, "BENCH", "duration");
+    if (entry && (parser_read_uint32(&cfg->duration, entry) < 0 || cfg->duration == 0)) {
+        printf("Cannot read BENCH/duration = %s.\n", entry);
+        exit(-1);
+    }
+}
+
+
+static void
+view_config_init(struct rte_cfgfile *cfgfile, struct view_config *cfg) {
+    struct rte_cfgfile_entry entries[MAX_VIEWS];
+    int num, i;
+
+    cfg->view_num = 1;
+    snprintf(cfg->names[0], VIEW_NAME_LEN, "default");
+    if (!rte_cfgfile_has_section(cfgfile, "VIEW")) {
+        return;
+    }
+
+    num = rte_cfgfile_section_num_entries(cfgfile, "VIEW");
+    if (num >= MAX_VIEWS) {
+        printf("Too many VIEW entries %d, max %d.\n", num, MAX_VIEWS - 1);
+        exit(-1);
+    }
+    num = rte_cfgfile_section_entries(cfgfile, "VIEW", entries, num);
+    for (i = 0; i < num; i++) {
+        if (strlen(entries[i].name) >= VIEW_NAME_LEN || strcmp(entries[i].name, "default") == 0) {
+            printf("Invalid VIEW name %s.\n", entries[i].name);
+            exit(-1);
+        }
+        snprintf(cfg->names[cfg->view_num], VIEW_NAME_LEN, "%s", entries[i].name);
+        cfg->prefixes[cfg->view_num] = strdup(entries[i].value);
+        cfg->view_num++;
+    }
+}
+
+
 void
 config_file_load( char *cfgfile_path, char *proc_name) {
     struct rte_cfgfile *cfgfile;
@@ -233,6 +592,11 @@ config_file_load( char *cfgfile_path, char *proc_name) {
     dpdk_config_init(cfgfile, &g_dns_cfg->dpdk, proc_name);
     netdev_config_init(cfgfile, &g_dns_cfg->netdev);
     common_config_init(cfgfile, &g_dns_cfg->comm);
+    rrl_config_init(cfgfile, &g_dns_cfg->rrl);
+    idle_config_init(cfgfile, &g_dns_cfg->idle);
+    service_config_init(cfgfile, &g_dns_cfg->service);
+    view_config_init(cfgfile, &g_dns_cfg->view);
+    bench_config_init(cfgfile, &g_dns_cfg->bench);
 }
 
 
@@ -2,9 +2,12 @@
 #define __DNSCONF_H__
 
 #include <stdint.h>
+#include "view_def.h"
 
 #define DPDK_ARG_MAX_NUM 32
 #define PATH_LENGTH 256
+#define VIEW_NAME_LEN   64
+#define NETDEV_MAX_PORTS    4
 
 
 struct dpdk_config {
@@ -22,18 +25,28 @@ struct comm_config {
      char *key_pem_file;
      char *cert_pem_file;
      uint16_t    web_port;
+     uint32_t    index_freeze_delay;   /* ms after the first name change before the index is rebuilt, 0 off */
+     uint16_t    edns_udp_size;        /* largest UDP answer to EDNS clients, 0 no EDNS */
 };
 
 
 struct netdev_config {
     char *name_prefix;
     char * mode;
+    uint16_t ports[NETDEV_MAX_PORTS];   /* dpdk port ids, a bonded device counts as one port */
+    uint16_t port_num;
     uint16_t mbuf_num;
     uint16_t rxq_desc_num;
     uint16_t txq_desc_num;
     uint16_t rxq_num;
     uint16_t txq_num;
+    uint32_t tx_drain_us;   /* longest wait of a partial tx burst */
+    int      flow_steering; /* rte_flow rules split DNS and exception traffic, rss mode only */
+    uint16_t mtu;           /* longer answers are sent as IP fragments */
+    uint32_t frag_table_size;   /* datagrams in reassembly per lcore, 0 drops fragments */
+    uint32_t frag_timeout_ms;   /* how long the fragments of a datagram are kept */
     
+    char *exception_path;   /* kni, tap or virtio-user */
     uint16_t kni_mbuf_num;
     uint32_t kni_ip;
     char *    kni_vip;
@@ -42,10 +55,65 @@ struct netdev_config {
 
 
 
+struct rrl_config {
+    int      enable;
+    uint32_t answer_rate;   /* responses per second per prefix, 0 means no limit */
+    uint32_t nxdomain_rate;
+    uint32_t fwd_rate;
+    uint32_t burst;         /* bucket depth in seconds of rate */
+    uint32_t slip;          /* every Nth limited response is sent truncated, 0 never */
+    uint32_t table_size;    /* buckets per lcore in sets of 4, power of 2 */
+    uint8_t  ipv4_prefix_len;
+    uint8_t  ipv6_prefix_len;
+};
+
+/* adaptive polling of the lcores */
+struct idle_config {
+    int      enable;
+    uint32_t pause_polls;   /* empty polls before rte_pause between the polls */
+    uint32_t scale_us;      /* idle time before the lowest frequency, 0 never */
+    uint32_t sleep_us;      /* idle time before sleeping, 0 never */
+    uint32_t sleep_max_ms;  /* longest sleep, the delay of forwarded answers and updates */
+    int      rx_intr;       /* sleep on rx interrupts, else on a timer */
+};
+
+/* the work of the master: exception path and update fan-out */
+struct service_config {
+    int      kni_cpu;           /* cpu of its own thread, -1 on the master loop */
+    int      update_cpu;
+    uint32_t kni_budget;        /* packets per run */
+    uint32_t update_budget;     /* updates per run */
+};
+
+/* view 0 is the default view, configured views start from 1 */
+struct view_config {
+    uint8_t view_num;
+    char    names[MAX_VIEWS][VIEW_NAME_LEN];
+    char   *prefixes[MAX_VIEWS];   /* comma separated ipv4 prefixes */
+};
+
+/* offline benchmark, run with --bench */
+struct bench_config {
+    int      enable;
+    char    *trace;         /* pcap of queries, generated from the names if not set */
+    char    *zone;          /* zone of the synthetic names, the first COMMON/zones by default */
+    uint32_t names;
+    uint32_t ips_per_name;
+    uint32_t srv_percent;   /* share of the names that are SRV names */
+    uint32_t srv_targets;   /* SRV records per SRV name */
+    uint32_t warmup;        /* seconds before measuring */
+    uint32_t duration;      /* seconds measured */
+};
+
 struct dns_config {
     struct dpdk_config dpdk;
     struct comm_config comm;
     struct netdev_config netdev;
+    struct rrl_config rrl;
+    struct idle_config idle;
+    struct service_config service;
+    struct view_config view;
+    struct bench_config bench;
 };
 
 extern struct dns_config *g_dns_cfg;
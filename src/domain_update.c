@@ -6,12 +6,22 @@
 #include <netinet/in.h>
 #include <rte_ring.h>
 #include <rte_rwlock.h>
+#include <rte_cycles.h>
+#include <rte_ethdev.h>
+#include <rte_lcore.h>
 
 #include "webserver.h"
 #include "db_update.h"
 #include "domain_update.h"
 #include "util.h"
 #include "netdev.h"
+#include "view.h"
+#include "kdns-adap.h"
+#include "dns-conf.h"
+#include "slab.h"
+#include "lat_hist.h"
+#include "idle.h"
+#include "service.h"
 
 
 #define DOMAIN_HASH_SIZE  0x3FFFF
@@ -37,6 +47,45 @@ static rte_rwlock_t domian_list_lock;
 
 unsigned master_lcore = CORE_ID_ERR;
 
+/* shared by the lcore copies of one update, the last lcore to apply it frees it */
+struct update_track {
+    uint64_t tsc;
+    uint32_t pending;
+    uint8_t  failed;
+};
+
+/*
+ * Propagation of the updates, in microseconds from the API: dispatched by the
+ * master, applied on each lcore and applied on every lcore. Each histogram but
+ * "all" has a single writer.
+ */
+static struct update_stats {
+    uint64_t received;
+    struct lat_hist master;
+    struct lat_hist all;
+    struct lat_hist lcore[MAX_CORES];
+    /* high-water mark of the msg ring of each lcore, master included */
+    uint32_t ring_hwm[MAX_CORES];
+} upd_stats;
+
+static inline uint64_t tsc_to_us(uint64_t cycles) {
+    return cycles * 1000000 / rte_get_tsc_hz();
+}
+
+static inline void ring_hwm_update(unsigned lcore_id) {
+    uint32_t depth = rte_ring_count(domian_msg_ring[lcore_id]);
+    if (depth > upd_stats.ring_hwm[lcore_id])
+        upd_stats.ring_hwm[lcore_id] = depth;
+}
+
+static void update_track_put(struct update_track *track, uint64_t now) {
+    if (__sync_sub_and_fetch(&track->pending, 1) == 0) {
+        if (!track->failed)
+            lat_hist_add_shared(&upd_stats.all, tsc_to_us(now - track->tsc));
+        free(track);
+    }
+}
+
 static inline unsigned get_master_lcore_id(void){
     if (master_lcore == CORE_ID_ERR)
         master_lcore = rte_get_master_lcore();
@@ -54,10 +103,13 @@ static inline struct domin_info_update * msg_copy(struct domin_info_update *src)
     dst->weight  = src->weight;
     dst->port    = src->port;
     dst->maxAnswer = src->maxAnswer;
+    dst->view_id = src->view_id;
+    dst->tsc = src->tsc;
 
     memcpy(dst->zone_name,src->zone_name,DB_MAX_NAME_LEN);
     memcpy(dst->host,src->host,DB_MAX_NAME_LEN);
     memcpy(dst->domain_name,src->domain_name,DB_MAX_NAME_LEN);
+    memcpy(dst->view_name,src->view_name,DB_MAX_NAME_LEN);
     return dst;  
 }
 
@@ -101,7 +153,9 @@ static void domain_list_ops(struct domin_info_update *msg,unsigned int hashValue
         if (find->hashValue == hashValue &&
             strcmp(find->domain_name,msg->domain_name)==0&&
             strcmp(find->zone_name,msg->zone_name)==0&&
-            strcmp(find->host,msg->host)==0){
+            strcmp(find->host,msg->host)==0&&
+            find->type == msg->type &&
+            find->view_id == msg->view_id){
             break;
         }
         pre = find;
@@ -116,6 +170,9 @@ static void domain_list_ops(struct domin_info_update *msg,unsigned int hashValue
             msg->hashValue = hashValue;
            
         }else{
+            /* the stores take the new weight of an address posted again */
+            if (msg->type == TYPE_A || msg->type == TYPE_AAAA)
+                find->weight = msg->weight;
             free(msg);
         }
     }else {
@@ -162,13 +219,19 @@ void domain_msg_ring_create(void){
 }
 
 
-void doman_msg_master_process(void){
+/* the update service: fan out at most budget updates, returns how many */
+uint32_t doman_msg_master_process(uint32_t budget){
     
     struct domin_info_update *msg;   
+    struct update_track *track;
     unsigned cid_master = get_master_lcore_id();
     unsigned idx =0;
-    
-    while (0 == rte_ring_dequeue(domian_msg_ring[cid_master], (void **)&msg)) {
+    uint32_t done = 0;
+    uint64_t now;
+
+    ring_hwm_update(cid_master);
+    while (done < budget && 0 == rte_ring_dequeue(domian_msg_ring[cid_master], (void **)&msg)) {
+        done++;
         
         if (g_domain_num > EXTRA_DOMAIN_NUMBERS - 100){
             log_msg(LOG_ERR,"domain len reach threadHold(%d): domian(%s) host(%s) \n", EXTRA_DOMAIN_NUMBERS,
@@ -176,6 +239,20 @@ void doman_msg_master_process(void){
             free(msg);
             continue;
          }
+        now = rte_rdtsc();
+        lat_hist_add(&upd_stats.master, tsc_to_us(now - msg->tsc));
+
+        /* the lcores may apply it before the last copy is queued, count them first */
+        track = calloc(1, sizeof(struct update_track));
+        assert(track);
+        track->tsc = msg->tsc;
+        for(idx =0; idx < MAX_CORES; idx ++){
+            if (domian_msg_ring[idx] != NULL && idx != cid_master)
+                track->pending++;
+        }
+        if (track->pending == 0)
+            free(track);
+
         //dispatch the msg
         for(idx =0; idx < MAX_CORES; idx ++){
 
@@ -184,6 +261,7 @@ void doman_msg_master_process(void){
                 continue;
             }
             struct domin_info_update * new_msg = msg_copy(msg);
+            new_msg->track = track;
             int res = rte_ring_enqueue(domian_msg_ring[idx], (void *)new_msg);
 
             if (unlikely(-EDQUOT == res)) {
@@ -195,6 +273,10 @@ void doman_msg_master_process(void){
                 log_msg(LOG_ERR,"unkown error %d for rte_ring_enqueue lcore %d\n", res,idx);
                 free(new_msg);
            }
+           if (unlikely(res && res != -EDQUOT)) {
+                track->failed = 1;
+                update_track_put(track, now);
+           }
              
         }
         // last we free the msg     
@@ -203,15 +285,40 @@ void doman_msg_master_process(void){
       
         domain_info_store(msg); 
     }   
+    return done;
 }
 
 void doman_msg_slave_process(void){
+    static uint64_t first_update[MAX_CORES];
+    static uint8_t  index_changed[MAX_CORES];
     struct domin_info_update *msg;   
     unsigned cid = rte_lcore_id();    
+    uint64_t now;
+
+    // the stores must not change while the freeze thread reads them
+    if (kdns_index_freeze_busy(cid)) {
+        return;
+    }
+    ring_hwm_update(cid);
     while (0 == rte_ring_dequeue(domian_msg_ring[cid], (void **)&msg)) {   
-        domaindata_update(dpdk_dns[cid].db,msg);
+        domaindata_update(kdns_view_db_get(&dpdk_dns[cid], msg->view_id),msg);
+        now = rte_rdtsc();
+        if (!index_changed[cid]) {
+            first_update[cid] = now;
+            index_changed[cid] = 1;
+        }
+        lat_hist_add(&upd_stats.lcore[cid], tsc_to_us(now - msg->tsc));
+        update_track_put(msg->track, now);
         free(msg); 
     }   
+
+    // rebuild the frozen index a while after the first change, even under steady updates
+    if (unlikely(index_changed[cid]) && g_dns_cfg->comm.index_freeze_delay &&
+            rte_rdtsc() - first_update[cid] > rte_get_tsc_hz() / 1000 * g_dns_cfg->comm.index_freeze_delay) {
+        if (kdns_index_freeze_start(cid) == 0) {
+            index_changed[cid] = 0;
+        }
+    }
 }
 
 static void send_domain_msg_to_master(struct domin_info_update *msg){ 
@@ -240,6 +347,36 @@ static inline int ipv4_address_check(const char *str)
     return inet_pton(AF_INET, str, &addr);  
 }
 
+/* rewrite an ipv6 address in its canonical text form, so that the master
+   index sees one spelling per address. <= 0 if it is not an ipv6 address */
+static inline int ipv6_address_canon(const char *str, char *canon, size_t len)
+{
+    struct in6_addr addr;
+    int ret = inet_pton(AF_INET6, str, &addr);
+
+    if (ret > 0 && inet_ntop(AF_INET6, &addr, canon, len) == NULL)
+        return -1;
+    return ret;
+}
+
+
+/* a wildcard is only allowed as the whole leftmost label, "*.svc.example.com" */
+static inline int domain_name_check(const char *str)
+{
+    const char *p = strchr(str, '*');
+    if (p == NULL){
+        return 1;
+    }
+    return p == str && str[1] == '.' && strchr(p + 1, '*') == NULL;
+}
+
+/* weight, priority and port are 16 bits on the wire */
+static inline int json_u16_check(json_t *json_key)
+{
+    json_int_t v = json_integer_value(json_key);
+    return v >= 0 && v <= UINT16_MAX;
+}
+
 
 static void* domaindata_parse(enum db_action   action,struct connection_info_struct *con_info , int * len_response)
 {
@@ -256,6 +393,7 @@ static void* domaindata_parse(enum db_action   action,struct connection_info_str
 
    struct domin_info_update *update = calloc(1,sizeof(struct domin_info_update));
    update->action = action;
+   update->tsc = rte_rdtsc();
     /* parse json object */
     json_error_t jerror;
     const char * value ;
@@ -289,8 +427,28 @@ static void* domaindata_parse(enum db_action   action,struct connection_info_str
         goto parse_err;
     }
     value = json_string_value(json_key);
+    if (!domain_name_check(value)){
+        log_msg(LOG_ERR,"domainName %s has an invalid wildcard!", value);
+        json_decref(json_response);
+        goto parse_err;
+    }
     snprintf(update->domain_name, strlen(value)+1, "%s", value);
 
+    /* get view name, records without it belong to the default view */
+    json_key = json_object_get(json_response, "view");
+    if (!json_key || !json_is_string(json_key))  {
+        update->view_id = VIEW_ID_DEFAULT;
+    }else{
+        value = json_string_value(json_key);
+        update->view_id = view_id_get(value);
+        if (update->view_id == VIEW_ID_ERR){
+            log_msg(LOG_ERR,"view %s not configured!", value);
+            json_decref(json_response);
+            goto parse_err;
+        }
+    }
+    snprintf(update->view_name, DB_MAX_NAME_LEN, "%s", view_name_get(update->view_id));
+
      /* get ttl  */
     json_key = json_object_get(json_response, "ttl");
     if (!json_key || !json_is_integer(json_key))  {
@@ -318,6 +476,8 @@ static void* domaindata_parse(enum db_action   action,struct connection_info_str
     snprintf(update->type_str, strlen(value)+1, "%s", value);
     if (strcmp(update->type_str, "A") == 0) {
         update->type = TYPE_A;
+    }else if (strcmp(update->type_str, "AAAA") == 0) {
+        update->type = TYPE_AAAA;
     }else if (strcmp(update->type_str, "CNAME") == 0) {
         update->type = TYPE_CNAME;
     }else if (strcmp(update->type_str, "SRV") == 0) {
@@ -342,6 +502,43 @@ static void* domaindata_parse(enum db_action   action,struct connection_info_str
                goto parse_err;
            }
            snprintf(update->host, strlen(value)+1, "%s", value);     
+
+           /* get weight, optional  */
+           json_key = json_object_get(json_response, "weight");
+           if (json_key && json_is_integer(json_key))  {
+               if (!json_u16_check(json_key)) {
+                   log_msg(LOG_ERR,"weight is not in 0..65535!");
+                   json_decref(json_response);
+                   goto parse_err;
+               }
+               update->weight = json_integer_value(json_key);
+           }
+    }
+    if (update->type == TYPE_AAAA){
+        /* get ipv6 addr  */
+           json_key = json_object_get(json_response, "host");
+           if (!json_key || !json_is_string(json_key))  {
+               log_msg(LOG_ERR,"host does not exist or is not string!");
+               json_decref(json_response);
+               goto parse_err;
+           }
+           value = json_string_value(json_key);
+           if (ipv6_address_canon(value, update->host, sizeof(update->host)) <= 0){
+               log_msg(LOG_ERR,"host is not an ipv6 addr\n!");
+               json_decref(json_response);
+               goto parse_err;
+           }
+
+           /* get weight, optional  */
+           json_key = json_object_get(json_response, "weight");
+           if (json_key && json_is_integer(json_key))  {
+               if (!json_u16_check(json_key)) {
+                   log_msg(LOG_ERR,"weight is not in 0..65535!");
+                   json_decref(json_response);
+                   goto parse_err;
+               }
+               update->weight = json_integer_value(json_key);
+           }
     }
     if (update->type == TYPE_CNAME){
         /* get host */
@@ -368,8 +565,8 @@ static void* domaindata_parse(enum db_action   action,struct connection_info_str
 
          /* get priority  */
         json_key = json_object_get(json_response, "priority");
-        if (!json_key || !json_is_integer(json_key))  {
-            log_msg(LOG_ERR,"priority does not exist or is not int!");
+        if (!json_key || !json_is_integer(json_key) || !json_u16_check(json_key))  {
+            log_msg(LOG_ERR,"priority does not exist or is not in 0..65535!");
             json_decref(json_response);
             goto parse_err;
         }
@@ -377,8 +574,8 @@ static void* domaindata_parse(enum db_action   action,struct connection_info_str
 
          /* get priority  */
         json_key = json_object_get(json_response, "weight");
-        if (!json_key || !json_is_integer(json_key))  {
-            log_msg(LOG_ERR,"weight does not exist or is not int!");
+        if (!json_key || !json_is_integer(json_key) || !json_u16_check(json_key))  {
+            log_msg(LOG_ERR,"weight does not exist or is not in 0..65535!");
             json_decref(json_response);
             goto parse_err;
         }
@@ -386,8 +583,8 @@ static void* domaindata_parse(enum db_action   action,struct connection_info_str
 
          /* get priority  */
         json_key = json_object_get(json_response, "port");
-        if (!json_key || !json_is_integer(json_key))  {
-            log_msg(LOG_ERR,"port does not exist or is not int!");
+        if (!json_key || !json_is_integer(json_key) || !json_u16_check(json_key))  {
+            log_msg(LOG_ERR,"port does not exist or is not in 0..65535!");
             json_decref(json_response);
             goto parse_err;
         }
@@ -395,6 +592,7 @@ static void* domaindata_parse(enum db_action   action,struct connection_info_str
        
     } 
 
+    __sync_fetch_and_add(&upd_stats.received, 1);
     send_domain_msg_to_master(update);
     
     json_decref(json_response);
@@ -440,17 +638,19 @@ static void* domains_get( __attribute__((unused)) struct connection_info_struct
         while(domain_info){
             switch (domain_info->type){
                 case TYPE_A:
-                    value = json_pack("{s:s, s:s, s:s, s:s, s:i, s:i}", "type","A",
+                case TYPE_AAAA:
+                    value = json_pack("{s:s, s:s, s:s, s:s, s:s, s:i, s:i, s:i}", "type", domain_info->type == TYPE_A ? "A" : "AAAA",
+                    "view", domain_info->view_name,
                     "domainName", domain_info->domain_name, "host", domain_info->host, "zoneName", domain_info->zone_name,
-                    "ttl", domain_info->ttl,"maxAnswer", domain_info->maxAnswer);
+                    "ttl", domain_info->ttl,"maxAnswer", domain_info->maxAnswer, "weight", domain_info->weight);
                     break;    
                  case TYPE_CNAME:
-                    value = json_pack("{s:s, s:s, s:s, s:s, s:i, s:i}", "type","CNAME",
+                    value = json_pack("{s:s, s:s, s:s, s:s, s:s, s:i, s:i}", "type","CNAME", "view", domain_info->view_name,
                     "domainName", domain_info->domain_name, "host", domain_info->host, "zoneName", domain_info->zone_name,
                     "ttl", domain_info->ttl,"maxAnswer", domain_info->maxAnswer);
                     break;
                  case TYPE_SRV:
-                    value = json_pack("{s:s, s:s, s:s, s:s, s:i, s:i, s:i, s:i, s:i}", "type","SRV",
+                    value = json_pack("{s:s, s:s, s:s, s:s, s:s, s:i, s:i, s:i, s:i, s:i}", "type","SRV", "view", domain_info->view_name,
                     "domainName", domain_info->domain_name, "host", domain_info->host, "zoneName", domain_info->zone_name,
                     "ttl", domain_info->ttl, "priority", domain_info->prio, "weight", domain_info->weight, "port", domain_info->port,
                     "maxAnswer", domain_info->maxAnswer);
@@ -512,17 +712,19 @@ static void* domain_get( __attribute__((unused)) struct connection_info_struct *
             strcmp(domain_info->domain_name,domain)==0){
               switch (domain_info->type){
                 case TYPE_A:
-                    value = json_pack("{s:s, s:s, s:s, s:s, s:i}", "type","A",
+                case TYPE_AAAA:
+                    value = json_pack("{s:s, s:s, s:s, s:s, s:s, s:i, s:i}", "type", domain_info->type == TYPE_A ? "A" : "AAAA",
+                    "view", domain_info->view_name,
                     "domainName", domain_info->domain_name, "host", domain_info->host, "zoneName", domain_info->zone_name,
-                    "ttl", domain_info->ttl);
+                    "ttl", domain_info->ttl, "weight", domain_info->weight);
                     break;    
                  case TYPE_CNAME:
-                    value = json_pack("{s:s, s:s, s:s, s:s, s:i}", "type","CNAME",
+                    value = json_pack("{s:s, s:s, s:s, s:s, s:s, s:i}", "type","CNAME", "view", domain_info->view_name,
                     "domainName", domain_info->domain_name, "host", domain_info->host, "zoneName", domain_info->zone_name,
                     "ttl", domain_info->ttl);
                     break;
                  case TYPE_SRV:
-                    value = json_pack("{s:s, s:s, s:s, s:s, s:i, s:i, s:i, s:i}", "type","SRV",
+                    value = json_pack("{s:s, s:s, s:s, s:s, s:s, s:i, s:i, s:i, s:i}", "type","SRV", "view", domain_info->view_name,
                     "domainName", domain_info->domain_name, "host", domain_info->host, "zoneName", domain_info->zone_name,
                     "ttl", domain_info->ttl, "priority", domain_info->prio, "weight", domain_info->weight, "port", domain_info->port);
                     break;
@@ -586,23 +788,150 @@ struct json_stats_strings
     char  pkts_2kni[32]; 
     char  pkts_icmp[32]; 
     char dns_pkts_rcv[32]; 
+    char dns6_pkts_rcv[32];
     char dns_pkts_snd[32]; 
     char dns_lens_rcv[32]; 
     char dns_lens_snd[32];
     char pkt_dropped[32];
-    char pkt_len_err[32];      
+    char pkt_len_err[32];
+    char pkt_tx_full[32];
+    char rrl_answer_limited[32];
+    char rrl_nxdomain_limited[32];
+    char rrl_fwd_limited[32];
+    char rrl_dropped[32];
+    char rrl_slipped[32];
+    char rrl_evicted[32];
+    char frag_rcv[32];
+    char frag_reassembled[32];
+    char frag_dropped[32];
+    char frag_snd[32];
+    char frag_snd_err[32];
 };
 
+/* hardware counters of each port and the counters of each lcore queue on it */
+static json_t *port_stats_json(void)
+{
+    json_t *ports = json_array();
+    struct rte_eth_stats hw;
+    unsigned lcore_id;
+    uint16_t i;
+
+    for (i = 0; i < kdns_net_device_num; i++) {
+        struct net_device *dev = &kdns_net_device[i];
+        json_t *queues = json_array();
+
+        RTE_LCORE_FOREACH_SLAVE(lcore_id) {
+            struct netif_queue_conf *conf = &dev->l_netif_queue_conf[lcore_id];
+            json_array_append_new(queues, json_pack("{s:i, s:i, s:i, s:I, s:I, s:I, s:I, s:I, s:I, s:I, s:I, s:I}",
+                "lcore", lcore_id, "rxq", conf->rx_queue_id, "txq", conf->tx_queue_id,
+                "pkts_rcv", (json_int_t)conf->stats.pkts_rcv, "pkts_2kni", (json_int_t)conf->stats.pkts_2kni,
+                "dns_pkts_rcv", (json_int_t)conf->stats.dns_pkts_rcv, "dns6_pkts_rcv", (json_int_t)conf->stats.dns6_pkts_rcv, "dns_pkts_snd", (json_int_t)conf->stats.dns_pkts_snd,
+                "dns_lens_snd", (json_int_t)conf->stats.dns_lens_snd, "pkt_dropped", (json_int_t)conf->stats.pkt_dropped,
+                "pkt_len_err", (json_int_t)conf->stats.pkt_len_err, "pkt_tx_full", (json_int_t)conf->stats.pkt_tx_full));
+        }
+
+        memset(&hw, 0, sizeof(hw));
+        rte_eth_stats_get(dev->port_id, &hw);
+        json_array_append_new(ports, json_pack("{s:i, s:I, s:I, s:I, s:I, s:I, s:I, s:b, s:I, s:I, s:o}",
+            "port", dev->port_id, "ipackets", (json_int_t)hw.ipackets, "opackets", (json_int_t)hw.opackets,
+            "imissed", (json_int_t)hw.imissed, "ierrors", (json_int_t)hw.ierrors,
+            "oerrors", (json_int_t)hw.oerrors, "rx_nombuf", (json_int_t)hw.rx_nombuf,
+            "flow_steering", dev->flow_steering, "exception_rcv", (json_int_t)dev->exception_conf.stats.pkts_rcv,
+            "exception_2kni", (json_int_t)dev->exception_conf.stats.pkts_2kni, "queues", queues));
+    }
+    return ports;
+}
+
+static json_t *lat_hist_json(const struct lat_hist *h)
+{
+    return json_pack("{s:I, s:I, s:I, s:I, s:I, s:I}", "count", (json_int_t)h->count,
+        "p50_us", (json_int_t)lat_hist_quantile(h, 0.5), "p90_us", (json_int_t)lat_hist_quantile(h, 0.9),
+        "p99_us", (json_int_t)lat_hist_quantile(h, 0.99), "p999_us", (json_int_t)lat_hist_quantile(h, 0.999),
+        "max_us", (json_int_t)h->max);
+}
+
+/* update propagation: latency of each stage and depth of the msg rings */
+static json_t *update_stats_json(void)
+{
+    json_t *lcores = json_array();
+    unsigned lcore_id, master = get_master_lcore_id();
+
+    RTE_LCORE_FOREACH_SLAVE(lcore_id) {
+        if (domian_msg_ring[lcore_id] == NULL)
+            continue;
+        json_t *lcore = lat_hist_json(&upd_stats.lcore[lcore_id]);
+        json_object_set_new(lcore, "lcore", json_integer(lcore_id));
+        json_object_set_new(lcore, "ring_count", json_integer(rte_ring_count(domian_msg_ring[lcore_id])));
+        json_object_set_new(lcore, "ring_hwm", json_integer(upd_stats.ring_hwm[lcore_id]));
+        json_array_append_new(lcores, lcore);
+    }
+    return json_pack("{s:I, s:i, s:i, s:o, s:o, s:o}", "received", (json_int_t)upd_stats.received,
+        "master_ring_count", domian_msg_ring[master] ? rte_ring_count(domian_msg_ring[master]) : 0,
+        "master_ring_hwm", upd_stats.ring_hwm[master],
+        "master", lat_hist_json(&upd_stats.master), "all", lat_hist_json(&upd_stats.all), "lcores", lcores);
+}
+
+/* backoff of the idle lcores, cpu_saved_pct is the share of the time asleep since the reset */
+static json_t *idle_stats_json(void)
+{
+    static const char *stages[] = {"busy", "pause", "scaled", "sleep"};
+    json_t *lcores = json_array();
+    uint64_t elapsed = tsc_to_us(rte_rdtsc() - idle_stats_since());
+    uint64_t sleep_us, saved = 0;
+    enum idle_stage stage;
+    unsigned lcore_id, n = 0;
+
+    RTE_LCORE_FOREACH(lcore_id) {
+        struct idle_stats *st = idle_stats_get(lcore_id, &stage);
+        json_t *lcore;
+
+        if (st == NULL)
+            continue;
+        sleep_us = tsc_to_us(st->sleep_cycles);
+        lcore = json_pack("{s:i, s:s, s:I, s:I, s:I, s:I, s:I, s:f, s:o}", "lcore", lcore_id,
+            "stage", stages[stage], "pause_us", (json_int_t)tsc_to_us(st->pause_cycles),
+            "scaled_us", (json_int_t)tsc_to_us(st->scaled_cycles), "sleep_us", (json_int_t)sleep_us,
+            "sleeps", (json_int_t)st->sleeps, "intr_wakeups", (json_int_t)st->intr_wakeups,
+            "cpu_saved_pct", elapsed ? 100.0 * sleep_us / elapsed : 0.0,
+            "wakeup", lat_hist_json(&st->wakeup));
+        json_array_append_new(lcores, lcore);
+        saved += sleep_us;
+        n++;
+    }
+    return json_pack("{s:b, s:I, s:f, s:o}", "enable", idle_enable, "elapsed_us", (json_int_t)elapsed,
+        "cpu_saved_pct", elapsed && n ? 100.0 * saved / elapsed / n : 0.0, "lcores", lcores);
+}
+
+/* the services of the master, busy_pct is the share of their run time spent on work */
+static json_t *service_stats_json(void)
+{
+    json_t *services = json_array();
+    uint16_t i;
+
+    for (i = 0; i < kdns_service_num; i++) {
+        struct service *s = &kdns_services[i];
+        uint64_t busy = tsc_to_us(s->stats.busy_cycles), idle = tsc_to_us(s->stats.idle_cycles);
+
+        json_array_append_new(services, json_pack("{s:s, s:i, s:i, s:I, s:I, s:I, s:I, s:I, s:I, s:f}",
+            "name", s->name, "cpu", s->cpu, "budget", s->budget, "runs", (json_int_t)s->stats.runs,
+            "busy_runs", (json_int_t)s->stats.busy_runs, "budget_full", (json_int_t)s->stats.budget_full,
+            "work", (json_int_t)s->stats.work, "busy_us", (json_int_t)busy, "idle_us", (json_int_t)idle,
+            "busy_pct", busy + idle ? 100.0 * busy / (busy + idle) : 0.0));
+    }
+    return services;
+}
+
 static void* statistics_get( __attribute__((unused)) struct connection_info_struct *con_info, __attribute__((unused))char *url,int * len_response)
 {
     struct netif_queue_stats sta ={0};
     netif_statsdata_get(&sta);
 
-    struct json_stats_strings sta_string ={"","","","","","","","","",""};
+    struct json_stats_strings sta_string ={"","","","","","","","","","","","","","","","","","","","","","",""};
 
     sprintf(sta_string.domain_num,"%d",domain_num_get());
     sprintf(sta_string.pkts_rcv,"%ld",sta.pkts_rcv);
     sprintf(sta_string.dns_pkts_rcv,"%ld",sta.dns_pkts_rcv);
+    sprintf(sta_string.dns6_pkts_rcv,"%ld",sta.dns6_pkts_rcv);
     sprintf(sta_string.dns_pkts_snd,"%ld",sta.dns_pkts_snd);
     sprintf(sta_string.dns_lens_rcv,"%ld",sta.dns_lens_rcv);
     sprintf(sta_string.dns_lens_snd,"%ld",sta.dns_lens_snd);
@@ -610,21 +939,44 @@ static void* statistics_get( __attribute__((unused)) struct connection_info_stru
     sprintf(sta_string.pkts_2kni,"%ld",sta.pkts_2kni);
     sprintf(sta_string.pkts_icmp,"%ld",sta.pkts_icmp);
     sprintf(sta_string.pkt_len_err,"%ld",sta.pkt_len_err);
+    sprintf(sta_string.pkt_tx_full,"%ld",sta.pkt_tx_full);
+    sprintf(sta_string.rrl_answer_limited,"%ld",sta.rrl_answer_limited);
+    sprintf(sta_string.rrl_nxdomain_limited,"%ld",sta.rrl_nxdomain_limited);
+    sprintf(sta_string.rrl_fwd_limited,"%ld",sta.rrl_fwd_limited);
+    sprintf(sta_string.rrl_dropped,"%ld",sta.rrl_dropped);
+    sprintf(sta_string.rrl_slipped,"%ld",sta.rrl_slipped);
+    sprintf(sta_string.rrl_evicted,"%ld",sta.rrl_evicted);
+    sprintf(sta_string.frag_rcv,"%ld",sta.frag_rcv);
+    sprintf(sta_string.frag_reassembled,"%ld",sta.frag_reassembled);
+    sprintf(sta_string.frag_dropped,"%ld",sta.frag_dropped);
+    sprintf(sta_string.frag_snd,"%ld",sta.frag_snd);
+    sprintf(sta_string.frag_snd_err,"%ld",sta.frag_snd_err);
 
     
     json_t *value = NULL;
     
-    value = json_pack("{s:s, s:s, s:s, s:s, s:s, s:s, s:s, s:s, s:s, s:s}", 
+    value = json_pack("{s:s, s:s, s:s, s:s, s:s, s:s, s:s, s:s, s:s, s:s, s:s, s:s, s:s, s:s, s:s, s:s, s:s, s:s, s:s, s:s, s:s, s:s, s:s}", 
             "domain_num",sta_string.domain_num, "pkts_rcv",sta_string.pkts_rcv,
-            "dns_pkts_rcv",sta_string.dns_pkts_rcv,"dns_pkts_snd",sta_string.dns_pkts_snd,"pkt_dropped",sta_string.pkt_dropped,
+            "dns_pkts_rcv",sta_string.dns_pkts_rcv,"dns6_pkts_rcv",sta_string.dns6_pkts_rcv,"dns_pkts_snd",sta_string.dns_pkts_snd,"pkt_dropped",sta_string.pkt_dropped,
             "pkts_2kni",sta_string.pkts_2kni,"pkts_icmp",sta_string.pkts_icmp,"pkt_len_err",sta_string.pkt_len_err,
-            "dns_lens_rcv",sta_string.dns_lens_rcv,"dns_lens_snd",sta_string.dns_lens_snd);
+            "pkt_tx_full",sta_string.pkt_tx_full,
+            "dns_lens_rcv",sta_string.dns_lens_rcv,"dns_lens_snd",sta_string.dns_lens_snd,
+            "rrl_answer_limited",sta_string.rrl_answer_limited,"rrl_nxdomain_limited",sta_string.rrl_nxdomain_limited,
+            "rrl_fwd_limited",sta_string.rrl_fwd_limited,"rrl_dropped",sta_string.rrl_dropped,
+            "rrl_slipped",sta_string.rrl_slipped,"rrl_evicted",sta_string.rrl_evicted,
+            "frag_rcv",sta_string.frag_rcv,"frag_reassembled",sta_string.frag_reassembled,
+            "frag_dropped",sta_string.frag_dropped,"frag_snd",sta_string.frag_snd,
+            "frag_snd_err",sta_string.frag_snd_err);
     
     if (!value){
            char * err = strdup("json_pack err");
            *len_response = strlen(err);
            return (void* )err;;  
     }
+    json_object_set_new(value, "ports", port_stats_json());
+    json_object_set_new(value, "update", update_stats_json());
+    json_object_set_new(value, "idle", idle_stats_json());
+    json_object_set_new(value, "services", service_stats_json());
     
     char *str_ret = json_dumps(value, JSON_COMPACT);
     json_decref(value);
@@ -637,12 +989,37 @@ static void* statistics_reset( __attribute__((unused)) struct connection_info_st
 {
     char * post_ok = strdup("OK\n");
     netif_statsdata_reset();
+    memset(&upd_stats, 0, sizeof(upd_stats));
+    idle_stats_reset();
+    service_stats_reset();
     *len_response = strlen(post_ok);
     return (void* )post_ok;
 }
 
 
 
+static void* memory_get( __attribute__((unused)) struct connection_info_struct *con_info, __attribute__((unused))char *url,int * len_response)
+{
+    struct slab_stats stats[SLAB_TYPE_MAX];
+    int i;
+
+    slab_stats_get(stats);
+    json_t *value = json_pack("{s:i}", "domain_num", domain_num_get());
+    for (i = 0; i < SLAB_TYPE_MAX; i++) {
+        json_object_set_new(value, slab_type_name(i),
+            json_pack("{s:I, s:I, s:I, s:I, s:I}",
+                "objects", (json_int_t)stats[i].objects, "bytes", (json_int_t)stats[i].bytes,
+                "reserved", (json_int_t)stats[i].reserved, "allocs", (json_int_t)stats[i].allocs,
+                "frees", (json_int_t)stats[i].frees));
+    }
+
+    char *str_ret = json_dumps(value, JSON_COMPACT);
+    json_decref(value);
+    *len_response = strlen(str_ret);
+    return (void* )str_ret;
+}
+
+
 void domian_info_exchange_run( int port){
     
     dins = webserver_new(port);
@@ -656,6 +1033,7 @@ void domian_info_exchange_run( int port){
 
     web_endpoint_add("GET","/kdns/statistics/get",dins,&statistics_get);
     web_endpoint_add("POST","/kdns/statistics/reset",dins,&statistics_reset);
+    web_endpoint_add("GET","/kdns/memory/get",dins,&memory_get);
     
     webserver_run(dins);
     return;   
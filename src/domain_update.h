@@ -6,7 +6,7 @@
 void domian_info_exchange_run( int port);
 
 void domain_msg_ring_create(void);
-void doman_msg_master_process(void);
+uint32_t doman_msg_master_process(uint32_t budget);
 void doman_msg_slave_process(void);
 
 #endif
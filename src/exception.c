@@ -0,0 +1,228 @@
+/*
+ * exception.c -- kernel interfaces for the exception path: KNI, TAP or virtio-user
+ */
+#include <string.h>
+#include <rte_common.h>
+#include <rte_ethdev.h>
+#include <rte_dev.h>
+#include <rte_kni.h>
+#include <rte_mbuf.h>
+
+#include "exception.h"
+#include "netdev.h"
+#include "dns-conf.h"
+#include "util.h"
+
+#define KNI_DEF_MBUF_SIZE   2048
+#define KNI_MBUF_CACHE      256
+
+#define EXC_PORT_DESC       1024
+
+extern struct rte_mempool *pkt_mbuf_pool;
+
+static struct rte_mempool *kni_mbuf_pool;
+static const struct exc_backend_ops *exc_ops;
+
+static const struct rte_eth_conf exc_port_conf = {
+    .txmode = {
+        .mq_mode = ETH_MQ_TX_NONE,
+    },
+};
+
+
+static void exc_ifname(struct net_device *dev, char *name, size_t len) {
+    /* one port keeps the plain name, several get the port index appended */
+    if (kdns_net_device_num == 1) {
+        snprintf(name, len, "%s", g_dns_cfg->netdev.name_prefix);
+    } else {
+        snprintf(name, len, "%s%u", g_dns_cfg->netdev.name_prefix, (unsigned)(dev - kdns_net_device));
+    }
+}
+
+/* the port is owned by kdns, link and mtu requests of the kernel are ignored */
+static int kni_config_network_interface(__rte_unused uint8_t port_id, __rte_unused uint8_t if_up) {
+    return 0;
+}
+
+static int kni_change_mtu(__rte_unused uint8_t port_id, __rte_unused unsigned new_mtu) {
+    return 0;
+}
+
+static int kni_open(struct net_device *dev) {
+    struct rte_kni_conf conf;
+    struct rte_kni_ops ops;
+    struct rte_eth_dev_info dev_info;
+
+    memset(&conf, 0, sizeof(conf));
+    exc_ifname(dev, conf.name, sizeof(conf.name));
+    conf.core_id = 0;
+    conf.force_bind = 1;
+    conf.mbuf_size = KNI_DEF_MBUF_SIZE;
+    conf.group_id = (uint16_t)0;
+
+    memset(&dev_info, 0, sizeof(dev_info));
+    rte_eth_dev_info_get(dev->port_id, &dev_info);
+    /* virtual ports such as a bond have no pci device */
+    if (dev_info.pci_dev) {
+        conf.addr = dev_info.pci_dev->addr;
+        conf.id = dev_info.pci_dev->id;
+    }
+
+    memset(&ops, 0, sizeof(ops));
+    ops.port_id = dev->port_id;
+    ops.change_mtu = kni_change_mtu;
+    ops.config_network_if = kni_config_network_interface;
+
+    dev->kni = rte_kni_alloc(kni_mbuf_pool, &conf, &ops);
+    if (!dev->kni) {
+        log_msg(LOG_ERR, "Fail to create kni for port: %d\n", dev->port_id);
+        return -1;
+    }
+    return 0;
+}
+
+static uint16_t kni_to_kernel(struct net_device *dev, struct rte_mbuf **pkts, uint16_t n) {
+    return rte_kni_tx_burst(dev->kni, pkts, n);
+}
+
+static uint16_t kni_from_kernel(struct net_device *dev, struct rte_mbuf **pkts, uint16_t n) {
+    return rte_kni_rx_burst(dev->kni, pkts, n);
+}
+
+static void kni_poll(struct net_device *dev) {
+    /* frees the mbufs the kernel is done with */
+    rte_kni_tx_burst(dev->kni, NULL, 0);
+    rte_kni_handle_request(dev->kni);
+}
+
+static void kni_close(struct net_device *dev) {
+    if (rte_kni_release(dev->kni))
+        log_msg(LOG_ERR, "Fail to release kni\n");
+}
+
+static const struct exc_backend_ops kni_backend_ops = {
+    .name        = "kni",
+    .open        = kni_open,
+    .to_kernel   = kni_to_kernel,
+    .from_kernel = kni_from_kernel,
+    .poll        = kni_poll,
+    .close       = kni_close,
+};
+
+
+/*
+ * TAP and virtio-user are ethdev ports on the master: the kernel interface
+ * is the other end, mbufs come from the pool of the served ports and no
+ * kernel module is needed.
+ */
+static int exc_port_open(struct net_device *dev, const char *vdev, const char *args, const char *ethdev) {
+    uint8_t port;
+    int ret;
+
+    if (rte_eal_vdev_init(vdev, args) < 0 || rte_eth_dev_get_port_by_name(ethdev, &port) != 0) {
+        log_msg(LOG_ERR, "Cannot create %s (%s) for port %u\n", vdev, args, dev->port_id);
+        return -1;
+    }
+    ret = rte_eth_dev_configure(port, 1, 1, &exc_port_conf);
+    if (ret == 0)
+        ret = rte_eth_rx_queue_setup(port, 0, EXC_PORT_DESC, rte_eth_dev_socket_id(port), NULL, pkt_mbuf_pool);
+    if (ret == 0)
+        ret = rte_eth_tx_queue_setup(port, 0, EXC_PORT_DESC, rte_eth_dev_socket_id(port), NULL);
+    if (ret == 0)
+        ret = rte_eth_dev_start(port);
+    if (ret < 0) {
+        log_msg(LOG_ERR, "Cannot start %s for port %u (%d)\n", vdev, dev->port_id, ret);
+        return -1;
+    }
+    dev->exc_port_id = port;
+    log_msg(LOG_INFO, "port %u: exception path %s is port %u\n", dev->port_id, vdev, port);
+    return 0;
+}
+
+static int tap_open(struct net_device *dev) {
+    char vdev[32], args[64], ifname[RTE_KNI_NAMESIZE];
+
+    exc_ifname(dev, ifname, sizeof(ifname));
+    snprintf(vdev, sizeof(vdev), "net_tap%u", (unsigned)(dev - kdns_net_device));
+    snprintf(args, sizeof(args), "iface=%s", ifname);
+    /* the TAP PMD names the ethdev after the interface, not the vdev */
+    return exc_port_open(dev, vdev, args, ifname);
+}
+
+/* the vhost-net backend names the kernel interface itself (tapN) */
+static int virtio_user_open(struct net_device *dev) {
+    char vdev[32], args[128];
+
+    snprintf(vdev, sizeof(vdev), "net_virtio_user%u", (unsigned)(dev - kdns_net_device));
+    snprintf(args, sizeof(args), "path=/dev/vhost-net,queues=1,queue_size=%u", EXC_PORT_DESC);
+    return exc_port_open(dev, vdev, args, vdev);
+}
+
+static uint16_t exc_port_to_kernel(struct net_device *dev, struct rte_mbuf **pkts, uint16_t n) {
+    return rte_eth_tx_burst(dev->exc_port_id, 0, pkts, n);
+}
+
+static uint16_t exc_port_from_kernel(struct net_device *dev, struct rte_mbuf **pkts, uint16_t n) {
+    return rte_eth_rx_burst(dev->exc_port_id, 0, pkts, n);
+}
+
+static void exc_port_close(struct net_device *dev) {
+    rte_eth_dev_stop(dev->exc_port_id);
+    rte_eth_dev_close(dev->exc_port_id);
+}
+
+static const struct exc_backend_ops tap_backend_ops = {
+    .name        = "tap",
+    .open        = tap_open,
+    .to_kernel   = exc_port_to_kernel,
+    .from_kernel = exc_port_from_kernel,
+    .close       = exc_port_close,
+};
+
+static const struct exc_backend_ops virtio_user_backend_ops = {
+    .name        = "virtio-user",
+    .open        = virtio_user_open,
+    .to_kernel   = exc_port_to_kernel,
+    .from_kernel = exc_port_from_kernel,
+    .close       = exc_port_close,
+};
+
+
+void exc_backend_init(uint16_t dev_num) {
+    const char *path = g_dns_cfg->netdev.exception_path;
+
+    if (path == NULL || strcmp(path, "kni") == 0) {
+        exc_ops = &kni_backend_ops;
+    } else if (strcmp(path, "tap") == 0) {
+        exc_ops = &tap_backend_ops;
+    } else if (strcmp(path, "virtio-user") == 0) {
+        exc_ops = &virtio_user_backend_ops;
+    } else {
+        log_msg(LOG_ERR, "Unknown NETDEV/exception-path = %s\n", path);
+        exit(-1);
+    }
+    log_msg(LOG_INFO, "exception path: %s\n", exc_ops->name);
+
+    if (exc_ops != &kni_backend_ops) {
+        return;
+    }
+    kni_mbuf_pool = rte_pktmbuf_pool_create("kni_mbuf_pool", g_dns_cfg->netdev.kni_mbuf_num,
+                KNI_MBUF_CACHE, 0, RTE_MBUF_DEFAULT_BUF_SIZE, rte_socket_id());
+    if (!kni_mbuf_pool) {
+        log_msg(LOG_ERR, "Fail to create pktmbuf_pool for kni.");
+        exit(-1);
+    }
+    rte_kni_init(dev_num);
+}
+
+int exc_backend_open(struct net_device *dev) {
+    dev->exc_ops = exc_ops;
+    if (exc_ops->open(dev) < 0) {
+        exit(-1);
+    }
+    return 0;
+}
+
+void exc_backend_close(struct net_device *dev) {
+    dev->exc_ops->close(dev);
+}
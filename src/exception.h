@@ -0,0 +1,32 @@
+#ifndef __EXCEPTION_H__
+#define __EXCEPTION_H__
+
+#include <stdint.h>
+#include <rte_mbuf.h>
+
+struct net_device;
+
+/*
+ * Exception path: packets that are not DNS queries (ARP, BGP, ICMP ...) go to
+ * a kernel interface named after NETDEV/name-prefix, and what the kernel sends
+ * goes out on the served port. All callbacks run on the master.
+ */
+struct exc_backend_ops {
+    const char *name;
+    /* create the kernel interface of the port */
+    int (*open)(struct net_device *dev);
+    /* returns the number of packets taken, the caller frees the rest */
+    uint16_t (*to_kernel)(struct net_device *dev, struct rte_mbuf **pkts, uint16_t n);
+    uint16_t (*from_kernel)(struct net_device *dev, struct rte_mbuf **pkts, uint16_t n);
+    /* control requests of the kernel, may be NULL */
+    void (*poll)(struct net_device *dev);
+    void (*close)(struct net_device *dev);
+};
+
+/* select the backend of NETDEV/exception-path for dev_num ports */
+void exc_backend_init(uint16_t dev_num);
+
+int exc_backend_open(struct net_device *dev);
+void exc_backend_close(struct net_device *dev);
+
+#endif
@@ -22,12 +22,14 @@
 #include <arpa/inet.h>
 #include <rte_byteorder.h>
 #include <rte_ethdev.h>
+#include <rte_lcore.h>
 #include "netdev.h"
 #include "util.h"
 #include "forward.h"
 
 struct fwd_pkt_input {
     struct rte_mbuf *pkt;
+    unsigned lcore_id;      /* the lcore that sends the answer */
     uint16_t old_id;
     uint16_t qtype;
     char  domain_name[FWD_MAX_DOMAIN_NAME_LEN];
@@ -63,6 +65,9 @@ typedef struct domin_fwd_cache{
 #define BUF_SIZE 512
 
 #define FWD_RING_SIZE     65536
+/* descriptors of the queries on their way to the forwarding threads */
+#define FWD_DESC_NUM      (FWD_RING_SIZE - 1)
+#define FWD_DESC_CACHE    32
 
 static domain_fwd_addrs *default_fwd_addrs = NULL ;
 
@@ -71,8 +76,10 @@ static int g_fwd_zone_num = 0;
 
 
 extern struct rte_mempool *pkt_mbuf_pool;
-struct rte_ring *master_fwd_pkt_ex_ring;
+/* answers back to the lcore the query came in on */
+static struct rte_ring *fwd_answer_ring[RTE_MAX_LCORE];
 struct rte_ring *fwd_pkt_to_process_ring;
+static struct rte_mempool *fwd_desc_pool;
 
 
 
@@ -274,10 +281,16 @@ int remote_sock_init(char * fwd_addrs, char * fwd_def_addr,int fwd_threads){
     default_fwd_addrs = resolve_dns_servers("defulat.zone",fwd_def_addr);
     parse_dns_fwd_zones(fwd_addrs);
     
-    master_fwd_pkt_ex_ring = rte_ring_create("master_fwd_pkt_ex_ring", FWD_RING_SIZE, rte_socket_id(), RING_F_SC_DEQ);
-    if (!master_fwd_pkt_ex_ring) {
-        log_msg(LOG_ERR, "Cannot create ring master_fwd_pkt_ex_ring  %s\n", rte_strerror(rte_errno));
-        exit(-1);
+    unsigned lcore_id;
+    RTE_LCORE_FOREACH_SLAVE(lcore_id) {
+        char ring_name[RTE_RING_NAMESIZE];
+        snprintf(ring_name, sizeof(ring_name), "fwd_answer_ring_%u", lcore_id);
+        fwd_answer_ring[lcore_id] = rte_ring_create(ring_name, FWD_RING_SIZE,
+            rte_lcore_to_socket_id(lcore_id), RING_F_SC_DEQ);
+        if (!fwd_answer_ring[lcore_id]) {
+            log_msg(LOG_ERR, "Cannot create ring %s  %s\n", ring_name, rte_strerror(rte_errno));
+            exit(-1);
+        }
     }
 
     fwd_pkt_to_process_ring = rte_ring_create("fwd_pkt_to_process_ring", FWD_RING_SIZE, rte_socket_id(), 0); 
@@ -285,6 +298,12 @@ int remote_sock_init(char * fwd_addrs, char * fwd_def_addr,int fwd_threads){
         log_msg(LOG_ERR, "Cannot create ring fwd_pkt_to_process_ring  %s\n", rte_strerror(rte_errno));
         exit(-1);
     }
+    fwd_desc_pool = rte_mempool_create("fwd_desc_pool", FWD_DESC_NUM, sizeof(struct fwd_pkt_input),
+        FWD_DESC_CACHE, 0, NULL, NULL, NULL, NULL, rte_socket_id(), 0);
+    if (!fwd_desc_pool) {
+        log_msg(LOG_ERR, "Cannot create fwd_desc_pool  %s\n", rte_strerror(rte_errno));
+        exit(-1);
+    }
 
     /* create a separate thread to send task status as quick as possible */
     int i =0;
@@ -404,27 +423,15 @@ domain_fwd_addrs * find_zone_fwd_addrs(char * domain_name){
 }
 
 static int  do_dns_handle_remote(int socket, struct rte_mbuf *pkt,uint16_t old_id,uint16_t qtype,char *doamin) {
-    struct ether_hdr *eth_hdr = NULL;
-    struct ipv4_hdr  *ip4_hdr = NULL;
     struct udp_hdr   *udp_hdr = NULL; 
-    struct ether_addr *src_mac, *dst_mac;
-    uint32_t src_addr, dst_addr;
-    uint16_t src_port, dst_port;
     char *buf_data;
     char expired_recrds[512]={0};
     int data_len = 0;
 
-    eth_hdr = rte_pktmbuf_mtod(pkt, struct ether_hdr*); 
-    ip4_hdr = rte_pktmbuf_mtod_offset(pkt, struct ipv4_hdr *, sizeof(struct ether_hdr));
-    udp_hdr = rte_pktmbuf_mtod_offset(pkt, struct udp_hdr*, sizeof(struct ether_hdr) + sizeof(struct ipv4_hdr));
-    buf_data = rte_pktmbuf_mtod_offset(pkt, char*, sizeof(struct ether_hdr) + sizeof(struct ipv4_hdr)+ sizeof(struct udp_hdr));
+    uint16_t data_offset = netif_udp_data_offset(pkt);
 
-    src_mac = &(eth_hdr->d_addr);
-    dst_mac = &(eth_hdr->s_addr);
-    src_addr = ip4_hdr->dst_addr;
-    dst_addr = ip4_hdr->src_addr;
-    src_port = udp_hdr->dst_port;
-    dst_port = udp_hdr->src_port;
+    udp_hdr = rte_pktmbuf_mtod_offset(pkt, struct udp_hdr*, data_offset - sizeof(struct udp_hdr));
+    buf_data = rte_pktmbuf_mtod_offset(pkt, char*, data_offset);
 
     // find in cache
     int status = fwd_cache_lookup(doamin,qtype, buf_data,&data_len,expired_recrds);
@@ -456,24 +463,10 @@ static int  do_dns_handle_remote(int socket, struct rte_mbuf *pkt,uint16_t old_i
     }
 
     
+    /* the lcore turns the query headers around when it sends the answer */
     if (data_len >0) {
-        
-        struct ether_hdr pkt_eth_hdr;
-        struct ipv4_hdr pkt_ipv4_hdr;
-        struct udp_hdr pkt_udp_hdr;
-  
-        init_eth_header(&pkt_eth_hdr, src_mac, dst_mac, ETHER_TYPE_IPv4);
-        init_ipv4_header(&pkt_ipv4_hdr, src_addr, dst_addr, sizeof(struct udp_hdr) + data_len);
-        init_udp_header(&pkt_udp_hdr, src_port, dst_port, data_len);
-
-         memcpy(eth_hdr,&pkt_eth_hdr, sizeof(struct ether_hdr));
-         memcpy(ip4_hdr,&pkt_ipv4_hdr, sizeof(struct ipv4_hdr));
-         memcpy(udp_hdr,&pkt_udp_hdr, sizeof(struct udp_hdr));
-         pkt->pkt_len = data_len + sizeof(struct ether_hdr) + sizeof(struct ipv4_hdr) + sizeof(struct udp_hdr);
+         pkt->pkt_len = data_len + data_offset;
          pkt->data_len = pkt->pkt_len;
-         pkt->l2_len = sizeof(struct ether_hdr);
-         pkt->vlan_tci  = ETHER_TYPE_IPv4;
-         pkt->l3_len = sizeof(struct ipv4_hdr); 
 
          // change the fag and  queryId
          uint16_t ns_old_id = htons(old_id);
@@ -487,33 +480,33 @@ static int  do_dns_handle_remote(int socket, struct rte_mbuf *pkt,uint16_t old_i
 
 int dns_handle_remote(struct rte_mbuf *pkt,uint16_t old_id,uint16_t qtype,char *domain){
 
-    struct fwd_pkt_input *etm = calloc(sizeof(struct fwd_pkt_input),1);
-    if (!etm){
+    struct fwd_pkt_input *etm;
+    size_t len = strlen(domain);
+
+    if (rte_mempool_get(fwd_desc_pool, (void **)&etm) != 0) {
         rte_pktmbuf_free(pkt);
         return -1;   
     }
+    if (len >= FWD_MAX_DOMAIN_NAME_LEN)
+        len = FWD_MAX_DOMAIN_NAME_LEN - 1;
     etm->pkt = pkt;
+    etm->lcore_id = rte_lcore_id();
     etm->old_id = old_id;
     etm->qtype = qtype;
-    memcpy(etm->domain_name,domain,strlen(domain));
+    memcpy(etm->domain_name,domain,len);
+    etm->domain_name[len] = '\0';
     int ret = rte_ring_mp_enqueue(fwd_pkt_to_process_ring, (void*)etm);
     if (ret != 0) {
         rte_pktmbuf_free(pkt);
-        free(etm);
+        rte_mempool_put(fwd_desc_pool, etm);
         return -2;       
     }
     return 0;   
 }
 
-uint16_t fwd_pkts_dequeue(struct rte_mbuf **mbufs,uint16_t pkts_len)
+uint16_t fwd_pkts_dequeue(unsigned lcore_id,struct rte_mbuf **mbufs,uint16_t pkts_len)
 {
-
-   while (pkts_len > 0 &&
-				unlikely(rte_ring_dequeue_bulk(master_fwd_pkt_ex_ring, (void ** )mbufs,
-					pkts_len) != 0))
-			pkts_len = (uint16_t)RTE_MIN(rte_ring_count(master_fwd_pkt_ex_ring),pkts_len);
-   
-   return pkts_len;
+   return (uint16_t)rte_ring_sc_dequeue_burst(fwd_answer_ring[lcore_id], (void ** )mbufs, pkts_len);
 }
 
 
@@ -537,15 +530,15 @@ static void *thread_fwd_pkt_process(void *socket){
         if (unlikely(fwd_len <= 0)){
             log_msg(LOG_ERR,"can not get rte_mbuf from do_dns_handle_remote\n");
             rte_pktmbuf_free(etm->pkt);
-            free(etm); 
+            rte_mempool_put(fwd_desc_pool, etm);
         }else{
-            int ret = rte_ring_mp_enqueue(master_fwd_pkt_ex_ring, (void*)etm->pkt);
+            int ret = rte_ring_mp_enqueue(fwd_answer_ring[etm->lcore_id], (void*)etm->pkt);
             if (ret != 0) {
-                log_msg(LOG_ERR,"can not en queue  master_fwd_pkt_ex_ring\n");
+                log_msg(LOG_ERR,"can not en queue  fwd_answer_ring of lcore %u\n", etm->lcore_id);
                 rte_pktmbuf_free(etm->pkt);      
             }
             
-            free(etm); 
+            rte_mempool_put(fwd_desc_pool, etm);
         }
     }
      return NULL;
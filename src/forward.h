@@ -20,7 +20,8 @@ typedef struct {
 
 int remote_sock_init(char * fwd_addrs, char * fwd_def_addr,int fwd_threads);
 int dns_handle_remote(struct rte_mbuf *pkt,uint16_t old_id,uint16_t qtype,char *domain);
-uint16_t fwd_pkts_dequeue(struct rte_mbuf **mbufs,uint16_t pkts_len);
+/* forwarded answers for the queries of an lcore */
+uint16_t fwd_pkts_dequeue(unsigned lcore_id,struct rte_mbuf **mbufs,uint16_t pkts_len);
 domain_fwd_addrs * find_zone_fwd_addrs(char * domain_name);
 int dns_tcp_process_init(char *ip);
 
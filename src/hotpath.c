@@ -0,0 +1,48 @@
+/*
+ * hotpath.c -- libc allocation in the packet path of the lcores, caught by
+ * wrapping the allocator at link time
+ */
+#include <stdlib.h>
+#include <rte_debug.h>
+#include <rte_lcore.h>
+
+#include "hotpath.h"
+
+__thread int hotpath_in;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t num, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t num, size_t size);
+void *__wrap_realloc(void *ptr, size_t size);
+void __wrap_free(void *ptr);
+
+/* rte_panic allocates to print the stack */
+#define HOTPATH_CHECK(fn) do { \
+    if (unlikely(hotpath_in)) { \
+        hotpath_in = 0; \
+        rte_panic(fn " in the packet path of lcore %u\n", rte_lcore_id()); \
+    } \
+} while (0)
+
+void *__wrap_malloc(size_t size) {
+    HOTPATH_CHECK("malloc");
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t num, size_t size) {
+    HOTPATH_CHECK("calloc");
+    return __real_calloc(num, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    HOTPATH_CHECK("realloc");
+    return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr) {
+    HOTPATH_CHECK("free");
+    __real_free(ptr);
+}
@@ -0,0 +1,17 @@
+#ifndef __HOTPATH_H__
+#define __HOTPATH_H__
+
+/*
+ * Built with HOTPATH_CHECK=y, malloc, calloc, realloc and free abort when
+ * called between HOTPATH_ENTER and HOTPATH_LEAVE in the same thread.
+ */
+#ifdef ENABLE_HOTPATH_CHECK
+extern __thread int hotpath_in;
+#define HOTPATH_ENTER()     (hotpath_in = 1)
+#define HOTPATH_LEAVE()     (hotpath_in = 0)
+#else
+#define HOTPATH_ENTER()     do {} while (0)
+#define HOTPATH_LEAVE()     do {} while (0)
+#endif
+
+#endif
@@ -0,0 +1,246 @@
+/*
+ * idle.c -- adaptive polling, the lcores back off when the traffic goes away
+ */
+#include <string.h>
+#include <unistd.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_lcore.h>
+#include <rte_malloc.h>
+#include <rte_ethdev.h>
+#include <rte_interrupts.h>
+#include <rte_power.h>
+
+#include "idle.h"
+#include "dns-conf.h"
+#include "util.h"
+
+/* longest run of rte_pause between two polls */
+#define IDLE_PAUSE_MAX  1024
+
+struct idle_lcore {
+    enum idle_stage stage;
+    uint32_t empty_polls;
+    uint32_t pauses;            /* rte_pause per empty poll, doubles up to IDLE_PAUSE_MAX */
+    uint64_t idle_tsc;          /* start of the idle period */
+    uint64_t scaled_tsc;        /* when the frequency went down */
+    uint64_t wait_end_tsc;      /* the last pause or sleep returned */
+    uint8_t  scale;             /* rte_power works on this lcore */
+    uint8_t  scaled;
+    uint8_t  intr;              /* every queue of the lcore raises rx interrupts */
+    struct netif_lcore_conf *lconf;
+    struct idle_stats stats;
+} __rte_cache_aligned;
+
+int idle_enable = 0;
+
+static struct idle_lcore *idle_lcores[RTE_MAX_LCORE];
+/* state of the calling thread, service threads have no lcore id */
+static __thread struct idle_lcore *idle_self;
+
+static uint64_t idle_scale_tsc;     /* idle time before lowering the frequency, 0 never */
+static uint64_t idle_sleep_tsc;     /* and before sleeping, 0 never */
+static uint64_t idle_reset_tsc;
+
+
+void idle_init(void) {
+    struct idle_config *cfg = &g_dns_cfg->idle;
+    uint64_t us = (rte_get_tsc_hz() + US_PER_S - 1) / US_PER_S;
+
+    idle_enable = cfg->enable;
+    idle_reset_tsc = rte_rdtsc();
+    if (!idle_enable) {
+        return;
+    }
+    idle_scale_tsc = us * cfg->scale_us;
+    idle_sleep_tsc = us * cfg->sleep_us;
+    log_msg(LOG_INFO, "idle: pause after %u empty polls, scale after %uus, sleep after %uus up to %ums %s\n",
+        cfg->pause_polls, cfg->scale_us, cfg->sleep_us, cfg->sleep_max_ms,
+        cfg->rx_intr ? "on rx interrupts" : "on a timer");
+}
+
+/* scale is off for the master, its core runs the web and forwarding threads too */
+int idle_lcore_init(unsigned lcore_id, int scale) {
+    struct idle_lcore *il;
+
+    if (!idle_enable) {
+        return 0;
+    }
+    il = rte_zmalloc_socket("idle_lcore", sizeof(*il), RTE_CACHE_LINE_SIZE,
+        rte_lcore_to_socket_id(lcore_id));
+    if (il == NULL) {
+        log_msg(LOG_ERR, "idle: cannot alloc state for lcore %u\n", lcore_id);
+        return -1;
+    }
+    if (scale && idle_scale_tsc) {
+        if (rte_power_init(lcore_id) == 0)
+            il->scale = 1;
+        else
+            log_msg(LOG_ERR, "idle: no frequency scaling on lcore %u\n", lcore_id);
+    }
+    idle_lcores[lcore_id] = il;
+    return 0;
+}
+
+/*
+ * In the lcore thread, its rx queues go to its own epoll instance. Without
+ * interrupts on any of them, or without queues, it sleeps sleep-max-ms at a
+ * time.
+ */
+void idle_lcore_start(struct netif_lcore_conf *lconf) {
+    unsigned lcore_id = rte_lcore_id();
+    struct idle_lcore *il = idle_lcores[lcore_id];
+    uint16_t i;
+    int ret;
+
+    if (il == NULL) {
+        return;
+    }
+    idle_self = il;
+    il->lconf = lconf;
+    if (lconf == NULL || !g_dns_cfg->idle.rx_intr || idle_sleep_tsc == 0) {
+        return;
+    }
+    for (i = 0; i < lconf->nb_queues; i++) {
+        ret = rte_eth_dev_rx_intr_ctl_q(lconf->queues[i]->port_id, lconf->queues[i]->rx_queue_id,
+            RTE_EPOLL_PER_THREAD, RTE_INTR_EVENT_ADD, NULL);
+        if (ret < 0) {
+            log_msg(LOG_ERR, "idle: no rx interrupts on port %u queue %u (%d), lcore %u sleeps on a timer\n",
+                lconf->queues[i]->port_id, lconf->queues[i]->rx_queue_id, ret, lcore_id);
+            return;
+        }
+    }
+    il->intr = 1;
+}
+
+/* a service thread backs off like the master, on a timer and at full frequency */
+int idle_thread_init(void) {
+    if (!idle_enable) {
+        return 0;
+    }
+    idle_self = rte_zmalloc("idle_thread", sizeof(struct idle_lcore), RTE_CACHE_LINE_SIZE);
+    if (idle_self == NULL) {
+        log_msg(LOG_ERR, "idle: cannot alloc state for a service thread\n");
+        return -1;
+    }
+    return 0;
+}
+
+static void idle_sleep(struct idle_lcore *il) {
+    struct netif_lcore_conf *lconf = il->lconf;
+    struct rte_epoll_event ev[NETDEV_MAX_PORTS];
+    uint64_t start = rte_rdtsc();
+    uint16_t i;
+    int n = 0;
+
+    if (il->intr) {
+        for (i = 0; i < lconf->nb_queues; i++)
+            rte_eth_dev_rx_intr_enable(lconf->queues[i]->port_id, lconf->queues[i]->rx_queue_id);
+        /* what came in before the interrupts were armed raises none */
+        for (i = 0; i < lconf->nb_queues; i++) {
+            if (rte_eth_rx_queue_count(lconf->queues[i]->port_id, lconf->queues[i]->rx_queue_id) > 0)
+                break;
+        }
+        if (i == lconf->nb_queues) {
+            n = rte_epoll_wait(RTE_EPOLL_PER_THREAD, ev, NETDEV_MAX_PORTS, g_dns_cfg->idle.sleep_max_ms);
+            il->stats.sleeps++;
+            if (n > 0)
+                il->stats.intr_wakeups++;
+        }
+        for (i = 0; i < lconf->nb_queues; i++)
+            rte_eth_dev_rx_intr_disable(lconf->queues[i]->port_id, lconf->queues[i]->rx_queue_id);
+    } else {
+        usleep(g_dns_cfg->idle.sleep_max_ms * 1000);
+        il->stats.sleeps++;
+    }
+    il->stats.sleep_cycles += rte_rdtsc() - start;
+}
+
+/* the first burst after backing off, back to full speed polling */
+static void idle_wakeup(struct idle_lcore *il) {
+    uint64_t now = rte_rdtsc();
+
+    lat_hist_add(&il->stats.wakeup, (now - il->wait_end_tsc) * US_PER_S / rte_get_tsc_hz());
+    if (il->scaled) {
+        rte_power_freq_max(rte_lcore_id());
+        il->stats.scaled_cycles += now - il->scaled_tsc;
+        il->scaled = 0;
+    }
+    il->stage = IDLE_BUSY;
+    il->empty_polls = 0;
+}
+
+/*
+ * After each round of polls with the packets it brought in. Past pause-polls
+ * empty rounds the lcore pauses between the polls, longer each time; idle for
+ * scale-us it lowers its frequency, and for sleep-us it sleeps.
+ */
+void idle_update(uint16_t nb_rx) {
+    struct idle_lcore *il = idle_self;
+    uint64_t now, start;
+    uint32_t i;
+
+    if (il == NULL) {
+        return;
+    }
+    if (likely(nb_rx > 0)) {
+        if (unlikely(il->stage != IDLE_BUSY))
+            idle_wakeup(il);
+        il->empty_polls = 0;
+        return;
+    }
+    if (il->empty_polls < g_dns_cfg->idle.pause_polls) {
+        il->empty_polls++;
+        return;
+    }
+
+    now = rte_rdtsc();
+    if (il->stage == IDLE_BUSY) {
+        il->stage = IDLE_PAUSE;
+        il->idle_tsc = now;
+        il->pauses = 1;
+    }
+    if (il->scale && !il->scaled && idle_scale_tsc && now - il->idle_tsc >= idle_scale_tsc) {
+        rte_power_freq_min(rte_lcore_id());
+        il->scaled = 1;
+        il->scaled_tsc = now;
+        il->stage = IDLE_SCALED;
+    }
+    if (idle_sleep_tsc && now - il->idle_tsc >= idle_sleep_tsc) {
+        il->stage = IDLE_SLEEP;
+        idle_sleep(il);
+    } else {
+        start = rte_rdtsc();
+        for (i = 0; i < il->pauses; i++)
+            rte_pause();
+        if (il->pauses < IDLE_PAUSE_MAX)
+            il->pauses <<= 1;
+        il->stats.pause_cycles += rte_rdtsc() - start;
+    }
+    il->wait_end_tsc = rte_rdtsc();
+}
+
+struct idle_stats *idle_stats_get(unsigned lcore_id, enum idle_stage *stage) {
+    struct idle_lcore *il = idle_lcores[lcore_id];
+
+    if (il == NULL) {
+        return NULL;
+    }
+    *stage = il->stage;
+    return &il->stats;
+}
+
+/* tsc of the last reset */
+uint64_t idle_stats_since(void) {
+    return idle_reset_tsc;
+}
+
+void idle_stats_reset(void) {
+    unsigned lcore_id;
+
+    for (lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++) {
+        if (idle_lcores[lcore_id])
+            memset(&idle_lcores[lcore_id]->stats, 0, sizeof(struct idle_stats));
+    }
+    idle_reset_tsc = rte_rdtsc();
+}
@@ -0,0 +1,40 @@
+#ifndef __IDLE_H__
+#define __IDLE_H__
+
+#include <stdint.h>
+#include "netdev.h"
+#include "lat_hist.h"
+
+/* how far an lcore has backed off, each stage keeps the ones before it */
+enum idle_stage {
+    IDLE_BUSY,
+    IDLE_PAUSE,     /* rte_pause between the polls */
+    IDLE_SCALED,    /* and at the lowest frequency */
+    IDLE_SLEEP,     /* and asleep until an rx interrupt or sleep-max-ms */
+};
+
+/* single writer, the lcore itself */
+struct idle_stats {
+    uint64_t pause_cycles;      /* spent in rte_pause */
+    uint64_t scaled_cycles;     /* at the lowest frequency, up to the last wakeup */
+    uint64_t sleep_cycles;      /* asleep, the CPU given back */
+    uint64_t sleeps;
+    uint64_t intr_wakeups;      /* sleeps ended by an rx interrupt */
+    /* us from the end of the last pause or sleep to the first burst handled */
+    struct lat_hist wakeup;
+};
+
+extern int idle_enable;
+
+void idle_init(void);
+int idle_lcore_init(unsigned lcore_id, int scale);
+void idle_lcore_start(struct netif_lcore_conf *lconf);
+int idle_thread_init(void);
+
+void idle_update(uint16_t nb_rx);
+
+struct idle_stats *idle_stats_get(unsigned lcore_id, enum idle_stage *stage);
+uint64_t idle_stats_since(void);
+void idle_stats_reset(void);
+
+#endif
@@ -0,0 +1,224 @@
+/*
+ * ipfrag.c -- reassembly of fragmented queries and fragmentation of long answers
+ */
+#include <string.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_lcore.h>
+#include <rte_malloc.h>
+#include <rte_memcpy.h>
+#include <rte_ip_frag.h>
+
+#include "ipfrag.h"
+#include "dns-conf.h"
+#include "util.h"
+
+#define IPFRAG_BUCKET_ENTRIES   16
+#define IPFRAG_PREFETCH         3
+
+/* per lcore, the table is NULL with reassembly off */
+struct ipfrag_lcore {
+    struct rte_ip_frag_tbl *tbl;
+    struct rte_ip_frag_death_row dr;
+    uint16_t ip_id;     /* identification of the fragmented answers */
+} __rte_cache_aligned;
+
+static struct ipfrag_lcore *ipfrag_lcores[RTE_MAX_LCORE];
+
+/* data segments of the fragments, attached to the answer mbuf, one pool per socket */
+static struct rte_mempool *ipfrag_indirect_pools[RTE_MAX_NUMA_NODES];
+
+void ipfrag_init(void) {
+    char name[RTE_MEMPOOL_NAMESIZE];
+    unsigned lcore_id, socket;
+
+    RTE_LCORE_FOREACH_SLAVE(lcore_id) {
+        socket = rte_lcore_to_socket_id(lcore_id);
+        if (ipfrag_indirect_pools[socket] != NULL)
+            continue;
+        snprintf(name, sizeof(name), "frag_indirect_pool_s%u", socket);
+        ipfrag_indirect_pools[socket] = rte_pktmbuf_pool_create(name, g_dns_cfg->netdev.mbuf_num,
+            256, 0, 0, socket);
+        if (ipfrag_indirect_pools[socket] == NULL) {
+            log_msg(LOG_ERR, "ipfrag: cannot create the indirect mbuf pool on socket %u\n", socket);
+            exit(-1);
+        }
+    }
+    log_msg(LOG_INFO, "ipfrag: mtu %u, reassembly of %u datagrams per lcore for %ums\n",
+        g_dns_cfg->netdev.mtu, g_dns_cfg->netdev.frag_table_size, g_dns_cfg->netdev.frag_timeout_ms);
+}
+
+int ipfrag_lcore_init(unsigned lcore_id) {
+    struct ipfrag_lcore *lc;
+    uint32_t size = g_dns_cfg->netdev.frag_table_size;
+    uint64_t max_cycles;
+
+    lc = rte_zmalloc_socket("ipfrag_lcore", sizeof(*lc), RTE_CACHE_LINE_SIZE,
+        rte_lcore_to_socket_id(lcore_id));
+    if (lc == NULL) {
+        log_msg(LOG_ERR, "ipfrag: cannot alloc state for lcore %u\n", lcore_id);
+        return -1;
+    }
+    lc->ip_id = (uint16_t)(lcore_id << 11);
+
+    if (size > 0) {
+        max_cycles = (rte_get_tsc_hz() + MS_PER_S - 1) / MS_PER_S * g_dns_cfg->netdev.frag_timeout_ms;
+        lc->tbl = rte_ip_frag_table_create((size + IPFRAG_BUCKET_ENTRIES - 1) / IPFRAG_BUCKET_ENTRIES,
+            IPFRAG_BUCKET_ENTRIES, size, max_cycles, rte_lcore_to_socket_id(lcore_id));
+        if (lc->tbl == NULL) {
+            log_msg(LOG_ERR, "ipfrag: cannot create the table of lcore %u\n", lcore_id);
+            rte_free(lc);
+            return -1;
+        }
+    }
+    ipfrag_lcores[lcore_id] = lc;
+    return 0;
+}
+
+/* copy the following segments of a reassembled datagram into the first one */
+static int ipfrag_linearize(struct rte_mbuf *m) {
+    struct rte_mbuf *seg;
+
+    if (m->pkt_len > (uint32_t)(m->buf_len - m->data_off))
+        return -1;
+    for (seg = m->next; seg != NULL; seg = seg->next) {
+        rte_memcpy(rte_pktmbuf_mtod_offset(m, char *, m->data_len), rte_pktmbuf_mtod(seg, char *),
+            seg->data_len);
+        m->data_len += seg->data_len;
+    }
+    rte_pktmbuf_free(m->next);
+    m->next = NULL;
+    m->nb_segs = 1;
+    return 0;
+}
+
+/*
+ * Take a UDP fragment. Once all fragments of the datagram are in, it is
+ * returned in one segment like any other query, until then the table keeps
+ * them and NULL is returned.
+ */
+struct rte_mbuf *ipfrag_reassemble(struct netif_queue_conf *conf, struct rte_mbuf *pkt) {
+    struct ipfrag_lcore *lc = ipfrag_lcores[rte_lcore_id()];
+    struct rte_mbuf *mo;
+    uint32_t dead;
+
+    conf->stats.frag_rcv++;
+    if (lc->tbl == NULL) {
+        conf->stats.frag_dropped++;
+        rte_pktmbuf_free(pkt);
+        return NULL;
+    }
+
+    /* whatever the table drops, timed out datagrams included, goes to the death row */
+    dead = lc->dr.cnt;
+    pkt->l2_len = sizeof(struct ether_hdr);
+    if (netif_pkt_is_ipv6(pkt)) {
+        struct ipv6_hdr *ip6 = rte_pktmbuf_mtod_offset(pkt, struct ipv6_hdr *, pkt->l2_len);
+
+        pkt->l3_len = sizeof(struct ipv6_hdr) + sizeof(struct ipv6_extension_fragment);
+        mo = rte_ipv6_frag_reassemble_packet(lc->tbl, &lc->dr, pkt, rte_rdtsc(), ip6,
+            rte_ipv6_frag_get_ipv6_fragment_header(ip6));
+    } else {
+        struct ipv4_hdr *ip4 = rte_pktmbuf_mtod_offset(pkt, struct ipv4_hdr *, pkt->l2_len);
+
+        pkt->l3_len = (ip4->version_ihl & 0xF) << 2;
+        mo = rte_ipv4_frag_reassemble_packet(lc->tbl, &lc->dr, pkt, rte_rdtsc(), ip4);
+    }
+    conf->stats.frag_dropped += lc->dr.cnt - dead;
+    if (mo == NULL)
+        return NULL;
+
+    if (mo->nb_segs > 1 && ipfrag_linearize(mo) < 0) {
+        conf->stats.frag_dropped += mo->nb_segs;
+        rte_pktmbuf_free(mo);
+        return NULL;
+    }
+    if (!netif_pkt_is_ipv6(mo)) {
+        struct ipv4_hdr *ip4 = rte_pktmbuf_mtod_offset(mo, struct ipv4_hdr *, mo->l2_len);
+
+        /* the answer updates the header checksum of the query */
+        ip4->hdr_checksum = rte_ipv4_cksum(ip4);
+    }
+    mo->ol_flags = 0;
+    conf->stats.frag_reassembled++;
+    return mo;
+}
+
+/* free what the table dropped, after each burst */
+void ipfrag_flush(void) {
+    struct ipfrag_lcore *lc = ipfrag_lcores[rte_lcore_id()];
+
+    if (lc->dr.cnt > 0)
+        rte_ip_frag_free_death_row(&lc->dr, IPFRAG_PREFETCH);
+}
+
+/*
+ * Send an answer on the queue, as IP fragments of at most the MTU of the
+ * port when it is longer. A fragment is a header mbuf from the pool of the
+ * answer chained to indirect mbufs on the answer, which is freed with the
+ * last of them.
+ */
+void ipfrag_tx_answer(struct netif_queue_conf *conf, struct rte_mbuf *pkt) {
+    struct ipfrag_lcore *lc = ipfrag_lcores[rte_lcore_id()];
+    struct rte_mempool *indirect_pool = ipfrag_indirect_pools[rte_socket_id()];
+    struct rte_mbuf *frags[IPFRAG_MAX_OUT];
+    struct ether_hdr eth;
+    uint16_t mtu = conf->dev->mtu;
+    uint16_t id;
+    int32_t n, i;
+    int v6;
+
+    if (likely(pkt->pkt_len <= mtu + sizeof(struct ether_hdr))) {
+        netif_tx_buffer(conf, pkt);
+        return;
+    }
+
+    id = lc->ip_id++;
+    v6 = netif_pkt_is_ipv6(pkt);
+    rte_memcpy(&eth, rte_pktmbuf_mtod(pkt, void *), sizeof(eth));
+    rte_pktmbuf_adj(pkt, sizeof(eth));
+    /* fragment data but the last is a multiple of 8 bytes */
+    if (v6) {
+        mtu = sizeof(struct ipv6_hdr) + sizeof(struct ipv6_extension_fragment) + RTE_ALIGN_FLOOR(
+            mtu - sizeof(struct ipv6_hdr) - sizeof(struct ipv6_extension_fragment), 8);
+        n = rte_ipv6_fragment_packet(pkt, frags, IPFRAG_MAX_OUT, mtu, pkt->pool, indirect_pool);
+    } else {
+        struct ipv4_hdr *ip4 = rte_pktmbuf_mtod(pkt, struct ipv4_hdr *);
+
+        mtu = sizeof(struct ipv4_hdr) + RTE_ALIGN_FLOOR(mtu - sizeof(struct ipv4_hdr), 8);
+        /* the DF bit of the query does not apply */
+        ip4->fragment_offset = 0;
+        ip4->packet_id = rte_cpu_to_be_16(id);
+        n = rte_ipv4_fragment_packet(pkt, frags, IPFRAG_MAX_OUT, mtu, pkt->pool, indirect_pool);
+    }
+    rte_pktmbuf_free(pkt);
+    if (n < 0) {
+        conf->stats.frag_snd_err++;
+        return;
+    }
+
+    for (i = 0; i < n; i++) {
+        struct rte_mbuf *f = frags[i];
+        struct ether_hdr *eth_hdr = (struct ether_hdr *)rte_pktmbuf_prepend(f, sizeof(eth));
+
+        rte_memcpy(eth_hdr, &eth, sizeof(eth));
+        f->l2_len = sizeof(eth);
+        f->ol_flags = 0;
+        if (v6) {
+            struct ipv6_extension_fragment *fh = (struct ipv6_extension_fragment *)
+                ((struct ipv6_hdr *)(eth_hdr + 1) + 1);
+
+            fh->id = rte_cpu_to_be_32(id);
+        } else {
+            struct ipv4_hdr *ip4 = (struct ipv4_hdr *)(eth_hdr + 1);
+
+            f->l3_len = sizeof(struct ipv4_hdr);
+            if (conf->dev->tx_ip_cksum)
+                f->ol_flags = PKT_TX_IPV4 | PKT_TX_IP_CKSUM;
+            else
+                ip4->hdr_checksum = rte_ipv4_cksum(ip4);
+        }
+        netif_tx_buffer(conf, f);
+    }
+    conf->stats.frag_snd += n;
+}
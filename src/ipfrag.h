@@ -0,0 +1,18 @@
+#ifndef __IPFRAG_H__
+#define __IPFRAG_H__
+
+#include <stdint.h>
+#include "netdev.h"
+
+/* fragments of one answer, enough for EDNS_MAX_MESSAGE_LEN at the smallest MTU */
+#define IPFRAG_MAX_OUT  8
+
+void ipfrag_init(void);
+int ipfrag_lcore_init(unsigned lcore_id);
+
+struct rte_mbuf *ipfrag_reassemble(struct netif_queue_conf *conf, struct rte_mbuf *pkt);
+void ipfrag_flush(void);
+
+void ipfrag_tx_answer(struct netif_queue_conf *conf, struct rte_mbuf *pkt);
+
+#endif
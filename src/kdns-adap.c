@@ -1,8 +1,15 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE     /* pthread_setname_np */
+#endif
 #include <rte_ethdev.h>
 #include <rte_mbuf.h>
+#include <rte_malloc.h>
+#include <rte_memcpy.h>
+#include <rte_ring.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <signal.h>
+#include <pthread.h>
 
 #include "kdns-adap.h"
 #include "kdns.h"
@@ -10,11 +17,14 @@
 #include "query.h"
 #include "dns-conf.h"
 #include "db_update.h"
+#include "view.h"
+#include "slab.h"
 
 #define MAX_CORES 64
-#define EDNS_MAX_MESSAGE_LEN 4096
 
 static struct query *queries[MAX_CORES];
+/* EDNS answers that may not fit in the query mbuf are built here */
+static uint8_t *answer_bufs[MAX_CORES];
 struct kdns dpdk_dns[MAX_CORES];
 
 extern void domain_store_zones_check_create(struct kdns*  kdns, char *zones);
@@ -29,11 +39,57 @@ static int dnsdata_prepare(struct kdns * kdns) {
     domain_store_zones_check_create( kdns,g_dns_cfg->comm.zones);
 
     kdns_zones_soa_create( kdns->db,g_dns_cfg->comm.zones);
+
+    kdns_views_prepare(kdns);
     return 0;
 }
 
+#define FREEZE_RING_SIZE    128
+
+enum {
+    FREEZE_IDLE,
+    FREEZE_BUILDING,    /* the freeze thread reads the stores, the lcore holds its updates */
+    FREEZE_DONE,
+};
+
+/* a rebuild of the frozen indexes of an lcore, by the freeze thread */
+struct index_freeze {
+    unsigned lcore_id;
+    int state;
+    struct radcompact *built[MAX_VIEWS];    /* 0 the default store, then the views */
+};
+
+static struct index_freeze index_freezes[MAX_CORES];
+static struct rte_ring *freeze_ring;
+/* the socket of the lcore whose index the freeze thread builds */
+static __thread int freeze_socket = SOCKET_ID_ANY;
+
+static void *frozen_index_alloc(size_t size) {
+    return rte_malloc_socket("frozen_index", size, RTE_CACHE_LINE_SIZE, freeze_socket);
+}
+
+/* slab chunks come from hugepages of the socket the updating lcore runs on */
+static void *slab_chunk_alloc(size_t size) {
+    return rte_malloc_socket("slab", size, RTE_CACHE_LINE_SIZE, rte_socket_id());
+}
+
+/* the query of an lcore, from hugepages of its socket */
+static void *query_alloc(size_t size) {
+    return rte_zmalloc_socket("query", size, RTE_CACHE_LINE_SIZE, rte_socket_id());
+}
+
 static int  kdns_query_init(unsigned lcore_id,struct kdns * kdns) {
-    queries[lcore_id] = query_create();
+    answer_bufs[lcore_id] = rte_malloc_socket("answer_buf", EDNS_MAX_MESSAGE_LEN, RTE_CACHE_LINE_SIZE,
+        rte_lcore_to_socket_id(lcore_id));
+    if (answer_bufs[lcore_id] == NULL) {
+        log_msg(LOG_ERR, "cannot alloc the answer buffer of lcore %u\n", lcore_id);
+        exit(-1);
+    }
+    queries[lcore_id] = query_create_in(query_alloc, answer_bufs[lcore_id], EDNS_MAX_MESSAGE_LEN);
+    if (queries[lcore_id] == NULL) {
+        log_msg(LOG_ERR, "cannot alloc the query of lcore %u\n", lcore_id);
+        exit(-1);
+    }
     return 1;
 }
 
@@ -106,6 +162,8 @@ int kdns_init(unsigned lcore_id) {
 
     struct kdns * lcore_kdns = &dpdk_dns[lcore_id]; 
     memset(lcore_kdns, 0, sizeof(struct kdns));
+    radcompact_set_allocator(frozen_index_alloc, rte_free);
+    slab_set_backend(slab_chunk_alloc, rte_free);
     if (dnsdata_prepare(lcore_kdns) != 0) {
         log_msg(LOG_ERR,"server preparation failed,could not be started");
         return -1;
@@ -117,9 +175,88 @@ int kdns_init(unsigned lcore_id) {
 
 
 
-kdns_query_st * dns_packet_proess(struct rte_mbuf *pkt , int offset, int received) {
+static struct domain_store *kdns_freeze_store(struct kdns *kdns, int i) {
+    return i == 0 ? kdns->db : kdns->views[i];
+}
+
+static void *index_freeze_loop(__attribute__((unused)) void *arg) {
+    struct index_freeze *f;
+    struct domain_store *db;
+    int i;
+
+    while (1) {
+        if (rte_ring_sc_dequeue(freeze_ring, (void **)&f) != 0) {
+            usleep(1000);
+            continue;
+        }
+        freeze_socket = rte_lcore_to_socket_id(f->lcore_id);
+        for (i = 0; i < MAX_VIEWS; i++) {
+            db = kdns_freeze_store(&dpdk_dns[f->lcore_id], i);
+            f->built[i] = (db && domain_store_freeze_needed(db)) ? domain_store_freeze_build(db) : NULL;
+        }
+        __atomic_store_n(&f->state, FREEZE_DONE, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+/* the thread inherits the cpus of the master */
+void kdns_index_freeze_init(void) {
+    pthread_t tid;
+
+    freeze_ring = rte_ring_create("index_freeze_ring", FREEZE_RING_SIZE, rte_socket_id(), RING_F_SC_DEQ);
+    if (freeze_ring == NULL) {
+        log_msg(LOG_ERR, "cannot create the index freeze ring\n");
+        exit(-1);
+    }
+    if (pthread_create(&tid, NULL, index_freeze_loop, NULL) != 0) {
+        log_msg(LOG_ERR, "cannot start the index freeze thread\n");
+        exit(-1);
+    }
+    pthread_setname_np(tid, "index-freeze");
+}
+
+int kdns_index_freeze_start(unsigned lcore_id) {
+    struct index_freeze *f = &index_freezes[lcore_id];
+    struct kdns *kdns = &dpdk_dns[lcore_id];
+    int i;
+
+    for (i = 0; i < MAX_VIEWS; i++) {
+        if (kdns_freeze_store(kdns, i) && domain_store_freeze_needed(kdns_freeze_store(kdns, i)))
+            break;
+    }
+    if (i == MAX_VIEWS)
+        return 0;
+    f->lcore_id = lcore_id;
+    f->state = FREEZE_BUILDING;
+    if (rte_ring_mp_enqueue(freeze_ring, f) != 0) {
+        f->state = FREEZE_IDLE;
+        return -1;
+    }
+    return 0;
+}
+
+int kdns_index_freeze_busy(unsigned lcore_id) {
+    struct index_freeze *f = &index_freezes[lcore_id];
+    struct kdns *kdns = &dpdk_dns[lcore_id];
+    int i;
+
+    if (f->state == FREEZE_IDLE)
+        return 0;
+    if (__atomic_load_n(&f->state, __ATOMIC_ACQUIRE) != FREEZE_DONE)
+        return 1;
+    /* a failed build keeps the old index, it is still right for the names it marks */
+    for (i = 0; i < MAX_VIEWS; i++) {
+        if (f->built[i])
+            domain_store_freeze_install(kdns_freeze_store(kdns, i), f->built[i]);
+    }
+    f->state = FREEZE_IDLE;
+    return 0;
+}
+
+kdns_query_st * dns_packet_proess(struct rte_mbuf *pkt , int offset, int received, uint8_t view_id) {
     unsigned lcore_id = rte_lcore_id();
     char *rdata = NULL;
+    size_t room;
 
     kdns_query_st *query = queries[lcore_id];
 
@@ -128,9 +265,18 @@ kdns_query_st * dns_packet_proess(struct rte_mbuf *pkt , int offset, int receive
     }
 
     query_reset(query);
+    query->view_id = view_id;
 
     rdata = rte_pktmbuf_mtod_offset(pkt, char *, offset);
+    room = pkt->buf_len - pkt->data_off - offset;
+    /* only a query with an additional section may ask for more */
+    if (unlikely(edns_udp_size > room) && received >= DNS_HEAD_SIZE && (rdata[10] | rdata[11])) {
+        rte_memcpy(answer_bufs[lcore_id], rdata, received);
+        rdata = (char *)answer_bufs[lcore_id];
+        room = EDNS_MAX_MESSAGE_LEN;
+    }
     query->packet->data = (uint8_t *)rdata;
+    query->packet->limit = query->packet->capacity = room;
     query->packet->position += received;
     buffer_flip(query->packet);
 
@@ -5,10 +5,18 @@
 #include "kdns.h"
 #include "util.h"
 
+struct rte_mbuf;
+
 
 int kdns_init(unsigned lcore_id);
 
-kdns_query_st* dns_packet_proess(struct rte_mbuf *pkt , int offset, int received); 
+kdns_query_st* dns_packet_proess(struct rte_mbuf *pkt , int offset, int received, uint8_t view_id);
+/* start the thread that builds the frozen name indexes of the lcores */
+void kdns_index_freeze_init(void);
+/* on the lcore: have its stale indexes rebuilt, -1 if the request was not queued */
+int kdns_index_freeze_start(unsigned lcore_id);
+/* on the lcore: 1 while its stores are read by a build, installs the result once done */
+int kdns_index_freeze_busy(unsigned lcore_id);
 int check_pid(const char *pid_file);
 void write_pid(const char *pid_file);
 void kdns_zones_soa_create(struct  domain_store *db,char * zonesName);
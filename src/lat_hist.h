@@ -0,0 +1,72 @@
+#ifndef __LAT_HIST_H__
+#define __LAT_HIST_H__
+
+#include <stdint.h>
+
+/*
+ * Latency histogram in microseconds: values below 4 have their own bucket,
+ * above that every power of two is split in 4 buckets (25% resolution) up to
+ * about 16 s. No DPDK code, the benchmark tools use it too.
+ */
+#define LAT_HIST_BUCKETS    96
+
+struct lat_hist {
+    uint64_t count;
+    uint64_t max;
+    uint64_t buckets[LAT_HIST_BUCKETS];
+};
+
+static inline unsigned lat_hist_bucket(uint64_t us) {
+    unsigned o, b;
+
+    if (us < 4)
+        return (unsigned)us;
+    o = 63 - __builtin_clzll(us);
+    b = (o - 1) * 4 + ((us >> (o - 2)) & 3);
+    return b < LAT_HIST_BUCKETS ? b : LAT_HIST_BUCKETS - 1;
+}
+
+/* largest value that falls in bucket b */
+static inline uint64_t lat_hist_bucket_max(unsigned b) {
+    unsigned o = b / 4 + 1;
+
+    if (b < 4)
+        return b;
+    return ((uint64_t)(4 + b % 4) << (o - 2)) + ((uint64_t)1 << (o - 2)) - 1;
+}
+
+static inline void lat_hist_add(struct lat_hist *h, uint64_t us) {
+    h->count++;
+    h->buckets[lat_hist_bucket(us)]++;
+    if (us > h->max)
+        h->max = us;
+}
+
+/* for a histogram several threads add to */
+static inline void lat_hist_add_shared(struct lat_hist *h, uint64_t us) {
+    uint64_t max = h->max;
+
+    __sync_fetch_and_add(&h->count, 1);
+    __sync_fetch_and_add(&h->buckets[lat_hist_bucket(us)], 1);
+    while (us > max && !__sync_bool_compare_and_swap(&h->max, max, us))
+        max = h->max;
+}
+
+/* upper bound of the p quantile (0 < p <= 1), never above the largest value seen */
+static inline uint64_t lat_hist_quantile(const struct lat_hist *h, double p) {
+    uint64_t rank = (uint64_t)(p * h->count + 0.999999), seen = 0, v;
+    unsigned b;
+
+    if (h->count == 0)
+        return 0;
+    for (b = 0; b < LAT_HIST_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen >= rank) {
+            v = lat_hist_bucket_max(b);
+            return v < h->max ? v : h->max;
+        }
+    }
+    return h->max;
+}
+
+#endif
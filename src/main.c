@@ -18,6 +18,11 @@
 #include "util.h"
 #include "forward.h"
 #include "domain_update.h" 
+#include "rrl.h"
+#include "ipfrag.h"
+#include "idle.h"
+#include "view.h"
+#include "bench.h"
 
 #define VERSION "0.2.1"
 #define DEFAULT_CONF_FILEPATH "/etc/kdns/kdns.cfg"
@@ -26,6 +31,7 @@
 
 static  char *dns_cfgfile;
 static  char *dns_procname;
+static  int dns_bench;
 
 static char *
 parse_progname(char *arg) {
@@ -42,15 +48,17 @@ parse_args(int argc, char *argv[]) {
     for (i = 1; i < argc; i++) {
         if (strncmp(argv[i], "--conf=", 7) == 0) {
             dns_cfgfile = strdup(argv[i] + 7);
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            dns_bench = 1;
         } else if (strcmp(argv[i], "--version") == 0) {
             printf("Version: %s\n", VERSION);
             exit(0);
         }
         else if (strcmp(argv[i], "--help") == 0) {
-            printf("usage: [--conf=%s] [--version] [--help]\n",DEFAULT_CONF_FILEPATH);
+            printf("usage: [--conf=%s] [--bench] [--version] [--help]\n",DEFAULT_CONF_FILEPATH);
             exit(0);
         }else {   
-            printf("usage: [--conf=%s] [--version] [--help]\n",DEFAULT_CONF_FILEPATH);
+            printf("usage: [--conf=%s] [--bench] [--version] [--help]\n",DEFAULT_CONF_FILEPATH);
             exit(0);
         }
     }
@@ -115,6 +123,22 @@ static void init_signals(void)
 }
 
 
+/* on the lcore, so that its domain store comes from the memory of its socket */
+static int kdns_lcore_init(__attribute__((unused)) void *arg)
+{
+    unsigned lcore_id = rte_lcore_id();
+
+    if (kdns_init(lcore_id) < 0) {
+        return -1;
+    }
+    if (dns_bench) {
+        bench_store_load(lcore_id);
+    }
+    log_msg(LOG_INFO, "numa: lcore %u built its domain store on socket %u\n", lcore_id, rte_socket_id());
+    return 0;
+}
+
+
 int  main(int argc, char **argv)
 { 
     dns_procname = parse_progname(argv[0]);
@@ -126,17 +150,28 @@ int  main(int argc, char **argv)
     write_pid(PIDFILE);
     
     config_file_load(dns_cfgfile,dns_procname);
+    g_dns_cfg->bench.enable = dns_bench;
     
     log_open(g_dns_cfg->comm.log_file);
     
     dns_dpdk_init();
+
+    rrl_init();
+    ipfrag_init();
+    idle_init();
+    view_init();
+    edns_udp_size = g_dns_cfg->comm.edns_udp_size;
     
     unsigned lcore_id = rte_lcore_id();
 
     remote_sock_init(g_dns_cfg->comm.fwd_addrs,g_dns_cfg->comm.fwd_def_addrs,g_dns_cfg->comm.fwd_threads);
+    if (g_dns_cfg->comm.index_freeze_delay) {
+        kdns_index_freeze_init();
+    }
 
 
     netif_queue_core_bind();
+    netif_numa_report();
 
    // struct sigaction action;
 	/* Setup the signal handling... */
@@ -145,15 +180,32 @@ int  main(int argc, char **argv)
     
 
     RTE_LCORE_FOREACH_SLAVE(lcore_id) {     
-        if(kdns_init(lcore_id) < 0){
+        rte_eal_remote_launch(kdns_lcore_init, NULL, lcore_id);
+        if (rte_eal_wait_lcore(lcore_id) < 0) {
             log_msg(LOG_ERR, "Error:kdns_init lcore_id =%d\n",lcore_id); 
             exit(-1);
         }
+        if (rrl_lcore_init(lcore_id) < 0) {
+            exit(-1);
+        }
+        if (ipfrag_lcore_init(lcore_id) < 0) {
+            exit(-1);
+        }
+        if (idle_lcore_init(lcore_id, 1) < 0) {
+            exit(-1);
+        }
         rte_eal_remote_launch(process_slave, NULL, lcore_id);
     }
 
 
+    if (dns_bench) {
+        bench_run();
+    }
+
     dns_tcp_process_init(g_dns_cfg->netdev.kni_vip);
+    if (idle_lcore_init(rte_get_master_lcore(), 0) < 0) {
+        exit(-1);
+    }
 
     process_master(NULL);
 
@@ -11,33 +11,31 @@
 #include "rte_mbuf.h"
 #include "rte_ethdev.h"
 #include "rte_kni.h"
+#include "rte_malloc.h"
+#include "rte_flow.h"
 #include <rte_ip.h>
 #include <rte_udp.h>
+#include <arpa/inet.h>
 #include "netdev.h"
 #include "dns-conf.h"
 #include "util.h"
 #include "process.h"
+#include "exception.h"
+#include "bench.h"
 
 
-#define KNI_ENET_HEADER_SIZE    14
-/* Total octets in the FCS */
-#define KNI_ENET_FCS_SIZE       4
-
 #define KNI_RING_SIZE     65536
 
-#define KNI_DEF_MBUF_SIZE       2048
-
 #define MBUF_CACHE_DEF    256
 
-struct rte_kni  *master_kni;
-
+/* rx mbufs of the lcores of each socket, pkt_mbuf_pool is the one of the master */
+static struct rte_mempool *pkt_mbuf_pools[RTE_MAX_NUMA_NODES];
 struct rte_mempool *pkt_mbuf_pool;
 
-struct rte_mempool *kni_mbuf_pool;
-
-struct rte_ring *master_kni_pkt_ring;
+struct net_device  kdns_net_device[NETDEV_MAX_PORTS];
+uint16_t kdns_net_device_num;
 
-struct net_device  kdns_net_device ={0};
+static struct netif_lcore_conf kdns_lcore_conf[RTE_MAX_LCORE];
 static  int rss_enable = 0;
 
 
@@ -78,33 +76,6 @@ static struct rte_eth_conf port_conf_rss = {
 };
 
 
-static int kni_config_network_interface(uint8_t port_id, uint8_t if_up)
-{
-	int ret = 0;
-    return 0 ;
-
-	if (port_id >= rte_eth_dev_count() || port_id >= RTE_MAX_ETHPORTS) {
-		log_msg(LOG_ERR,"Invalid port id %d\n", port_id);
-		return -EINVAL;
-	}
-
-	log_msg(LOG_INFO,"Configure network interface of %d %s\n",
-					port_id, if_up ? "up" : "down");
-
-	if (if_up != 0) { /* Configure network interface up */
-		rte_eth_dev_stop(port_id);
-		ret = rte_eth_dev_start(port_id);
-	} else /* Configure network interface down */
-		rte_eth_dev_stop(port_id);
-
-	if (ret < 0)
-		log_msg(LOG_ERR,"Failed to start port %d\n", port_id);
-
-	return ret;
-}
-
-
-
 /* Check the link status of all ports in up to 9s, and print them finally */
 static void check_all_ports_link_status(uint8_t port_num, uint32_t port_mask)
 {
@@ -159,99 +130,36 @@ static void check_all_ports_link_status(uint8_t port_num, uint32_t port_mask)
 	}
 }
 
-static int kni_change_mtu(uint8_t port_id, unsigned new_mtu)
+int netif_dev_close(struct net_device *dev)
 {
-	int ret;
-	struct rte_eth_conf conf;
-    return 0 ;
-
-	if (port_id >= rte_eth_dev_count()) {
-		log_msg(LOG_ERR, "Invalid port id %d\n", port_id);
-		return -EINVAL;
-	}
-
-	log_msg(LOG_INFO, "Change MTU of port %d to %u\n", port_id, new_mtu);
-
-	/* Stop specific port */
-	rte_eth_dev_stop(port_id);
-    if ( strcmp(g_dns_cfg->netdev.mode,"rss") == 0 ){
-        rss_enable = 1;
-        memcpy(&conf, &port_conf_rss, sizeof(conf));
-    }else{
-    	memcpy(&conf, &port_conf, sizeof(conf));
-    }
-
-	/* Set new MTU */
-	if (new_mtu > ETHER_MAX_LEN)
-		conf.rxmode.jumbo_frame = 1;
-	else
-		conf.rxmode.jumbo_frame = 0;
-
-	/* mtu + length of header + length of FCS = max pkt length */
-	conf.rxmode.max_rx_pkt_len = new_mtu + KNI_ENET_HEADER_SIZE +
-							KNI_ENET_FCS_SIZE;
-	ret = rte_eth_dev_configure(port_id, 1, 1, &conf);
-	if (ret < 0) {
-		log_msg(LOG_ERR, "Fail to reconfigure port %d\n", port_id);
-		return ret;
-	}
-
-	/* Restart specific port */
-	ret = rte_eth_dev_start(port_id);
-	if (ret < 0) {
-		log_msg(LOG_ERR,"Fail to restart port %d\n", port_id);
-		return ret;
-	}
-
+	exc_backend_close(dev);
+	if (dev->flow_steering)
+		rte_flow_flush(dev->port_id, NULL);
+	rte_eth_dev_stop(dev->port_id);
 	return 0;
 }
-static int kni_alloc(uint8_t port_id)
-{
-	struct rte_kni_conf conf;
-    
-    struct rte_kni_ops ops;
-	struct rte_eth_dev_info dev_info;
-
-	/* Clear conf at first */
-	memset(&conf, 0, sizeof(conf));
-    
-	conf.core_id = 0;
-    conf.force_bind = 1;
-    conf.mbuf_size = KNI_DEF_MBUF_SIZE;
-    conf.group_id = (uint16_t)0;
-    snprintf(conf.name, sizeof(conf.name),"%s",g_dns_cfg->netdev.name_prefix);
 
-	memset(&dev_info, 0, sizeof(dev_info));
-	rte_eth_dev_info_get(port_id, &dev_info);
-	conf.addr = dev_info.pci_dev->addr;
-	conf.id = dev_info.pci_dev->id;
-
-	memset(&ops, 0, sizeof(ops));
-	ops.port_id = port_id;
-	ops.change_mtu = kni_change_mtu;
-	ops.config_network_if = kni_config_network_interface;
 
-	master_kni = rte_kni_alloc(kni_mbuf_pool, &conf, &ops);
+/* the lcore using queue q of a port, handed out like netif_queue_core_bind does */
+static unsigned netif_queue_lcore(uint16_t q, int tx)
+{
+    unsigned lcore_id, n = tx && rss_enable ? 1 : 0;
 
-	if (!master_kni){
-        log_msg(LOG_ERR,"Fail to create kni for port: %d\n", port_id);
-		exit(-1);
+    RTE_LCORE_FOREACH_SLAVE(lcore_id) {
+        if (n++ == q)
+            return lcore_id;
     }
-	return 0;
+    /* the exception queue and tx queue 0 */
+    return rte_get_master_lcore();
 }
 
-int kni_free_kni(uint8_t port_id)
-{
-    if (rte_kni_release(master_kni))
-		log_msg(LOG_ERR,"Fail to release kni\n");	
-	rte_eth_dev_stop(port_id);
-	return 0;
-}
-
-
 /* Initialise a single port on an Ethernet device */
-static void init_port(uint8_t port,uint16_t rx_rings, uint16_t tx_rings)
+static void init_port(struct net_device *dev,uint16_t rx_rings, uint16_t tx_rings)
 {
+	uint8_t port = dev->port_id;
+	struct rte_eth_dev_info dev_info;
+	struct rte_eth_txconf txconf;
+	unsigned socket;
 	int ret,q;
 
 	/* Initialise device and RX/TX queues */
@@ -265,6 +173,8 @@ static void init_port(uint8_t port,uint16_t rx_rings, uint16_t tx_rings)
     }else{
     	memcpy(&conf, &port_conf, sizeof(conf));
     } 
+	/* idle lcores sleep until their queues raise an interrupt */
+	conf.intr_conf.rxq = g_dns_cfg->idle.enable && g_dns_cfg->idle.rx_intr && g_dns_cfg->idle.sleep_us > 0;
 	ret = rte_eth_dev_configure(port, rx_rings, tx_rings, &conf);
 	if (ret < 0){
 		log_msg(LOG_ERR, "Could not configure port%u (%d)\n",
@@ -272,20 +182,35 @@ static void init_port(uint8_t port,uint16_t rx_rings, uint16_t tx_rings)
         exit(-1);
     }
 
-	/* Allocate and set up 1 RX queue per Ethernet port. */
+	/* each queue and its mbufs on the socket of the lcore using it */
 	for (q = 0; q < rx_rings; q++) {
+		socket = rte_lcore_to_socket_id(netif_queue_lcore(q, 0));
 		ret = rte_eth_rx_queue_setup(port, q, g_dns_cfg->netdev.rxq_desc_num,
-				rte_eth_dev_socket_id(port), NULL, pkt_mbuf_pool);
+				socket, NULL, pkt_mbuf_pools[socket]);
 		if (ret < 0){
             log_msg(LOG_ERR,"rte_eth_rx_queue_setup err\n");
 			 exit(-1);
         }
 	}
 
+	/* answer checksums are offloaded where the PMD offers it */
+	memset(&dev_info, 0, sizeof(dev_info));
+	rte_eth_dev_info_get(port, &dev_info);
+	dev->tx_ip_cksum = !!(dev_info.tx_offload_capa & DEV_TX_OFFLOAD_IPV4_CKSUM);
+	dev->tx_udp_cksum = !!(dev_info.tx_offload_capa & DEV_TX_OFFLOAD_UDP_CKSUM);
+	txconf = dev_info.default_txconf;
+	if (dev->tx_ip_cksum || dev->tx_udp_cksum)
+		txconf.txq_flags &= ~ETH_TXQ_FLAGS_NOXSUMUDP;
+	/* IP fragments are a header mbuf chained to the answer data */
+	if (g_dns_cfg->comm.edns_udp_size + UDP6_DATA_OFFSET > g_dns_cfg->netdev.mtu + sizeof(struct ether_hdr))
+		txconf.txq_flags &= ~ETH_TXQ_FLAGS_NOMULTSEGS;
+	log_msg(LOG_INFO, "port %u checksum offload: ipv4 %s udp %s\n", (unsigned)port,
+		dev->tx_ip_cksum ? "on" : "off", dev->tx_udp_cksum ? "on" : "off");
+
 	/* Allocate and set up 1 TX queue per Ethernet port. */
 	for (q = 0; q < tx_rings; q++) {
 		ret = rte_eth_tx_queue_setup(port, q,  g_dns_cfg->netdev.txq_desc_num,
-				rte_eth_dev_socket_id(port), NULL);
+				rte_lcore_to_socket_id(netif_queue_lcore(q, 1)), &txconf);
 		if (ret < 0){
             log_msg(LOG_ERR,"rte_eth_tx_queue_setup err\n");
 			exit(-1);
@@ -303,9 +228,128 @@ static void init_port(uint8_t port,uint16_t rx_rings, uint16_t tx_rings)
     
 }
 
+/*
+ * Install the steering rules: UDP/53 to the VIP and UDP/53 over IPv6 are
+ * spread over the first dns_queues rx queues by RSS, anything else goes to
+ * exception_queue.
+ * Returns -1 with no rule left behind when the PMD does not take them.
+ */
+static int netif_flow_init(struct net_device *dev, uint16_t dns_queues, uint16_t exception_queue)
+{
+    struct rte_flow_attr attr;
+    struct rte_flow_item_ipv4 ip_spec, ip_mask;
+    struct rte_flow_item_ipv6 ip6_spec, ip6_mask;
+    struct rte_flow_item_udp udp_spec, udp_mask;
+    struct rte_flow_item pattern[4];
+    struct rte_flow_action actions[2];
+    struct rte_flow_action_queue queue;
+    struct rte_flow_action_rss *rss;
+    struct rte_flow_error err;
+    struct in_addr vip;
+    uint16_t q;
+
+    memset(&ip_spec, 0, sizeof(ip_spec));
+    memset(&ip_mask, 0, sizeof(ip_mask));
+    if (g_dns_cfg->netdev.kni_vip && inet_pton(AF_INET, g_dns_cfg->netdev.kni_vip, &vip) == 1) {
+        ip_spec.hdr.dst_addr = vip.s_addr;
+        ip_mask.hdr.dst_addr = 0xffffffff;
+    }
+    memset(&udp_spec, 0, sizeof(udp_spec));
+    memset(&udp_mask, 0, sizeof(udp_mask));
+    udp_spec.hdr.dst_port = UDP_PORT_53;
+    udp_mask.hdr.dst_port = 0xffff;
+
+    memset(pattern, 0, sizeof(pattern));
+    pattern[0].type = RTE_FLOW_ITEM_TYPE_ETH;
+    pattern[1].type = RTE_FLOW_ITEM_TYPE_IPV4;
+    pattern[1].spec = &ip_spec;
+    pattern[1].mask = &ip_mask;
+    pattern[2].type = RTE_FLOW_ITEM_TYPE_UDP;
+    pattern[2].spec = &udp_spec;
+    pattern[2].mask = &udp_mask;
+    pattern[3].type = RTE_FLOW_ITEM_TYPE_END;
+
+    /* kept for the life of the rule, some PMDs refer to it */
+    rss = rte_zmalloc("flow_rss", sizeof(*rss) + dns_queues * sizeof(uint16_t), 0);
+    if (rss == NULL) {
+        return -1;
+    }
+    rss->rss_conf = &port_conf_rss.rx_adv_conf.rss_conf;
+    rss->num = dns_queues;
+    for (q = 0; q < dns_queues; q++)
+        rss->queue[q] = q;
+
+    memset(actions, 0, sizeof(actions));
+    actions[0].type = RTE_FLOW_ACTION_TYPE_RSS;
+    actions[0].conf = rss;
+    actions[1].type = RTE_FLOW_ACTION_TYPE_END;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.ingress = 1;
+    attr.priority = 0;
+    memset(&err, 0, sizeof(err));
+    dev->dns_flow = rte_flow_create(dev->port_id, &attr, pattern, actions, &err);
+    if (dev->dns_flow == NULL) {
+        log_msg(LOG_ERR, "port %u: cannot steer dns traffic: %s\n", dev->port_id,
+            err.message ? err.message : "unknown error");
+        rte_free(rss);
+        return -1;
+    }
+
+    memset(&ip6_spec, 0, sizeof(ip6_spec));
+    memset(&ip6_mask, 0, sizeof(ip6_mask));
+    pattern[1].type = RTE_FLOW_ITEM_TYPE_IPV6;
+    pattern[1].spec = &ip6_spec;
+    pattern[1].mask = &ip6_mask;
+    memset(&err, 0, sizeof(err));
+    dev->dns6_flow = rte_flow_create(dev->port_id, &attr, pattern, actions, &err);
+    if (dev->dns6_flow == NULL) {
+        log_msg(LOG_ERR, "port %u: cannot steer ipv6 dns traffic: %s\n", dev->port_id,
+            err.message ? err.message : "unknown error");
+        rte_flow_destroy(dev->port_id, dev->dns_flow, NULL);
+        dev->dns_flow = NULL;
+        rte_free(rss);
+        return -1;
+    }
+
+    /* lower priority catch all */
+    pattern[1].type = RTE_FLOW_ITEM_TYPE_END;
+    queue.index = exception_queue;
+    actions[0].type = RTE_FLOW_ACTION_TYPE_QUEUE;
+    actions[0].conf = &queue;
+    attr.priority = 1;
+    memset(&err, 0, sizeof(err));
+    dev->exception_flow = rte_flow_create(dev->port_id, &attr, pattern, actions, &err);
+    if (dev->exception_flow == NULL) {
+        log_msg(LOG_ERR, "port %u: cannot steer exception traffic: %s\n", dev->port_id,
+            err.message ? err.message : "unknown error");
+        rte_flow_destroy(dev->port_id, dev->dns6_flow, NULL);
+        rte_flow_destroy(dev->port_id, dev->dns_flow, NULL);
+        dev->dns6_flow = NULL;
+        dev->dns_flow = NULL;
+        rte_free(rss);
+        return -1;
+    }
+    return 0;
+}
+
+/* the exception queue of the port is polled by the master on tx queue 0 */
+static void netif_exception_conf_init(struct net_device *dev, uint16_t rx_queue_id)
+{
+    struct netif_queue_conf *conf = &dev->exception_conf;
+
+    memset(conf, 0, sizeof(struct netif_queue_conf));
+    conf->dev = dev;
+    conf->port_id = dev->port_id;
+    conf->rx_queue_id = rx_queue_id;
+    conf->tx_queue_id = 0;
+    dev->flow_steering = 1;
+    log_msg(LOG_INFO, "port %u: flow steering on, exception rxqueue %u\n", dev->port_id, rx_queue_id);
+}
+
 void dns_kni_enqueue(struct netif_queue_conf *conf,struct rte_mbuf **mbufs,uint16_t rx_len){
     int i =0;
-    int res = rte_ring_enqueue_bulk(master_kni_pkt_ring, (void *const * )mbufs, rx_len);
+    int res = rte_ring_enqueue_bulk(conf->dev->kni_ring, (void *const * )mbufs, rx_len);
     if (res) {
         if (res == -EDQUOT) {
             log_msg(LOG_ERR,"rte_ring_enqueue_bulk err\n ");
@@ -320,12 +364,12 @@ void dns_kni_enqueue(struct netif_queue_conf *conf,struct rte_mbuf **mbufs,uint1
     }
 }
 
-uint16_t dns_kni_dequeue(struct rte_mbuf **mbufs,uint16_t pkts_len){
+uint16_t dns_kni_dequeue(struct net_device *dev,struct rte_mbuf **mbufs,uint16_t pkts_len){
 
    while (pkts_len > 0 &&
-				unlikely(rte_ring_dequeue_bulk(master_kni_pkt_ring, (void ** )mbufs,
+				unlikely(rte_ring_dequeue_bulk(dev->kni_ring, (void ** )mbufs,
 					pkts_len) != 0))
-			pkts_len = (uint16_t)RTE_MIN(rte_ring_count(master_kni_pkt_ring),pkts_len);
+			pkts_len = (uint16_t)RTE_MIN(rte_ring_count(dev->kni_ring),pkts_len);
    
    return pkts_len;
 }
@@ -371,9 +415,89 @@ flowtype_to_str(uint16_t flow_type)
 }
 
 
+static void port_flow_types_log(uint16_t port_id){
+    struct rte_eth_dev_info dev_info;
+    char *p;
+    int i;
+
+    memset(&dev_info, 0, sizeof(dev_info));
+    rte_eth_dev_info_get(port_id, &dev_info);
+
+    log_msg(LOG_INFO,"port %u flow_type_rss_offloads = %ld\n",port_id,dev_info.flow_type_rss_offloads);
+
+    log_msg(LOG_INFO,"Supported flow types:\n");
+    for (i = RTE_ETH_FLOW_UNKNOWN + 1; i < RTE_ETH_FLOW_MAX;
+                            i++) {
+        if (!(dev_info.flow_type_rss_offloads & (1ULL << i)))
+            continue;
+        p = flowtype_to_str(i);
+        log_msg(LOG_INFO,"  %s\n", (p ? p : "unknown"));
+    }
+}
+
+
+/* mbuf-num mbufs on each socket with an lcore */
+static void netif_mbuf_pools_create(void)
+{
+    char name[RTE_MEMPOOL_NAMESIZE];
+    unsigned lcore_id, socket;
+
+    RTE_LCORE_FOREACH(lcore_id) {
+        socket = rte_lcore_to_socket_id(lcore_id);
+        if (pkt_mbuf_pools[socket] != NULL)
+            continue;
+        snprintf(name, sizeof(name), "mbuf_pool_s%u", socket);
+        pkt_mbuf_pools[socket] = rte_pktmbuf_pool_create(name, g_dns_cfg->netdev.mbuf_num,
+                MBUF_CACHE_DEF, 0, RTE_MBUF_DEFAULT_BUF_SIZE, socket);
+        if (pkt_mbuf_pools[socket] == NULL) {
+            log_msg(LOG_ERR, "Could not initialise mbuf pool on socket %u\n", socket);
+            exit(-1);
+        }
+    }
+    pkt_mbuf_pool = pkt_mbuf_pools[rte_socket_id()];
+}
+
+/*
+ * Where the packet path lives: the socket of each port and of the queues,
+ * mbufs, tx buffers and answer rings of each lcore using it.
+ */
+void netif_numa_report(void)
+{
+    struct netif_lcore_conf *lconf;
+    struct netif_queue_conf *conf;
+    unsigned lcore_id, socket;
+    uint16_t i;
+    int port_socket;
+
+    for (i = 0; i < kdns_net_device_num; i++) {
+        port_socket = rte_eth_dev_socket_id(kdns_net_device[i].port_id);
+        log_msg(LOG_INFO, "numa: port %u on socket %d\n", kdns_net_device[i].port_id, port_socket);
+    }
+    for (socket = 0; socket < RTE_MAX_NUMA_NODES; socket++) {
+        if (pkt_mbuf_pools[socket])
+            log_msg(LOG_INFO, "numa: %s %u mbufs on socket %u\n", pkt_mbuf_pools[socket]->name,
+                pkt_mbuf_pools[socket]->size, socket);
+    }
+    RTE_LCORE_FOREACH_SLAVE(lcore_id) {
+        socket = rte_lcore_to_socket_id(lcore_id);
+        lconf = &kdns_lcore_conf[lcore_id];
+        for (i = 0; i < lconf->nb_queues; i++) {
+            conf = lconf->queues[i];
+            log_msg(LOG_INFO, "numa: lcore %u on socket %u polls port %u rxq %u txq %u with %s\n",
+                lcore_id, socket, conf->port_id, conf->rx_queue_id, conf->tx_queue_id,
+                pkt_mbuf_pools[socket]->name);
+            /* SOCKET_ID_ANY when the PMD does not know */
+            port_socket = rte_eth_dev_socket_id(conf->port_id);
+            if (port_socket >= 0 && (unsigned)port_socket != socket)
+                log_msg(LOG_ERR, "numa: lcore %u reaches port %u across sockets\n", lcore_id, conf->port_id);
+        }
+    }
+}
+
 void dns_dpdk_init(void){
     
     char *dpdk_argv[g_dns_cfg->dpdk.argc];
+    uint32_t port_mask = 0;
     int i;
 
     for (i = 0; i < g_dns_cfg->dpdk.argc; i++) {
@@ -385,65 +509,64 @@ void dns_dpdk_init(void){
     }
     uint8_t nb_sys_ports;
 
-    pkt_mbuf_pool = rte_pktmbuf_pool_create("mbuf_pool", g_dns_cfg->netdev.mbuf_num,
-                MBUF_CACHE_DEF, 0, RTE_MBUF_DEFAULT_BUF_SIZE, rte_socket_id());
-    if (pkt_mbuf_pool == NULL) {
-        log_msg(LOG_ERR, "Could not initialise mbuf pool\n");
-        exit(-1);
-    }
+    netif_mbuf_pools_create();
 
-    kni_mbuf_pool = rte_pktmbuf_pool_create("kni_mbuf_pool", g_dns_cfg->netdev.kni_mbuf_num,
-                MBUF_CACHE_DEF, 0, RTE_MBUF_DEFAULT_BUF_SIZE, rte_socket_id());
-    if (!kni_mbuf_pool){
-        log_msg(LOG_ERR, "Fail to create pktmbuf_pool for kni.");
-        exit(-1);
-    }
+    if (g_dns_cfg->bench.enable)
+        bench_port_create();
 
-    master_kni_pkt_ring = rte_ring_create("master_kni_pkt_ring", KNI_RING_SIZE, rte_socket_id(), RING_F_SC_DEQ);
-
-    if (master_kni_pkt_ring == NULL){
-        log_msg(LOG_ERR, "Could not initialise ring buf \n");
-        exit(-1);
-    }
-    
         /* Get number of ports found in scan */
     nb_sys_ports = rte_eth_dev_count();
     if (nb_sys_ports == 0){
         log_msg(LOG_ERR, "No supported Ethernet device found\n");
         exit(-1);
     }
-    
-    if (nb_sys_ports != 1){
-        log_msg(LOG_ERR, "now just one port supported\n");
-        exit(-1);
-    }
 
-    rte_kni_init(nb_sys_ports);
-    
-    init_port(0,g_dns_cfg->netdev.rxq_num,g_dns_cfg->netdev.txq_num);
-    kni_alloc(0);
+    kdns_net_device_num = g_dns_cfg->netdev.port_num;
+    /* the benchmark serves a ring port and has no exception path */
+    if (!g_dns_cfg->bench.enable)
+        exc_backend_init(kdns_net_device_num);
 
-    check_all_ports_link_status(nb_sys_ports, 1);
+    for (i = 0; i < kdns_net_device_num; i++) {
+        struct net_device *dev = &kdns_net_device[i];
+        char ring_name[RTE_RING_NAMESIZE];
 
-    struct rte_eth_dev_info dev_info;
- 
-	memset(&dev_info, 0, sizeof(dev_info));
-	rte_eth_dev_info_get(0, &dev_info);
-    
-    log_msg(LOG_INFO,"flow_type_rss_offloads = %ld\n",dev_info.flow_type_rss_offloads);
-
-	log_msg(LOG_INFO,"Supported flow types:\n");
-	char *p;
-	for (i = RTE_ETH_FLOW_UNKNOWN + 1; i < RTE_ETH_FLOW_MAX;
-							i++) {
-		if (!(dev_info.flow_type_rss_offloads & (1ULL << i)))
-			continue;
-		p = flowtype_to_str(i);
-		log_msg(LOG_INFO,"  %s\n", (p ? p : "unknown"));
-	}
-                            
-    rte_eth_macaddr_get(0, &kdns_net_device.hwaddr);
+        dev->port_id = g_dns_cfg->netdev.ports[i];
+        if (dev->port_id >= nb_sys_ports || (port_mask & (1 << dev->port_id))) {
+            log_msg(LOG_ERR, "Invalid or repeated port %u, %u ports found\n",
+                dev->port_id, nb_sys_ports);
+            exit(-1);
+        }
+        port_mask |= 1 << dev->port_id;
+        dev->mtu = g_dns_cfg->netdev.mtu;
+
+        snprintf(ring_name, sizeof(ring_name), "kni_pkt_ring_%u", dev->port_id);
+        dev->kni_ring = rte_ring_create(ring_name, KNI_RING_SIZE, rte_socket_id(), RING_F_SC_DEQ);
+        if (dev->kni_ring == NULL){
+            log_msg(LOG_ERR, "Could not initialise ring buf \n");
+            exit(-1);
+        }
 
+        /* steering takes one more rx queue, without the rules the port is
+           brought up again the plain way and the lcores classify in software */
+        if (g_dns_cfg->netdev.flow_steering && strcmp(g_dns_cfg->netdev.mode, "rss") == 0) {
+            init_port(dev, g_dns_cfg->netdev.rxq_num + 1, g_dns_cfg->netdev.txq_num);
+            if (netif_flow_init(dev, g_dns_cfg->netdev.rxq_num, g_dns_cfg->netdev.rxq_num) == 0) {
+                netif_exception_conf_init(dev, g_dns_cfg->netdev.rxq_num);
+            } else {
+                log_msg(LOG_ERR, "port %u: no flow steering, using the software path\n", dev->port_id);
+                rte_eth_dev_stop(dev->port_id);
+                init_port(dev, g_dns_cfg->netdev.rxq_num, g_dns_cfg->netdev.txq_num);
+            }
+        } else {
+            init_port(dev, g_dns_cfg->netdev.rxq_num, g_dns_cfg->netdev.txq_num);
+        }
+        if (!g_dns_cfg->bench.enable)
+            exc_backend_open(dev);
+        rte_eth_macaddr_get(dev->port_id, &dev->hwaddr);
+        port_flow_types_log(dev->port_id);
+    }
+
+    check_all_ports_link_status(nb_sys_ports, port_mask);
 }
 
 
@@ -457,6 +580,8 @@ void dns_dpdk_init(void){
         packet_l3_handle(pkt,conf);
         break;
     case ETHER_TYPE_IPv6:
+        packet_ipv6_handle(pkt,conf);
+        break;
     default:
         conf->kni_mbufs[conf->kni_len]= pkt;
         conf->kni_len ++;
@@ -466,67 +591,106 @@ void dns_dpdk_init(void){
  }
     
     
- static void netif_queue_conf_init(uint16_t lcore_id, uint16_t port_id,uint16_t rx_queue_id,uint16_t tx_queue_id)
+ static void netif_queue_conf_init(uint16_t lcore_id, struct net_device *dev,uint16_t rx_queue_id,uint16_t tx_queue_id)
  {
+     struct netif_queue_conf *conf = &dev->l_netif_queue_conf[lcore_id];
+     struct netif_lcore_conf *lconf = &kdns_lcore_conf[lcore_id];
+
      log_msg(LOG_INFO,"core queue info: coreId(%d) portID(%d) rxQueueId(%d) txQueueId(%d)\n",
-        lcore_id,port_id,rx_queue_id,tx_queue_id);
-     memset(&kdns_net_device.l_netif_queue_conf[lcore_id],0,sizeof(struct netif_queue_conf));
-     kdns_net_device.l_netif_queue_conf[lcore_id].port_id = port_id;
-     kdns_net_device.l_netif_queue_conf[lcore_id].rx_queue_id = rx_queue_id;
-     kdns_net_device.l_netif_queue_conf[lcore_id].tx_queue_id = tx_queue_id;
+        lcore_id,dev->port_id,rx_queue_id,tx_queue_id);
+     memset(conf,0,sizeof(struct netif_queue_conf));
+     conf->dev = dev;
+     conf->port_id = dev->port_id;
+     conf->rx_queue_id = rx_queue_id;
+     conf->tx_queue_id = tx_queue_id;
+
+     conf->tx_buffer = rte_zmalloc_socket("tx_buffer", RTE_ETH_TX_BUFFER_SIZE(NETIF_MAX_PKT_BURST),
+        0, rte_lcore_to_socket_id(lcore_id));
+     if (conf->tx_buffer == NULL) {
+        log_msg(LOG_ERR, "Cannot alloc tx buffer for lcore %u port %u\n", lcore_id, dev->port_id);
+        exit(-1);
+     }
+     rte_eth_tx_buffer_init(conf->tx_buffer, NETIF_MAX_PKT_BURST);
+     /* packets the full tx ring did not take are freed and counted */
+     rte_eth_tx_buffer_set_err_callback(conf->tx_buffer, rte_eth_tx_buffer_count_callback,
+        &conf->stats.pkt_tx_full);
+     lconf->queues[lconf->nb_queues++] = conf;
  }
 
+/* every slave lcore polls the same rx/tx queue pair on each port */
 void netif_queue_core_bind(void)
 {
     int rx_id =0;
     int tx_id =0;
+    uint16_t i;
     if (rss_enable)
         tx_id = 1; 
     unsigned lcore_id;
     RTE_LCORE_FOREACH_SLAVE(lcore_id) {     
-        netif_queue_conf_init(lcore_id,0,rx_id,tx_id);
+        if (rx_id >= g_dns_cfg->netdev.rxq_num || tx_id >= g_dns_cfg->netdev.txq_num) {
+            log_msg(LOG_ERR, "No queue left for lcore %u: rxqueue-num %u txqueue-num %u\n",
+                lcore_id, g_dns_cfg->netdev.rxq_num, g_dns_cfg->netdev.txq_num);
+            exit(-1);
+        }
+        for (i = 0; i < kdns_net_device_num; i++)
+            netif_queue_conf_init(lcore_id,&kdns_net_device[i],rx_id,tx_id);
         rx_id++;
         tx_id++;
     }
 }
 
     
-struct netif_queue_conf* netif_queue_conf_get(uint16_t lcore_id){
-    return &kdns_net_device.l_netif_queue_conf[lcore_id];   
+struct netif_lcore_conf* netif_lcore_conf_get(uint16_t lcore_id){
+    return &kdns_lcore_conf[lcore_id];   
+}
+
+void netif_stats_add(struct netif_queue_stats *sum, const struct netif_queue_stats *sta){
+    sum->pkts_rcv     +=  sta->pkts_rcv;
+    sum->pkts_2kni    +=  sta->pkts_2kni;
+    sum->pkts_icmp    +=  sta->pkts_icmp;
+    sum->dns_pkts_rcv +=  sta->dns_pkts_rcv;
+    sum->dns6_pkts_rcv +=  sta->dns6_pkts_rcv;
+    sum->dns_pkts_snd +=  sta->dns_pkts_snd;
+    sum->dns_lens_rcv +=  sta->dns_lens_rcv;
+    sum->dns_lens_snd +=  sta->dns_lens_snd;
+    sum->pkt_dropped  +=  sta->pkt_dropped;
+    sum->pkt_len_err  +=  sta->pkt_len_err;
+    sum->pkt_tx_full  +=  sta->pkt_tx_full;
+    sum->frag_rcv     +=  sta->frag_rcv;
+    sum->frag_reassembled +=  sta->frag_reassembled;
+    sum->frag_dropped +=  sta->frag_dropped;
+    sum->frag_snd     +=  sta->frag_snd;
+    sum->frag_snd_err +=  sta->frag_snd_err;
+    sum->rrl_answer_limited   +=  sta->rrl_answer_limited;
+    sum->rrl_nxdomain_limited +=  sta->rrl_nxdomain_limited;
+    sum->rrl_fwd_limited      +=  sta->rrl_fwd_limited;
+    sum->rrl_dropped  +=  sta->rrl_dropped;
+    sum->rrl_slipped  +=  sta->rrl_slipped;
+    sum->rrl_evicted  +=  sta->rrl_evicted;
 }
 
 void netif_statsdata_get(struct netif_queue_stats *sta){
     unsigned lcore_id;
-    struct netif_queue_stats *sta_lcore;
+    uint16_t i;
     RTE_LCORE_FOREACH_SLAVE(lcore_id) {  
-        sta_lcore = &kdns_net_device.l_netif_queue_conf[lcore_id].stats;
-        sta->pkts_rcv     +=  sta_lcore->pkts_rcv;
-        sta->pkts_2kni    +=  sta_lcore->pkts_2kni;
-        sta->pkts_icmp     +=  sta_lcore->pkts_icmp;
-        sta->dns_pkts_rcv +=  sta_lcore->dns_pkts_rcv;
-        sta->dns_pkts_snd +=  sta_lcore->dns_pkts_snd;
-        sta->dns_lens_rcv +=  sta_lcore->dns_lens_rcv;
-        sta->dns_lens_snd +=  sta_lcore->dns_lens_snd;
-        sta->pkt_dropped      +=  sta_lcore->pkt_dropped;
-        sta->pkt_len_err  +=  sta_lcore->pkt_len_err;
+        for (i = 0; i < kdns_net_device_num; i++)
+            netif_stats_add(sta, &kdns_net_device[i].l_netif_queue_conf[lcore_id].stats);
     }  
+    for (i = 0; i < kdns_net_device_num; i++)
+        netif_stats_add(sta, &kdns_net_device[i].exception_conf.stats);
     return;
 }
 
 void netif_statsdata_reset(void){
     unsigned lcore_id;
-    struct netif_queue_stats *sta_lcore;
-    RTE_LCORE_FOREACH_SLAVE(lcore_id) {  
-        sta_lcore = &kdns_net_device.l_netif_queue_conf[lcore_id].stats;
-        sta_lcore->pkts_rcv     = 0;
-        sta_lcore->pkts_2kni    = 0 ;
-        sta_lcore->pkts_icmp     = 0 ;
-        sta_lcore->dns_pkts_rcv = 0 ;
-        sta_lcore->dns_pkts_snd = 0 ;
-        sta_lcore->dns_lens_rcv = 0 ;
-        sta_lcore->dns_lens_snd = 0 ;
-        sta_lcore->pkt_dropped  = 0 ;
-        sta_lcore->pkt_len_err  = 0 ;
+    uint16_t i;
+    for (i = 0; i < kdns_net_device_num; i++) {
+        RTE_LCORE_FOREACH_SLAVE(lcore_id) {  
+            memset(&kdns_net_device[i].l_netif_queue_conf[lcore_id].stats, 0,
+                sizeof(struct netif_queue_stats));
+        }
+        memset(&kdns_net_device[i].exception_conf.stats, 0, sizeof(struct netif_queue_stats));
+        rte_eth_stats_reset(kdns_net_device[i].port_id);
     }  
     return;
 }
@@ -534,67 +698,137 @@ void netif_statsdata_reset(void){
 
 
 
-void init_eth_header(struct ether_hdr *eth_hdr, struct ether_addr *src_mac, \
-    struct ether_addr *dst_mac, uint16_t ether_type)
+/* RFC 1624 update of a checksum for one 16 bit word changing from old to new */
+static inline uint16_t cksum_update16(uint16_t cksum, uint16_t old, uint16_t new)
 {
-    ether_addr_copy(dst_mac, &eth_hdr->d_addr);
-    ether_addr_copy(src_mac, &eth_hdr->s_addr);
+    uint32_t sum = (uint16_t)~cksum + (uint16_t)~old + new;
 
-    eth_hdr->ether_type = rte_cpu_to_be_16(ether_type);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return (uint16_t)~sum;
 }
 
-uint16_t init_ipv4_header(struct ipv4_hdr *ip_hdr, uint32_t src_addr,
-    uint32_t dst_addr, uint16_t pktdata_len)
+/* UDP checksum over the segments from l4_off on, phdr is the pseudo header sum */
+static uint16_t udp_cksum_segs(const struct rte_mbuf *pkt, uint32_t l4_off, uint16_t phdr)
 {
-    uint16_t pkt_len;
-    unaligned_uint16_t *ptr16;
-    uint32_t ip_cksum;
-
-    pkt_len = (uint16_t) (pktdata_len + sizeof(struct ipv4_hdr));
-
-    ip_hdr->version_ihl   = IP_VHL_DEF;
-    ip_hdr->type_of_service   = 0;
-    ip_hdr->fragment_offset = 0;
-    ip_hdr->time_to_live   = IP_DEFTTL;
-    ip_hdr->next_proto_id = IPPROTO_UDP;
-    ip_hdr->packet_id = 0;
-    ip_hdr->total_length   = rte_cpu_to_be_16(pkt_len);
-    ip_hdr->src_addr = src_addr;
-    ip_hdr->dst_addr = dst_addr;
-
-    ptr16 = (unaligned_uint16_t *)ip_hdr;
-    ip_cksum = 0;
-    ip_cksum += ptr16[0]; ip_cksum += ptr16[1];
-    ip_cksum += ptr16[2]; ip_cksum += ptr16[3];
-    ip_cksum += ptr16[4];
-    ip_cksum += ptr16[6]; ip_cksum += ptr16[7];
-    ip_cksum += ptr16[8]; ip_cksum += ptr16[9];
-
-
-    ip_cksum = ((ip_cksum & 0xFFFF0000) >> 16) +
-        (ip_cksum & 0x0000FFFF);
-    ip_cksum %= 65536;
-    ip_cksum = (~ip_cksum) & 0x0000FFFF;
-    if (ip_cksum == 0)
-        ip_cksum = 0xFFFF;
-    ip_hdr->hdr_checksum = (uint16_t) ip_cksum;
-
-    return pkt_len;
+    uint16_t raw;
+    uint32_t sum;
+
+    rte_raw_cksum_mbuf(pkt, l4_off, pkt->pkt_len - l4_off, &raw);
+    sum = (uint32_t)raw + phdr;
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (~sum) & 0xffff;
+    return sum == 0 ? 0xffff : (uint16_t)sum;
 }
 
-
-uint16_t init_udp_header(struct udp_hdr *udp_hdr, uint16_t src_port,
-    uint16_t dst_port, uint16_t pktdata_len)
+/*
+ * Turn the UDP/IPv4 query in pkt into its answer of data_len bytes at
+ * UDP4_DATA_OFFSET: addresses and ports are swapped in place, the lengths
+ * and TTL rewritten, and the checksums left to the port if it offers to,
+ * else updated incrementally (IPv4) or computed (UDP). The data may go on
+ * in more segments, and the UDP checksum of an answer longer than the MTU
+ * is computed as the port only sees its fragments.
+ */
+void netif_udp4_reply(struct net_device *dev, struct rte_mbuf *pkt, uint16_t data_len)
 {
-    uint16_t pkt_len;
-
-    pkt_len = (uint16_t) (pktdata_len + sizeof(struct udp_hdr));
-
-    udp_hdr->src_port = src_port;
-    udp_hdr->dst_port = dst_port;
-    udp_hdr->dgram_len = rte_cpu_to_be_16(pkt_len);
-    udp_hdr->dgram_cksum = 0; 
+    struct ether_hdr *eth_hdr = rte_pktmbuf_mtod(pkt, struct ether_hdr *);
+    struct ipv4_hdr *ip_hdr = (struct ipv4_hdr *)(eth_hdr + 1);
+    struct udp_hdr *udp_hdr = (struct udp_hdr *)(ip_hdr + 1);
+    unaligned_uint16_t *ttl_proto = (unaligned_uint16_t *)&ip_hdr->time_to_live;
+    uint16_t ip_len = rte_cpu_to_be_16(data_len + sizeof(struct udp_hdr) + sizeof(struct ipv4_hdr));
+    uint16_t old, cksum;
+    struct ether_addr mac;
+    uint32_t addr;
+    uint16_t port;
+
+    ether_addr_copy(&eth_hdr->s_addr, &mac);
+    ether_addr_copy(&eth_hdr->d_addr, &eth_hdr->s_addr);
+    ether_addr_copy(&mac, &eth_hdr->d_addr);
+
+    addr = ip_hdr->src_addr;
+    ip_hdr->src_addr = ip_hdr->dst_addr;
+    ip_hdr->dst_addr = addr;
+    port = udp_hdr->src_port;
+    udp_hdr->src_port = udp_hdr->dst_port;
+    udp_hdr->dst_port = port;
+    udp_hdr->dgram_len = rte_cpu_to_be_16(data_len + sizeof(struct udp_hdr));
+
+    pkt->pkt_len = data_len + UDP4_DATA_OFFSET;
+    if (pkt->nb_segs == 1)
+        pkt->data_len = pkt->pkt_len;
+    pkt->l2_len = sizeof(struct ether_hdr);
+    pkt->l3_len = sizeof(struct ipv4_hdr);
+    pkt->ol_flags = 0;
+
+    /* the address swap leaves the sum of the header unchanged */
+    if (dev->tx_ip_cksum) {
+        ip_hdr->total_length = ip_len;
+        ip_hdr->time_to_live = IP_DEFTTL;
+        ip_hdr->hdr_checksum = 0;
+        pkt->ol_flags |= PKT_TX_IPV4 | PKT_TX_IP_CKSUM;
+    } else {
+        old = ip_hdr->total_length;
+        ip_hdr->total_length = ip_len;
+        cksum = cksum_update16(ip_hdr->hdr_checksum, old, ip_len);
+        old = *ttl_proto;
+        ip_hdr->time_to_live = IP_DEFTTL;
+        ip_hdr->hdr_checksum = cksum_update16(cksum, old, *ttl_proto);
+    }
 
-    return pkt_len;
+    if (dev->tx_udp_cksum && pkt->pkt_len <= dev->mtu + sizeof(struct ether_hdr)) {
+        pkt->ol_flags |= PKT_TX_IPV4 | PKT_TX_UDP_CKSUM;
+        udp_hdr->dgram_cksum = rte_ipv4_phdr_cksum(ip_hdr, pkt->ol_flags);
+    } else if (pkt->nb_segs == 1) {
+        udp_hdr->dgram_cksum = 0;
+        udp_hdr->dgram_cksum = rte_ipv4_udptcp_cksum(ip_hdr, udp_hdr);
+    } else {
+        udp_hdr->dgram_cksum = 0;
+        udp_hdr->dgram_cksum = udp_cksum_segs(pkt, UDP4_DATA_OFFSET - sizeof(struct udp_hdr),
+            rte_ipv4_phdr_cksum(ip_hdr, 0));
+    }
 }
 
+/* the same for a UDP/IPv6 query at UDP6_DATA_OFFSET, whose UDP checksum is mandatory */
+void netif_udp6_reply(struct net_device *dev, struct rte_mbuf *pkt, uint16_t data_len)
+{
+    struct ether_hdr *eth_hdr = rte_pktmbuf_mtod(pkt, struct ether_hdr *);
+    struct ipv6_hdr *ip_hdr = (struct ipv6_hdr *)(eth_hdr + 1);
+    struct udp_hdr *udp_hdr = (struct udp_hdr *)(ip_hdr + 1);
+    uint16_t udp_len = rte_cpu_to_be_16(data_len + sizeof(struct udp_hdr));
+    struct ether_addr mac;
+    uint8_t addr[16];
+    uint16_t port;
+
+    ether_addr_copy(&eth_hdr->s_addr, &mac);
+    ether_addr_copy(&eth_hdr->d_addr, &eth_hdr->s_addr);
+    ether_addr_copy(&mac, &eth_hdr->d_addr);
+
+    memcpy(addr, ip_hdr->src_addr, sizeof(addr));
+    memcpy(ip_hdr->src_addr, ip_hdr->dst_addr, sizeof(addr));
+    memcpy(ip_hdr->dst_addr, addr, sizeof(addr));
+    ip_hdr->payload_len = udp_len;
+    ip_hdr->hop_limits = IP_DEFTTL;
+    port = udp_hdr->src_port;
+    udp_hdr->src_port = udp_hdr->dst_port;
+    udp_hdr->dst_port = port;
+    udp_hdr->dgram_len = udp_len;
+
+    pkt->pkt_len = data_len + UDP6_DATA_OFFSET;
+    if (pkt->nb_segs == 1)
+        pkt->data_len = pkt->pkt_len;
+    pkt->l2_len = sizeof(struct ether_hdr);
+    pkt->l3_len = sizeof(struct ipv6_hdr);
+    pkt->ol_flags = 0;
+
+    if (dev->tx_udp_cksum && pkt->pkt_len <= dev->mtu + sizeof(struct ether_hdr)) {
+        pkt->ol_flags |= PKT_TX_IPV6 | PKT_TX_UDP_CKSUM;
+        udp_hdr->dgram_cksum = rte_ipv6_phdr_cksum(ip_hdr, pkt->ol_flags);
+    } else if (pkt->nb_segs == 1) {
+        udp_hdr->dgram_cksum = 0;
+        udp_hdr->dgram_cksum = rte_ipv6_udptcp_cksum(ip_hdr, udp_hdr);
+    } else {
+        udp_hdr->dgram_cksum = 0;
+        udp_hdr->dgram_cksum = udp_cksum_segs(pkt, UDP6_DATA_OFFSET - sizeof(struct udp_hdr),
+            rte_ipv6_phdr_cksum(ip_hdr, 0));
+    }
+}
@@ -6,6 +6,12 @@
 #include <rte_mempool.h>
 #include <rte_udp.h>
 #include <rte_ip.h>
+#include <rte_ethdev.h>
+#include <rte_kni.h>
+#include <rte_ring.h>
+
+#include "dns-conf.h"
+#include "exception.h"
 
 
 #define NETIF_MAX_PKT_BURST         32
@@ -16,6 +22,11 @@
 #define IP_HDRLEN  0x05 /* default IP header length == five 32-bits words. */
 #define IP_VHL_DEF (IP_VERSION | IP_HDRLEN)
 
+/* offset of the DNS message in a UDP/IPv4 frame without IP options */
+#define UDP4_DATA_OFFSET  (sizeof(struct ether_hdr) + sizeof(struct ipv4_hdr) + sizeof(struct udp_hdr))
+/* and in a UDP/IPv6 frame without extension headers */
+#define UDP6_DATA_OFFSET  (sizeof(struct ether_hdr) + sizeof(struct ipv6_hdr) + sizeof(struct udp_hdr))
+
 
 
 struct netif_queue_stats
@@ -25,43 +36,90 @@ struct netif_queue_stats
     uint64_t pkts_icmp; /* Total number of receive pkts to kni */
     
     uint64_t dns_pkts_rcv; /* Total number of successfully received packets. */
+    uint64_t dns6_pkts_rcv; /* the part of them received over IPv6 */
     uint64_t dns_pkts_snd; /* Total number of successfully transmitted packets. */
     uint64_t pkt_dropped; /* Total number of dropped packets by software. */   
     uint64_t pkt_len_err; /* pkt len err. */
+    uint64_t pkt_tx_full; /* dropped because the tx ring was full */
+
+    uint64_t frag_rcv;          /* UDP fragments received */
+    uint64_t frag_reassembled;  /* queries reassembled from them */
+    uint64_t frag_dropped;      /* fragments timed out, over the table or too long */
+    uint64_t frag_snd;          /* fragments of answers longer than the MTU */
+    uint64_t frag_snd_err;      /* such answers dropped, no mbuf left */
 
     uint64_t dns_lens_rcv; /* Total lens of  received packets. */
     uint64_t dns_lens_snd; /* Total lens of  transmitted packets. */
+
+    uint64_t rrl_answer_limited;   /* answers over the source prefix rate */
+    uint64_t rrl_nxdomain_limited; /* nxdomain answers over the source prefix rate */
+    uint64_t rrl_fwd_limited;      /* forwarded queries over the source prefix rate */
+    uint64_t rrl_dropped;          /* limited responses dropped */
+    uint64_t rrl_slipped;          /* limited responses sent truncated */
+    uint64_t rrl_evicted;          /* prefixes that took over the bucket of another */
        
 } __rte_cache_aligned;
 
 
+struct net_device;
+struct rte_flow;
+
 /* RX/TX queue conf for lcore */
 struct netif_queue_conf
 {
+    struct net_device *dev;
     uint16_t port_id;
     uint16_t rx_queue_id;   
     uint16_t tx_queue_id;
     struct netif_queue_stats stats;
-    uint16_t tx_len;
-    struct rte_mbuf *tx_mbufs[NETIF_MAX_PKT_BURST];
+    /* answers wait here until a burst is full or the drain timer fires */
+    struct rte_eth_dev_tx_buffer *tx_buffer;
     
     uint16_t kni_len;
     struct rte_mbuf *kni_mbufs[NETIF_MAX_PKT_BURST];   
 } __rte_cache_aligned;
 
 
+/* a served port, with its KNI and the queues of the slave lcores */
 struct net_device {
-
+    uint16_t port_id;
     uint16_t max_rx_queues;   
     uint16_t max_tx_queues;
     uint16_t max_rx_desc;
     uint16_t max_tx_desc;
     struct ether_addr hwaddr;
+    uint8_t tx_ip_cksum;    /* the PMD computes IPv4 header checksums */
+    uint8_t tx_udp_cksum;   /* the PMD computes UDP checksums */
+    uint16_t mtu;           /* longer answers are fragmented */
+
+    /* exception path to the kernel */
+    const struct exc_backend_ops *exc_ops;
+    struct rte_kni *kni;        /* kni backend */
+    uint8_t exc_port_id;        /* tap and virtio-user backends */
+    struct rte_ring *kni_ring;  /* packets from the lcores to the kernel */
+
+    /* with flow steering the NIC sends UDP/53 to the VIP to the lcore
+       queues and everything else to the exception queue of the master */
+    uint8_t flow_steering;
+    struct rte_flow *dns_flow;
+    struct rte_flow *dns6_flow;
+    struct rte_flow *exception_flow;
+    struct netif_queue_conf exception_conf;
 
     struct netif_queue_conf l_netif_queue_conf[RTE_MAX_LCORE];
 };
 
-//extern struct net_device  kdns_net_device;
+/* queues a slave lcore polls, one on each port */
+struct netif_lcore_conf
+{
+    uint16_t nb_queues;
+    struct netif_queue_conf *queues[NETDEV_MAX_PORTS];
+};
+
+extern struct net_device kdns_net_device[NETDEV_MAX_PORTS];
+extern uint16_t kdns_net_device_num;
+
+void netif_stats_add(struct netif_queue_stats *sum, const struct netif_queue_stats *sta);
 void netif_statsdata_get(struct netif_queue_stats *sta);
 void netif_statsdata_reset(void);
 
@@ -70,19 +128,47 @@ int packet_l2_handle(struct rte_mbuf *pkt, struct netif_queue_conf *conf);
 
 void netif_queue_core_bind(void);
 
-struct netif_queue_conf* netif_queue_conf_get(uint16_t lcore_id);
-void init_eth_header(struct ether_hdr *eth_hdr, struct ether_addr *src_mac, \
-    struct ether_addr *dst_mac, uint16_t ether_type);
-uint16_t init_ipv4_header(struct ipv4_hdr *ip_hdr, uint32_t src_addr,
-    uint32_t dst_addr, uint16_t pktdata_len);
-uint16_t init_udp_header(struct udp_hdr *udp_hdr, uint16_t src_port,
-    uint16_t dst_port, uint16_t pktdata_len);
+struct netif_lcore_conf* netif_lcore_conf_get(uint16_t lcore_id);
+
+static inline void netif_tx_buffer(struct netif_queue_conf *conf, struct rte_mbuf *pkt)
+{
+    conf->stats.dns_pkts_snd += rte_eth_tx_buffer(conf->port_id, conf->tx_queue_id,
+        conf->tx_buffer, pkt);
+}
+
+static inline void netif_tx_flush(struct netif_queue_conf *conf)
+{
+    conf->stats.dns_pkts_snd += rte_eth_tx_buffer_flush(conf->port_id, conf->tx_queue_id,
+        conf->tx_buffer);
+}
+void netif_udp4_reply(struct net_device *dev, struct rte_mbuf *pkt, uint16_t data_len);
+void netif_udp6_reply(struct net_device *dev, struct rte_mbuf *pkt, uint16_t data_len);
+
+static inline int netif_pkt_is_ipv6(struct rte_mbuf *pkt)
+{
+    return rte_pktmbuf_mtod(pkt, struct ether_hdr *)->ether_type == rte_cpu_to_be_16(ETHER_TYPE_IPv6);
+}
+
+/* offset of the DNS message in a query the lcores took, IPv4 or IPv6 */
+static inline uint16_t netif_udp_data_offset(struct rte_mbuf *pkt)
+{
+    return netif_pkt_is_ipv6(pkt) ? UDP6_DATA_OFFSET : UDP4_DATA_OFFSET;
+}
+
+static inline void netif_udp_reply(struct net_device *dev, struct rte_mbuf *pkt, uint16_t data_len)
+{
+    if (netif_pkt_is_ipv6(pkt))
+        netif_udp6_reply(dev, pkt, data_len);
+    else
+        netif_udp4_reply(dev, pkt, data_len);
+}
 
-int kni_free_kni(uint8_t port_id);
+int netif_dev_close(struct net_device *dev);
 
 void dns_kni_enqueue(struct netif_queue_conf *conf,struct rte_mbuf **mbufs,uint16_t rx_len);
-uint16_t dns_kni_dequeue(struct rte_mbuf **mbufs,uint16_t pkts_len);
+uint16_t dns_kni_dequeue(struct net_device *dev,struct rte_mbuf **mbufs,uint16_t pkts_len);
 void dns_dpdk_init(void);
+void netif_numa_report(void);
 
 
 
@@ -6,9 +6,10 @@
 #include <arpa/inet.h>
 #include <rte_byteorder.h>
 #include <rte_ethdev.h>
-#include <rte_kni.h>
 #include <rte_arp.h>
 #include <rte_icmp.h>
+#include <rte_memcpy.h>
+#include <rte_ip_frag.h>
 
 #include "rte_cycles.h"
 
@@ -20,13 +21,17 @@
 #include "netdev.h"
 
 #include "forward.h"
+#include "rrl.h"
+#include "view.h"
 #include "domain_update.h"
+#include "ipfrag.h"
+#include "idle.h"
+#include "service.h"
+#include "hotpath.h"
 
 
 extern struct dns_config *g_dns_cfg;
 extern struct rte_mempool *pkt_mbuf_pool;
-extern struct rte_kni     *master_kni;
-extern struct net_device  kdns_net_device;
 static void packet_icmp_handle(struct rte_mbuf *pkt, struct netif_queue_conf *conf);
 
 #if 0
@@ -48,23 +53,92 @@ static void print_ip(uint32_t sip, uint32_t dip) {
 
 #endif
 
+/*
+ * Put an answer built outside the query mbuf behind the query headers, in
+ * more segments from the pool of the mbuf if it does not fit.
+ */
+static int packet_answer_copy(struct rte_mbuf *pkt, uint16_t data_offset, const uint8_t *data, uint16_t len) {
+    struct rte_mbuf *seg, *last = pkt;
+    uint16_t n = RTE_MIN(len, pkt->buf_len - pkt->data_off - data_offset);
+
+    rte_memcpy(rte_pktmbuf_mtod_offset(pkt, void *, data_offset), data, n);
+    pkt->data_len = data_offset + n;
+    for (data += n, len -= n; len > 0; data += n, len -= n) {
+        seg = rte_pktmbuf_alloc(pkt->pool);
+        if (seg == NULL)
+            return -1;
+        n = RTE_MIN(len, rte_pktmbuf_tailroom(seg));
+        rte_memcpy(rte_pktmbuf_mtod(seg, void *), data, n);
+        seg->data_len = n;
+        last->next = seg;
+        last = seg;
+        pkt->nb_segs++;
+    }
+    return 0;
+}
+
+/*
+ * Answer the UDP query whose DNS message starts at data_offset, from the
+ * client src4 (IPv4) or src6 (IPv6, src4 unused). The answer goes out on the
+ * queue, refused queries are forwarded.
+ */
+static void packet_dns_handle(struct rte_mbuf *pkt, struct netif_queue_conf *conf, uint16_t data_offset,
+        int received, uint8_t view_id, uint32_t src4, const uint8_t *src6) {
+
+    kdns_query_st *query;
+    uint16_t flags_old ;
+    char * bufdata = rte_pktmbuf_mtod_offset(pkt, char*, data_offset);
+
+    conf->stats.dns_pkts_rcv++;
+    conf->stats.dns_lens_rcv += pkt->pkt_len;
+    memcpy(&flags_old,bufdata+2 , 2);
+
+    query = dns_packet_proess(pkt, data_offset, received, view_id);
+    int retLen = buffer_remaining(query->packet);
+
+    if (rrl_enable && retLen > 0) {
+        enum rrl_class cls = rrl_response_class(query);
+        enum rrl_action act = src6 ? rrl_check_v6(conf, src6, cls) : rrl_check_v4(conf, src4, cls);
+        if (act == RRL_ACTION_DROP) {
+            rte_pktmbuf_free(pkt);
+            return;
+        }
+        if (act == RRL_ACTION_SLIP) {
+            retLen = rrl_slip_response(query);
+        }
+    }
+
+    if(GET_RCODE(query->packet) == RCODE_REFUSE ) {
+           memcpy(bufdata + 2, &flags_old, 2);  
+           /* the answer goes out on the served port, not a bond slave */
+           pkt->port = conf->port_id;
+           dns_handle_remote(pkt,GET_ID(query->packet),query->qtype,(char *)domain_name_to_string(query->qname, NULL));
+          return;
+    }
+    if(query != NULL && retLen > 0) {
+        if (query->packet->data != (uint8_t *)bufdata &&
+                packet_answer_copy(pkt, data_offset, query->packet->data, retLen) < 0) {
+            conf->stats.frag_snd_err++;
+            rte_pktmbuf_free(pkt);
+            return;
+        }
+        netif_udp_reply(conf->dev, pkt, retLen);
+        conf->stats.dns_lens_snd += pkt->pkt_len;
+        ipfrag_tx_answer(conf, pkt);
+    } else {
+        rte_pktmbuf_free(pkt);
+    }
+}
+
 int packet_l3_handle(struct rte_mbuf *pkt, struct netif_queue_conf *conf) {
     
-    struct ether_hdr *eth_hdr_in = NULL;
     struct ipv4_hdr  *ip_hdr_in = NULL;
     struct udp_hdr   *udp_hdr_in = NULL; 
     
-    struct ether_hdr tmp_eth_hdr;
-    struct ipv4_hdr  tmp_ipv4_hdr;
-    struct udp_hdr   tmp_udp_hdr;
-    
     uint16_t ether_hdr_offset = sizeof(struct ether_hdr);
     uint16_t ip_hdr_offset    = sizeof(struct ether_hdr) + sizeof(struct ipv4_hdr);
-    uint16_t udp_hdr_offset   = sizeof(struct ether_hdr) + sizeof(struct ipv4_hdr) + sizeof(struct udp_hdr);
    
 
-    kdns_query_st *query;
-    
     ip_hdr_in = rte_pktmbuf_mtod_offset(pkt, struct ipv4_hdr *, ether_hdr_offset);
 
     int ip_headlen           = (ip_hdr_in->version_ihl & 0xF)<<2 ;
@@ -83,11 +157,18 @@ int packet_l3_handle(struct rte_mbuf *pkt, struct netif_queue_conf *conf) {
         printf("pkt_len  err: pkt->pkt_len(%d)< ip_total_length(%d)+ ether_hdr(%d)\n",pkt->pkt_len , ip_total_length,ether_hdr_offset);
         goto cleanup;
     }
-   
+
+    /* UDP fragments are reassembled here, other fragments are the kernel's */
+    if (unlikely(rte_ipv4_frag_pkt_is_fragmented(ip_hdr_in)) && ip_hdr_in->next_proto_id == IPPROTO_UDP) {
+        pkt = ipfrag_reassemble(conf, pkt);
+        if (pkt == NULL)
+            return 0;
+        ip_hdr_in = rte_pktmbuf_mtod_offset(pkt, struct ipv4_hdr *, ether_hdr_offset);
+        ip_total_length = rte_be_to_cpu_16(ip_hdr_in->total_length);
+    }
 
     switch(ip_hdr_in->next_proto_id) {
     case IPPROTO_UDP:
-        eth_hdr_in = rte_pktmbuf_mtod(pkt, struct ether_hdr*);
         udp_hdr_in = rte_pktmbuf_mtod_offset(pkt, struct udp_hdr*, ip_hdr_offset);
         if(ip_total_length != ip_headlen + ntohs(udp_hdr_in->dgram_len)) {
              conf->stats.pkt_len_err++;
@@ -96,45 +177,10 @@ int packet_l3_handle(struct rte_mbuf *pkt, struct netif_queue_conf *conf) {
         }
         
         if(udp_hdr_in->dst_port == UDP_PORT_53) { // port 53
-
-            conf->stats.dns_pkts_rcv++;
-           // printf("rvc len =%d\n",pkt->pkt_len);
-            conf->stats.dns_lens_rcv += pkt->pkt_len;
             int received = rte_be_to_cpu_16(udp_hdr_in->dgram_len) - sizeof(struct udp_hdr);
 
-            uint16_t flags_old ;
-            char * bufdata = rte_pktmbuf_mtod_offset(pkt, char*, udp_hdr_offset);
-            memcpy(&flags_old,bufdata+2 , 2);
-              
-            query = dns_packet_proess(pkt, udp_hdr_offset, received);
-            int retLen = buffer_remaining(query->packet);
-
-            if(GET_RCODE(query->packet) == RCODE_REFUSE ) {
-                   memcpy(bufdata + 2, &flags_old, 2);  
-                   dns_handle_remote(pkt,GET_ID(query->packet),query->qtype,(char *)domain_name_to_string(query->qname, NULL));
-                  return 0;
-            }
-            if(query != NULL && retLen > 0) {
-                init_eth_header(&tmp_eth_hdr, &eth_hdr_in->d_addr, &eth_hdr_in->s_addr, ETHER_TYPE_IPv4);
-                init_ipv4_header(&tmp_ipv4_hdr, ip_hdr_in->dst_addr, ip_hdr_in->src_addr, sizeof(struct udp_hdr) + retLen);
-                init_udp_header(&tmp_udp_hdr, udp_hdr_in->dst_port, udp_hdr_in->src_port, retLen);
-
-                memcpy(eth_hdr_in,&tmp_eth_hdr, sizeof(struct ether_hdr));
-                memcpy(ip_hdr_in,&tmp_ipv4_hdr, sizeof(struct ipv4_hdr));
-                memcpy(udp_hdr_in,&tmp_udp_hdr, sizeof(struct udp_hdr));
-                pkt->pkt_len = retLen + udp_hdr_offset;
-                pkt->data_len = pkt->pkt_len;
-                pkt->l2_len = sizeof(struct ether_hdr);
-                pkt->vlan_tci  = ETHER_TYPE_IPv4;
-                pkt->l3_len = sizeof(struct ipv4_hdr);  
-                char * data = (char *)pkt->buf_addr;
-                
-                conf->tx_mbufs[conf->tx_len] = pkt;
-                conf->tx_len++;
-                conf->stats.dns_lens_snd += pkt->pkt_len;
-               // printf("snd len =%d\n",pkt->pkt_len);
-            }
-            
+            packet_dns_handle(pkt, conf, UDP4_DATA_OFFSET, received,
+                view_lookup_v4(ip_hdr_in->src_addr), ip_hdr_in->src_addr, NULL);
         }else{
             conf->stats.pkt_dropped++;
              rte_pktmbuf_free(pkt);     
@@ -142,8 +188,7 @@ int packet_l3_handle(struct rte_mbuf *pkt, struct netif_queue_conf *conf) {
         return 0;
     case IPPROTO_ICMP:
         packet_icmp_handle(pkt,conf);
-        conf->tx_mbufs[conf->tx_len] = pkt;
-        conf->tx_len++;
+        netif_tx_buffer(conf, pkt);
         return 0;
     default:
         conf->kni_mbufs[conf->kni_len]= pkt;
@@ -157,6 +202,63 @@ cleanup:
     return 0;
 }
 
+/*
+ * UDP/53 over IPv6 without extension headers, or in fragments, is answered
+ * here. ICMPv6, neighbor discovery included, and other extension headers go
+ * to the kernel, which owns the addresses of the port.
+ */
+int packet_ipv6_handle(struct rte_mbuf *pkt, struct netif_queue_conf *conf) {
+    struct ipv6_hdr *ip6_hdr_in;
+    struct udp_hdr  *udp_hdr_in;
+    uint16_t payload_len;
+
+    if (pkt->data_len < sizeof(struct ether_hdr) + sizeof(struct ipv6_hdr)) {
+        conf->stats.pkt_len_err++;
+        goto cleanup;
+    }
+    ip6_hdr_in = rte_pktmbuf_mtod_offset(pkt, struct ipv6_hdr *, sizeof(struct ether_hdr));
+    payload_len = rte_be_to_cpu_16(ip6_hdr_in->payload_len);
+    if (pkt->pkt_len < sizeof(struct ether_hdr) + sizeof(struct ipv6_hdr) + payload_len) {
+        conf->stats.pkt_len_err++;
+        goto cleanup;
+    }
+
+    if (ip6_hdr_in->proto == IPPROTO_FRAGMENT && payload_len >= sizeof(struct ipv6_extension_fragment) &&
+            rte_ipv6_frag_get_ipv6_fragment_header(ip6_hdr_in)->next_header == IPPROTO_UDP) {
+        pkt = ipfrag_reassemble(conf, pkt);
+        if (pkt == NULL)
+            return 0;
+        ip6_hdr_in = rte_pktmbuf_mtod_offset(pkt, struct ipv6_hdr *, sizeof(struct ether_hdr));
+        payload_len = rte_be_to_cpu_16(ip6_hdr_in->payload_len);
+    }
+
+    if (ip6_hdr_in->proto != IPPROTO_UDP) {
+        conf->kni_mbufs[conf->kni_len]= pkt;
+        conf->kni_len ++;
+        return 0;
+    }
+
+    udp_hdr_in = (struct udp_hdr *)(ip6_hdr_in + 1);
+    if (payload_len < sizeof(struct udp_hdr) || pkt->data_len < UDP6_DATA_OFFSET ||
+            rte_be_to_cpu_16(udp_hdr_in->dgram_len) != payload_len) {
+        conf->stats.pkt_len_err++;
+        goto cleanup;
+    }
+    if (udp_hdr_in->dst_port != UDP_PORT_53)
+        goto cleanup;
+
+    /* views are IPv4 prefixes, IPv6 clients see the default view */
+    conf->stats.dns6_pkts_rcv++;
+    packet_dns_handle(pkt, conf, UDP6_DATA_OFFSET, payload_len - sizeof(struct udp_hdr),
+        VIEW_ID_DEFAULT, 0, ip6_hdr_in->src_addr);
+    return 0;
+
+cleanup:
+    conf->stats.pkt_dropped++;
+    rte_pktmbuf_free(pkt);
+    return 0;
+}
+
 #define is_multicast_ipv4_addr(ipv4_addr) \
 	(((rte_be_to_cpu_32((ipv4_addr)) >> 24) & 0x000000FF) == 0xE0)
 
@@ -204,7 +306,7 @@ static void packet_icmp_handle(struct rte_mbuf *pkt, struct netif_queue_conf *co
     	/* Use source MAC address as destination MAC address. */
     	ether_addr_copy(&eth_h->s_addr, &eth_h->d_addr);
     	/* Set source MAC address with MAC address of TX port */
-    	ether_addr_copy(&kdns_net_device.hwaddr,&eth_h->s_addr);
+    	ether_addr_copy(&conf->dev->hwaddr,&eth_h->s_addr);
 
     	arp_h->arp_op = rte_cpu_to_be_16(ARP_OP_REPLY);
 
@@ -251,112 +353,208 @@ static void packet_icmp_handle(struct rte_mbuf *pkt, struct netif_queue_conf *co
 }
 
 
+static uint16_t netif_queue_poll(struct netif_queue_conf *conf) {
+    struct rte_mbuf *mbufs[NETIF_MAX_PKT_BURST];
+    uint16_t rx_count;
+    int t,k;
+
+    rx_count = rte_eth_rx_burst(conf->port_id, conf->rx_queue_id, mbufs, NETIF_MAX_PKT_BURST);
+
+    if (unlikely(rx_count == 0)) {
+       return 0;
+    } 
+    conf->kni_len =0;
+    memset(conf->kni_mbufs,0,sizeof(conf->kni_mbufs));
+
+    /* prefetch packets */
+    for (t = 0; t < rx_count && t < 3; t++)
+         rte_prefetch0(rte_pktmbuf_mtod(mbufs[t], void *));
+    
+    for (k = 0; k < rx_count; k++) {
+            packet_l2_handle(mbufs[k],conf);      
+            if (t < rx_count) {
+                rte_prefetch0(rte_pktmbuf_mtod(mbufs[t], void *));
+                t++;
+            } 
+    }
+    ipfrag_flush();
+    // snd to master
+    if (unlikely(conf->kni_len > 0)){
+        dns_kni_enqueue(conf,conf->kni_mbufs,conf->kni_len);
+    }       
+    return rx_count;
+}
+
+
+/* forwarded answers of this lcore go out on its own queue of the query's port */
+static uint16_t fwd_answers_tx(unsigned lcore_id, struct netif_lcore_conf *lconf) {
+    struct rte_mbuf *pkts[NETIF_MAX_PKT_BURST];
+    uint16_t count = fwd_pkts_dequeue(lcore_id, pkts, NETIF_MAX_PKT_BURST);
+    uint16_t i, q;
+
+    for (i = 0; i < count; i++) {
+        for (q = 0; q < lconf->nb_queues; q++) {
+            if (lconf->queues[q]->port_id == pkts[i]->port)
+                break;
+        }
+        if (unlikely(q == lconf->nb_queues)) {
+            rte_pktmbuf_free(pkts[i]);
+            continue;
+        }
+        netif_udp_reply(lconf->queues[q]->dev, pkts[i], pkts[i]->pkt_len - netif_udp_data_offset(pkts[i]));
+        lconf->queues[q]->stats.dns_lens_snd += pkts[i]->pkt_len;
+        netif_tx_buffer(lconf->queues[q], pkts[i]);
+    }
+    return count;
+}
+
+
 int process_slave(__attribute__((unused)) void *arg) {
     unsigned lcore_id = rte_lcore_id();
-
-    int t,k;
-    struct netif_queue_conf *conf = netif_queue_conf_get(lcore_id);    
-    printf("Starting core %u conf:  rx=%d, tx=%d \n", lcore_id,conf->rx_queue_id,conf->tx_queue_id);
+    struct netif_lcore_conf *lconf = netif_lcore_conf_get(lcore_id);
+    uint64_t drain_tsc = (rte_get_tsc_hz() + US_PER_S - 1) / US_PER_S * g_dns_cfg->netdev.tx_drain_us;
+    uint64_t prev_tsc = rte_rdtsc(), cur_tsc;
+    uint16_t i, nb_rx;
+
+    for (i = 0; i < lconf->nb_queues; i++)
+        printf("Starting core %u conf: port=%d rx=%d, tx=%d \n", lcore_id,lconf->queues[i]->port_id,
+            lconf->queues[i]->rx_queue_id,lconf->queues[i]->tx_queue_id);
     domain_msg_ring_create();
+    idle_lcore_start(lconf);
     
     while (1){
+        /* updates of the domain store allocate, the packets must not */
         doman_msg_slave_process();
-        struct rte_mbuf *mbufs[NETIF_MAX_PKT_BURST] ={0};
-        uint16_t rx_count;
-    
-        rx_count = rte_eth_rx_burst(conf->port_id, conf->rx_queue_id, mbufs, NETIF_MAX_PKT_BURST);
-
-        if (unlikely(rx_count == 0)) {
-           continue;
-        } 
-        conf->tx_len = conf->kni_len =0;
-        memset(conf->tx_mbufs,0,sizeof(conf->tx_mbufs));
-        memset(conf->kni_mbufs,0,sizeof(conf->kni_mbufs));
-
-        /* prefetch packets */
-        for (t = 0; t < rx_count && t < 3; t++)
-             rte_prefetch0(rte_pktmbuf_mtod(mbufs[t], void *));
-        
-        for (k = 0; k < rx_count; k++) {
-                packet_l2_handle(mbufs[k],conf);      
-                if (t < rx_count) {
-                    rte_prefetch0(rte_pktmbuf_mtod(mbufs[t], void *));
-                    t++;
-                } 
-        }
-        // send the pkts
-        if (likely(conf->tx_len >0)){
-               int ntx = rte_eth_tx_burst(conf->port_id,conf->tx_queue_id, conf->tx_mbufs, conf->tx_len);
-               conf->stats.dns_pkts_snd += ntx;
-               if (unlikely(ntx != conf->tx_len)){
-                   printf("  rx =%d tx=%d  real tx =%d\n",rx_count,conf->tx_len,ntx);
-                   int i =0;
-                   for (i = ntx; i < conf->tx_len; i++)
-                       rte_pktmbuf_free(conf->tx_mbufs[i]);
-                   conf->stats.pkt_dropped += ntx;
-               }
+        HOTPATH_ENTER();
+        nb_rx = fwd_answers_tx(lcore_id, lconf);
+        for (i = 0; i < lconf->nb_queues; i++)
+            nb_rx += netif_queue_poll(lconf->queues[i]);
+
+        /* full bursts leave at once, the rest when idle or on the drain timer */
+        cur_tsc = rte_rdtsc();
+        if (nb_rx == 0 || cur_tsc - prev_tsc > drain_tsc) {
+            for (i = 0; i < lconf->nb_queues; i++)
+                netif_tx_flush(lconf->queues[i]);
+            prev_tsc = cur_tsc;
         }
-        // snd to master
-        if (unlikely(conf->kni_len > 0)){
-            dns_kni_enqueue(conf,conf->kni_mbufs,conf->kni_len);
-        }       
+        idle_update(nb_rx);
+        HOTPATH_LEAVE();
     }
     return 0;
 }
 
 
+/* packets of the lcores to the kernel, and what the kernel sends out on tx queue 0 */
+static uint16_t master_kernel_process(struct net_device *dev) {
+    const struct exc_backend_ops *ops = dev->exc_ops;
+    struct rte_mbuf *pkts[NETIF_MAX_PKT_BURST];
+    uint16_t i, nb_rx, nb_tx, nb = 0;
+
+    nb_rx = dns_kni_dequeue(dev, pkts, NETIF_MAX_PKT_BURST);
+    nb += nb_rx;
+    if (nb_rx > 0) {
+        nb_tx = ops->to_kernel(dev, pkts, nb_rx);
+        for (i = nb_tx; i < nb_rx; i++)
+            rte_pktmbuf_free(pkts[i]);
+    }
+
+    if (ops->poll)
+        ops->poll(dev);
+
+    nb_rx = ops->from_kernel(dev, pkts, NETIF_MAX_PKT_BURST);
+    nb += nb_rx;
+    if (nb_rx > 0) {
+        nb_tx = rte_eth_tx_burst(dev->port_id, 0, pkts, nb_rx);
+        for (i = nb_tx; i < nb_rx; i++)
+            rte_pktmbuf_free(pkts[i]);
+    }
+    return nb;
+}
+
+
+/* what the NIC did not steer to the lcores: ICMP is answered, the rest goes to the kernel */
+static uint16_t master_exception_process(struct net_device *dev) {
+    struct netif_queue_conf *conf = &dev->exception_conf;
+    struct rte_mbuf *pkts[NETIF_MAX_PKT_BURST];
+    struct rte_mbuf *icmp_pkts[NETIF_MAX_PKT_BURST];
+    struct ether_hdr *eth_hdr;
+    struct ipv4_hdr *ip_hdr;
+    uint16_t i, nb_rx, nb_icmp = 0, nb_tx;
+
+    nb_rx = rte_eth_rx_burst(conf->port_id, conf->rx_queue_id, pkts, NETIF_MAX_PKT_BURST);
+    if (nb_rx == 0) {
+        return 0;
+    }
+    conf->stats.pkts_rcv += nb_rx;
+    conf->kni_len = 0;
+    for (i = 0; i < nb_rx; i++) {
+        eth_hdr = rte_pktmbuf_mtod(pkts[i], struct ether_hdr *);
+        ip_hdr = (struct ipv4_hdr *)(eth_hdr + 1);
+        if (eth_hdr->ether_type == rte_cpu_to_be_16(ETHER_TYPE_IPv4) &&
+                ip_hdr->next_proto_id == IPPROTO_ICMP) {
+            packet_icmp_handle(pkts[i], conf);
+            icmp_pkts[nb_icmp++] = pkts[i];
+        } else {
+            conf->kni_mbufs[conf->kni_len++] = pkts[i];
+        }
+    }
+
+    if (nb_icmp > 0) {
+        nb_tx = rte_eth_tx_burst(conf->port_id, conf->tx_queue_id, icmp_pkts, nb_icmp);
+        for (i = nb_tx; i < nb_icmp; i++)
+            rte_pktmbuf_free(icmp_pkts[i]);
+        conf->stats.pkt_tx_full += nb_icmp - nb_tx;
+    }
+    if (conf->kni_len > 0) {
+        nb_tx = dev->exc_ops->to_kernel(dev, conf->kni_mbufs, conf->kni_len);
+        for (i = nb_tx; i < conf->kni_len; i++)
+            rte_pktmbuf_free(conf->kni_mbufs[i]);
+        conf->stats.pkts_2kni += nb_tx;
+        conf->stats.pkt_dropped += conf->kni_len - nb_tx;
+    }
+    return nb_rx;
+}
+
+
+/* the kni service: the exception path of every port, at most budget packets */
+static uint32_t master_kni_run(uint32_t budget) {
+    uint32_t nb = 0, n;
+    uint16_t d;
+
+    do {
+        n = 0;
+        for (d = 0; d < kdns_net_device_num; d++) {
+            if (kdns_net_device[d].flow_steering)
+                n += master_exception_process(&kdns_net_device[d]);
+            n += master_kernel_process(&kdns_net_device[d]);
+        }
+        nb += n;
+    } while (n > 0 && nb < budget);
+    return nb;
+}
+
+
+/*
+ * The master runs the services not pinned to a cpu of their own in turn,
+ * and returns when there are none left.
+ */
 void process_master(__attribute__((unused)) void *arg) {
     
      domain_msg_ring_create();
 
      domian_info_exchange_run(g_dns_cfg->comm.web_port);
+    idle_lcore_start(NULL);
 
-    while(1) {
-        struct rte_mbuf *pkts_kni_rx[NETIF_MAX_PKT_BURST];
-        unsigned pkt_num;
-
-        doman_msg_master_process();
-        uint16_t rx_count = dns_kni_dequeue(pkts_kni_rx,NETIF_MAX_PKT_BURST);
-        if (rx_count == 0){
-            rte_kni_tx_burst(master_kni,NULL , 0); 
-           // rte_delay_ms(30);
-        }else{
-            pkt_num = rte_kni_tx_burst(master_kni, pkts_kni_rx, rx_count);          
-            if (unlikely(pkt_num < rx_count)) {
-                int i =0;
-                for(i = pkt_num; i < rx_count; i ++  )
-                    rte_pktmbuf_free(pkts_kni_rx[i]);
-            }
-        }
+    service_register("update", doman_msg_master_process, g_dns_cfg->service.update_budget,
+        g_dns_cfg->service.update_cpu);
+    service_register("kni", master_kni_run, g_dns_cfg->service.kni_budget, g_dns_cfg->service.kni_cpu);
+    service_start();
+    if (service_master_num() == 0)
+        return;
 
-        // kni 
-        rte_kni_handle_request(master_kni);
-
-        struct rte_mbuf *kni_pkts_tx[NETIF_MAX_PKT_BURST];
-        unsigned npkts = rte_kni_rx_burst(master_kni, kni_pkts_tx, NETIF_MAX_PKT_BURST);
-        if(npkts > 0) {
-            uint16_t nb_tx = rte_eth_tx_burst(0, 0, kni_pkts_tx, (uint16_t)npkts);
-            if(nb_tx < npkts){
-                uint16_t i =0;
-                for(i = nb_tx; i < npkts; i++  )
-                    rte_pktmbuf_free(kni_pkts_tx[i]);
-           }
-        }   
-
-        //fwd
-        struct rte_mbuf *fwd_pkts_tx[NETIF_MAX_PKT_BURST];
-        uint16_t fwd_count = fwd_pkts_dequeue(fwd_pkts_tx,NETIF_MAX_PKT_BURST);
-        if (fwd_count != 0){
-            int nb_tx = rte_eth_tx_burst(0, 0, fwd_pkts_tx, (uint16_t)fwd_count);
-            if(nb_tx < fwd_count){
-                int i =0;
-                for(i = nb_tx; i < fwd_count; i ++  )
-                    rte_pktmbuf_free(fwd_pkts_tx[i]);
-           }
-        }
+    while(1) {
+        idle_update(service_master_run() > 0);
     }
     
     return ;
 }
-
-
@@ -0,0 +1,248 @@
+/*
+ * rrl.c -- response rate limiting per client source prefix
+ */
+#include <string.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_lcore.h>
+#include <rte_malloc.h>
+#include <rte_meter.h>
+#include <rte_jhash.h>
+#include <rte_random.h>
+#include <rte_byteorder.h>
+
+#include "rrl.h"
+#include "dns-conf.h"
+#include "util.h"
+
+/* buckets per set, a new prefix takes over the least recently used one */
+#define RRL_WAYS        4
+
+#define RRL_FAMILY_NONE 0
+#define RRL_FAMILY_V4   4
+#define RRL_FAMILY_V6   6
+
+/* one token bucket per response class for a v4 or v6 source prefix */
+struct rrl_bucket {
+    uint32_t key[4];
+    uint8_t  family;
+    uint32_t slip_count;
+    uint64_t last;
+    struct rte_meter_srtcm meters[RRL_CLASS_MAX];
+} __rte_cache_aligned;
+
+struct rrl_table {
+    uint32_t mask;      /* of the sets */
+    struct rrl_bucket buckets[0];
+};
+
+int rrl_enable = 0;
+
+static struct rrl_table *rrl_tables[RTE_MAX_LCORE];
+
+/* random so that prefixes sharing a set cannot be picked from the source */
+static uint32_t rrl_hash_seed;
+
+/* configured meters, the buckets start with them */
+static struct rte_meter_srtcm rrl_meter_tmpl[RRL_CLASS_MAX];
+static uint32_t rrl_rates[RRL_CLASS_MAX];
+
+static uint32_t rrl_v4_mask;
+static uint32_t rrl_v6_mask[4];
+
+
+static void rrl_meter_tmpl_init(enum rrl_class cls, uint32_t rate) {
+    struct rte_meter_srtcm_params params;
+
+    rrl_rates[cls] = rate;
+    if (rate == 0) {
+        return;
+    }
+    /* one token is one response */
+    params.cir = rate;
+    params.cbs = (uint64_t)rate * g_dns_cfg->rrl.burst;
+    params.ebs = 0;
+    if (rte_meter_srtcm_config(&rrl_meter_tmpl[cls], &params) != 0) {
+        log_msg(LOG_ERR, "rrl: invalid meter config for class %d rate %u\n", cls, rate);
+        exit(-1);
+    }
+}
+
+void rrl_init(void) {
+    struct rrl_config *cfg = &g_dns_cfg->rrl;
+    int i;
+
+    rrl_enable = cfg->enable;
+    if (!rrl_enable) {
+        return;
+    }
+    rrl_hash_seed = (uint32_t)rte_rand();
+
+    rrl_meter_tmpl_init(RRL_CLASS_ANSWER, cfg->answer_rate);
+    rrl_meter_tmpl_init(RRL_CLASS_NXDOMAIN, cfg->nxdomain_rate);
+    rrl_meter_tmpl_init(RRL_CLASS_FORWARD, cfg->fwd_rate);
+
+    rrl_v4_mask = cfg->ipv4_prefix_len == 0 ? 0 :
+        rte_cpu_to_be_32(~0U << (32 - cfg->ipv4_prefix_len));
+    for (i = 0; i < 4; i++) {
+        int bits = (int)cfg->ipv6_prefix_len - i * 32;
+        if (bits >= 32)
+            rrl_v6_mask[i] = ~0U;
+        else if (bits <= 0)
+            rrl_v6_mask[i] = 0;
+        else
+            rrl_v6_mask[i] = rte_cpu_to_be_32(~0U << (32 - bits));
+    }
+
+    log_msg(LOG_INFO, "rrl: answer %u/s nxdomain %u/s fwd %u/s burst %us slip %u prefix /%u /%u\n",
+        cfg->answer_rate, cfg->nxdomain_rate, cfg->fwd_rate, cfg->burst, cfg->slip,
+        cfg->ipv4_prefix_len, cfg->ipv6_prefix_len);
+}
+
+int rrl_lcore_init(unsigned lcore_id) {
+    struct rrl_table *table;
+    uint64_t now = rte_rdtsc();
+    size_t size;
+    uint32_t i;
+    int j;
+
+    if (!rrl_enable) {
+        return 0;
+    }
+    size = sizeof(struct rrl_table) + g_dns_cfg->rrl.table_size * sizeof(struct rrl_bucket);
+    table = rte_zmalloc_socket("rrl_table", size, RTE_CACHE_LINE_SIZE,
+        rte_lcore_to_socket_id(lcore_id));
+    if (table == NULL) {
+        log_msg(LOG_ERR, "rrl: cannot alloc table for lcore %u\n", lcore_id);
+        return -1;
+    }
+    table->mask = g_dns_cfg->rrl.table_size / RRL_WAYS - 1;
+    for (i = 0; i < g_dns_cfg->rrl.table_size; i++) {
+        for (j = 0; j < RRL_CLASS_MAX; j++) {
+            table->buckets[i].meters[j] = rrl_meter_tmpl[j];
+            table->buckets[i].meters[j].time = now;
+        }
+    }
+    rrl_tables[lcore_id] = table;
+    return 0;
+}
+
+enum rrl_class rrl_response_class(kdns_query_st *query) {
+    switch (GET_RCODE(query->packet)) {
+    case RCODE_REFUSE:
+        return RRL_CLASS_FORWARD;
+    case RCODE_NXDOMAIN:
+        return RRL_CLASS_NXDOMAIN;
+    default:
+        return RRL_CLASS_ANSWER;
+    }
+}
+
+/*
+ * The bucket of the prefix in its set. A new prefix keeps the tokens and the
+ * slip count of the bucket it takes over, idle ones have refilled meanwhile.
+ */
+static struct rrl_bucket *rrl_bucket_get(struct netif_queue_conf *conf, struct rrl_table *table,
+        uint32_t hash, const uint32_t *key, uint8_t family, uint64_t now) {
+    struct rrl_bucket *set = &table->buckets[(hash & table->mask) * RRL_WAYS];
+    struct rrl_bucket *lru = set;
+    int i;
+
+    for (i = 0; i < RRL_WAYS; i++) {
+        if (set[i].family == family && memcmp(set[i].key, key, sizeof(set[i].key)) == 0) {
+            set[i].last = now;
+            return &set[i];
+        }
+        if (set[i].last < lru->last) {
+            lru = &set[i];
+        }
+    }
+    if (lru->family != RRL_FAMILY_NONE) {
+        conf->stats.rrl_evicted++;
+    }
+    memcpy(lru->key, key, sizeof(lru->key));
+    lru->family = family;
+    lru->last = now;
+    return lru;
+}
+
+static enum rrl_action rrl_bucket_check(struct netif_queue_conf *conf, struct rrl_table *table,
+        uint32_t hash, const uint32_t *key, uint8_t family, enum rrl_class cls) {
+    uint64_t now = rte_rdtsc();
+    struct rrl_bucket *b = rrl_bucket_get(conf, table, hash, key, family, now);
+
+    if (rte_meter_srtcm_color_blind_check(&b->meters[cls], now, 1) != e_RTE_METER_RED) {
+        return RRL_ACTION_PASS;
+    }
+
+    switch (cls) {
+    case RRL_CLASS_ANSWER:
+        conf->stats.rrl_answer_limited++;
+        break;
+    case RRL_CLASS_NXDOMAIN:
+        conf->stats.rrl_nxdomain_limited++;
+        break;
+    default:
+        conf->stats.rrl_fwd_limited++;
+        break;
+    }
+    if (g_dns_cfg->rrl.slip && ++b->slip_count >= g_dns_cfg->rrl.slip) {
+        b->slip_count = 0;
+        conf->stats.rrl_slipped++;
+        return RRL_ACTION_SLIP;
+    }
+    conf->stats.rrl_dropped++;
+    return RRL_ACTION_DROP;
+}
+
+enum rrl_action rrl_check_v4(struct netif_queue_conf *conf, uint32_t src_addr,
+        enum rrl_class cls) {
+    struct rrl_table *table = rrl_tables[rte_lcore_id()];
+    uint32_t key[4] = {0};
+
+    if (rrl_rates[cls] == 0) {
+        return RRL_ACTION_PASS;
+    }
+    key[0] = src_addr & rrl_v4_mask;
+    return rrl_bucket_check(conf, table, rte_jhash_1word(key[0], rrl_hash_seed), key, RRL_FAMILY_V4, cls);
+}
+
+enum rrl_action rrl_check_v6(struct netif_queue_conf *conf, const uint8_t *src_addr,
+        enum rrl_class cls) {
+    struct rrl_table *table = rrl_tables[rte_lcore_id()];
+    uint32_t key[4];
+    int i;
+
+    if (rrl_rates[cls] == 0) {
+        return RRL_ACTION_PASS;
+    }
+    memcpy(key, src_addr, sizeof(key));
+    for (i = 0; i < 4; i++) {
+        key[i] &= rrl_v6_mask[i];
+    }
+    return rrl_bucket_check(conf, table, rte_jhash_32b(key, 4, rrl_hash_seed), key, RRL_FAMILY_V6, cls);
+}
+
+/*
+ * Turn the response in the query buffer into an empty truncated answer that
+ * carries only the question, so that a real client retries over TCP.
+ */
+int rrl_slip_response(kdns_query_st *query) {
+    buffer_st *packet = query->packet;
+    size_t len = DNS_HEAD_SIZE;
+
+    if (GET_QD_COUNT(packet) == 1 && query->qname->name_size > 0) {
+        len += query->qname->name_size + 2 * sizeof(uint16_t);
+    }
+    SET_FLAG_QR(packet);
+    SET_FLAG_TC(packet);
+    RESET_FLAG_AA(packet);
+    SET_RCODE(packet, RCODE_OK);
+    SET_AN_COUNT(packet, 0);
+    SET_NS_COUNT(packet, 0);
+    SET_AR_COUNT(packet, 0);
+
+    buffer_set_position(packet, 0);
+    buffer_setlimit(packet, len);
+    return len;
+}
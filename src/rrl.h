@@ -0,0 +1,36 @@
+#ifndef __RRL_H__
+#define __RRL_H__
+
+#include <stdint.h>
+#include "netdev.h"
+#include "query.h"
+
+/* response classes, each one has its own token bucket per source prefix */
+enum rrl_class {
+    RRL_CLASS_ANSWER,
+    RRL_CLASS_NXDOMAIN,
+    RRL_CLASS_FORWARD,
+    RRL_CLASS_MAX
+};
+
+enum rrl_action {
+    RRL_ACTION_PASS,
+    RRL_ACTION_DROP,
+    RRL_ACTION_SLIP,   /* send an empty TC=1 response instead */
+};
+
+extern int rrl_enable;
+
+void rrl_init(void);
+int rrl_lcore_init(unsigned lcore_id);
+
+enum rrl_class rrl_response_class(kdns_query_st *query);
+
+enum rrl_action rrl_check_v4(struct netif_queue_conf *conf, uint32_t src_addr,
+    enum rrl_class cls);
+enum rrl_action rrl_check_v6(struct netif_queue_conf *conf, const uint8_t *src_addr,
+    enum rrl_class cls);
+
+int rrl_slip_response(kdns_query_st *query);
+
+#endif
@@ -0,0 +1,151 @@
+/*
+ * service.c -- the work of the master, as services run by the master loop or
+ * by threads of their own
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE     /* pthread_attr_setaffinity_np */
+#endif
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+
+#include "service.h"
+#include "idle.h"
+#include "util.h"
+
+struct service kdns_services[SERVICE_MAX];
+uint16_t kdns_service_num;
+
+/* the services of one thread, each runs once per round with its budget */
+struct service_thread {
+    int cpu;
+    uint16_t num;
+    struct service *services[SERVICE_MAX];
+};
+
+
+void service_register(const char *name, service_run_t run, uint32_t budget, int cpu) {
+    struct service *s;
+
+    if (kdns_service_num == SERVICE_MAX) {
+        log_msg(LOG_ERR, "service: no room for %s\n", name);
+        exit(-1);
+    }
+    s = &kdns_services[kdns_service_num++];
+    memset(s, 0, sizeof(*s));
+    s->name = name;
+    s->run = run;
+    s->budget = budget;
+    s->cpu = cpu;
+}
+
+static uint32_t service_run(struct service *s) {
+    uint64_t start = rte_rdtsc(), cycles;
+    uint32_t work;
+
+    work = s->run(s->budget);
+    cycles = rte_rdtsc() - start;
+    s->stats.runs++;
+    if (work > 0) {
+        s->stats.busy_runs++;
+        s->stats.work += work;
+        s->stats.busy_cycles += cycles;
+        if (work >= s->budget)
+            s->stats.budget_full++;
+    } else {
+        s->stats.idle_cycles += cycles;
+    }
+    return work;
+}
+
+static void *service_thread_loop(void *arg) {
+    struct service_thread *t = arg;
+    uint32_t work;
+    uint16_t i;
+
+    if (idle_thread_init() < 0) {
+        exit(-1);
+    }
+    while (1) {
+        work = 0;
+        for (i = 0; i < t->num; i++)
+            work += service_run(t->services[i]);
+        idle_update(work > 0);
+    }
+    return NULL;
+}
+
+/* one thread per cpu some services are pinned to, the rest stay on the master */
+void service_start(void) {
+    struct service_thread *t;
+    pthread_attr_t attr;
+    pthread_t tid;
+    cpu_set_t cpus;
+    char name[16];
+    uint16_t i, j;
+
+    for (i = 0; i < kdns_service_num; i++) {
+        if (kdns_services[i].cpu == SERVICE_CPU_MASTER)
+            continue;
+        for (j = 0; j < i; j++) {
+            if (kdns_services[j].cpu == kdns_services[i].cpu)
+                break;
+        }
+        if (j < i)
+            continue;
+
+        t = xalloc(sizeof(*t));
+        memset(t, 0, sizeof(*t));
+        t->cpu = kdns_services[i].cpu;
+        for (j = i; j < kdns_service_num; j++) {
+            if (kdns_services[j].cpu == t->cpu)
+                t->services[t->num++] = &kdns_services[j];
+        }
+        CPU_ZERO(&cpus);
+        CPU_SET(t->cpu, &cpus);
+        pthread_attr_init(&attr);
+        pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+        if (pthread_create(&tid, &attr, service_thread_loop, t) != 0) {
+            log_msg(LOG_ERR, "service: cannot start the thread of cpu %d\n", t->cpu);
+            exit(-1);
+        }
+        pthread_attr_destroy(&attr);
+        snprintf(name, sizeof(name), "svc-cpu%d", t->cpu);
+        pthread_setname_np(tid, name);
+        for (j = 0; j < t->num; j++)
+            log_msg(LOG_INFO, "service %s on cpu %d, budget %u\n", t->services[j]->name, t->cpu,
+                t->services[j]->budget);
+    }
+}
+
+/* one round of the services left on the master */
+uint32_t service_master_run(void) {
+    uint32_t work = 0;
+    uint16_t i;
+
+    for (i = 0; i < kdns_service_num; i++) {
+        if (kdns_services[i].cpu == SERVICE_CPU_MASTER)
+            work += service_run(&kdns_services[i]);
+    }
+    return work;
+}
+
+int service_master_num(void) {
+    int n = 0;
+    uint16_t i;
+
+    for (i = 0; i < kdns_service_num; i++) {
+        if (kdns_services[i].cpu == SERVICE_CPU_MASTER)
+            n++;
+    }
+    return n;
+}
+
+void service_stats_reset(void) {
+    uint16_t i;
+
+    for (i = 0; i < kdns_service_num; i++)
+        memset(&kdns_services[i].stats, 0, sizeof(struct service_stats));
+}
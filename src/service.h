@@ -0,0 +1,40 @@
+#ifndef __SERVICE_H__
+#define __SERVICE_H__
+
+#include <stdint.h>
+
+#define SERVICE_MAX         4
+#define SERVICE_CPU_MASTER  (-1)
+
+/* runs once with the most items it may handle, returns those it handled */
+typedef uint32_t (*service_run_t)(uint32_t budget);
+
+/* single writer, the thread running the service */
+struct service_stats {
+    uint64_t runs;
+    uint64_t busy_runs;     /* runs that handled something */
+    uint64_t budget_full;   /* runs that used the whole budget, the service lags */
+    uint64_t work;          /* items handled */
+    uint64_t busy_cycles;   /* spent in the busy runs */
+    uint64_t idle_cycles;   /* spent in the others */
+};
+
+struct service {
+    const char *name;
+    service_run_t run;
+    uint32_t budget;
+    int cpu;                /* the thread it runs on, SERVICE_CPU_MASTER for the master loop */
+    struct service_stats stats;
+};
+
+extern struct service kdns_services[SERVICE_MAX];
+extern uint16_t kdns_service_num;
+
+void service_register(const char *name, service_run_t run, uint32_t budget, int cpu);
+void service_start(void);
+uint32_t service_master_run(void);
+int service_master_num(void);
+
+void service_stats_reset(void);
+
+#endif
@@ -20,6 +20,7 @@
 
 #include "db_update.h"
 #include "query.h"
+#include "view.h"
 
 
 
@@ -33,7 +34,7 @@ static struct  query *query_tcp = NULL;
 
 int tcp_domian_databd_update(struct domin_info_update* update){
     
-    return domaindata_update(kdns_tcp.db,update);
+    return domaindata_update(kdns_view_db_get(&kdns_tcp, update->view_id),update);
 }
 
 
@@ -124,6 +125,8 @@ static void *dns_tcp_process(void *arg) {
 
     kdns_zones_soa_create( kdns_tcp.db,g_dns_cfg->comm.zones);
 
+    kdns_views_prepare(&kdns_tcp);
+
 
     query_tcp = query_create();
     
@@ -167,6 +170,7 @@ static void *dns_tcp_process(void *arg) {
 
             query_reset(query_tcp);
             query_tcp->maxMsgLen = TCP_MAX_MESSAGE_LEN;
+            query_tcp->view_id = view_lookup_v4(pin.sin_addr.s_addr);
 
             query_tcp->packet->data = (uint8_t *)(buf+2); // skip len
 
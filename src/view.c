@@ -0,0 +1,131 @@
+/*
+ * view.c -- source prefix views (split horizon)
+ */
+#include <string.h>
+#include <stdlib.h>
+#include <arpa/inet.h>
+#include <rte_lpm.h>
+#include <rte_mbuf.h>
+#include <rte_lcore.h>
+#include <rte_byteorder.h>
+
+#include "view.h"
+#include "dns-conf.h"
+#include "kdns-adap.h"
+#include "util.h"
+
+#define VIEW_LPM_MAX_RULES  4096
+#define VIEW_LPM_TBL8S      256
+
+extern void domain_store_zones_check_create(struct kdns*  kdns, char *zones);
+
+uint8_t view_num = 1;
+
+/* read only after init, shared by all lcores */
+static struct rte_lpm *view_lpm = NULL;
+
+
+static int view_prefix_parse(char *str, uint32_t *ip, uint8_t *depth) {
+    struct in_addr addr;
+    char *slash = strchr(str, '/');
+    int len = 32;
+
+    if (slash) {
+        *slash = '\0';
+        len = atoi(slash + 1);
+    }
+    if (inet_pton(AF_INET, str, &addr) <= 0 || len <= 0 || len > 32) {
+        return -1;
+    }
+    *ip = rte_be_to_cpu_32(addr.s_addr);
+    *depth = len;
+    return 0;
+}
+
+void view_init(void) {
+    struct view_config *cfg = &g_dns_cfg->view;
+    struct rte_lpm_config lpm_cfg;
+    char tmp[1024];
+    char *prefix, *save;
+    uint32_t ip;
+    uint8_t depth;
+    int i;
+
+    view_num = cfg->view_num;
+    if (view_num <= 1) {
+        return;
+    }
+
+    lpm_cfg.max_rules = VIEW_LPM_MAX_RULES;
+    lpm_cfg.number_tbl8s = VIEW_LPM_TBL8S;
+    lpm_cfg.flags = 0;
+    view_lpm = rte_lpm_create("view_lpm", rte_socket_id(), &lpm_cfg);
+    if (view_lpm == NULL) {
+        log_msg(LOG_ERR, "view: cannot create lpm table\n");
+        exit(-1);
+    }
+
+    for (i = 1; i < view_num; i++) {
+        snprintf(tmp, sizeof(tmp), "%s", cfg->prefixes[i]);
+        for (prefix = strtok_r(tmp, ",", &save); prefix; prefix = strtok_r(NULL, ",", &save)) {
+            while (*prefix == ' ')
+                prefix++;
+            if (view_prefix_parse(prefix, &ip, &depth) < 0) {
+                log_msg(LOG_ERR, "view %s: invalid prefix %s\n", cfg->names[i], prefix);
+                exit(-1);
+            }
+            if (rte_lpm_add(view_lpm, ip, depth, i) < 0) {
+                log_msg(LOG_ERR, "view %s: cannot add prefix %s/%u\n", cfg->names[i], prefix, depth);
+                exit(-1);
+            }
+        }
+        log_msg(LOG_INFO, "view %s(%d): %s\n", cfg->names[i], i, cfg->prefixes[i]);
+    }
+}
+
+uint8_t view_lookup_v4(uint32_t src_addr) {
+    uint32_t next_hop;
+
+    if (view_lpm == NULL || rte_lpm_lookup(view_lpm, rte_be_to_cpu_32(src_addr), &next_hop) != 0) {
+        return VIEW_ID_DEFAULT;
+    }
+    return (uint8_t)next_hop;
+}
+
+uint8_t view_id_get(const char *name) {
+    int i;
+
+    for (i = 0; i < view_num; i++) {
+        if (strcmp(g_dns_cfg->view.names[i], name) == 0) {
+            return i;
+        }
+    }
+    return VIEW_ID_ERR;
+}
+
+const char *view_name_get(uint8_t view_id) {
+    return g_dns_cfg->view.names[view_id];
+}
+
+void kdns_views_prepare(struct kdns *kdns) {
+    struct kdns view_kdns;
+    int i;
+
+    for (i = 1; i < view_num; i++) {
+        memset(&view_kdns, 0, sizeof(view_kdns));
+        if ((view_kdns.db = domain_store_open()) == NULL) {
+            log_msg(LOG_ERR, "unable to open the database of view %s\n", view_name_get(i));
+            exit(-1);
+        }
+        domain_store_zones_check_create(&view_kdns, g_dns_cfg->comm.zones);
+        kdns_zones_soa_create(view_kdns.db, g_dns_cfg->comm.zones);
+        kdns->views[i] = view_kdns.db;
+    }
+}
+
+struct domain_store *kdns_view_db_get(struct kdns *kdns, uint8_t view_id) {
+    if (view_id == VIEW_ID_DEFAULT || kdns->views[view_id] == NULL) {
+        return kdns->db;
+    }
+    return kdns->views[view_id];
+}
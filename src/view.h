@@ -0,0 +1,24 @@
+#ifndef __VIEW_H__
+#define __VIEW_H__
+
+#include <stdint.h>
+#include "kdns.h"
+
+#define VIEW_ID_DEFAULT  0
+#define VIEW_ID_ERR      0xFF
+
+extern uint8_t view_num;
+
+void view_init(void);
+
+/* client ipv4 address in network order to view id, VIEW_ID_DEFAULT if none matches */
+uint8_t view_lookup_v4(uint32_t src_addr);
+
+uint8_t view_id_get(const char *name);
+const char *view_name_get(uint8_t view_id);
+
+/* overlay stores for the configured views, db of the kdns must be opened first */
+void kdns_views_prepare(struct kdns *kdns);
+struct domain_store *kdns_view_db_get(struct kdns *kdns, uint8_t view_id);
+
+#endif